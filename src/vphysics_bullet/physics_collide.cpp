@@ -5,6 +5,7 @@
 #include "physics_parse.h"
 #include "physics_object.h"
 #include <LinearMath/btGeometryUtil.h>
+#include <LinearMath/btThreads.h>
 #include "mathlib/polyhedron.h"
 #include "mathlib/vplane.h"
 #include "tier0/dbg.h"
@@ -14,27 +15,9 @@ CPhysicsCollision *g_pPhysCollision = &s_PhysCollision;
 EXPOSE_SINGLE_INTERFACE_GLOBALVAR(CPhysicsCollision, IPhysicsCollision,
 		VPHYSICS_COLLISION_INTERFACE_VERSION, s_PhysCollision);
 
-CPhysicsCollision::CPhysicsCollision() :
-		m_InContactTest(false),
-		m_TraceBoxShape(btVector3(1.0f, 1.0f, 1.0f)),
-		m_TracePointShape(VPHYSICS_CONVEX_DISTANCE_MARGIN),
-		m_TraceConeShape(1.0f, 1.0f) {
-	m_TraceBoxShape.setMargin(VPHYSICS_CONVEX_DISTANCE_MARGIN);
-	m_TraceConeShape.setMargin(VPHYSICS_CONVEX_DISTANCE_MARGIN);
-
-	m_ContactTestCollisionConfiguration = VPhysicsNew(btDefaultCollisionConfiguration);
-	m_ContactTestDispatcher = VPhysicsNew(btCollisionDispatcher, m_ContactTestCollisionConfiguration);
-	m_ContactTestBroadphase = VPhysicsNew(btSimpleBroadphase, 2); // 0 is dangerous as it's array size.
-	m_ContactTestCollisionWorld = VPhysicsNew(btCollisionWorld,
-			m_ContactTestDispatcher, m_ContactTestBroadphase, m_ContactTestCollisionConfiguration);
-}
+CPhysicsCollision::CPhysicsCollision() : m_AsyncLoader(nullptr) {}
 
 CPhysicsCollision::~CPhysicsCollision() {
-	VPhysicsDelete(btCollisionWorld, m_ContactTestCollisionWorld);
-	VPhysicsDelete(btSimpleBroadphase, m_ContactTestBroadphase);
-	VPhysicsDelete(btCollisionDispatcher, m_ContactTestDispatcher);
-	VPhysicsDelete(btDefaultCollisionConfiguration, m_ContactTestCollisionConfiguration);
-
 	int sphereCount = m_SphereCache.Count();
 	for (int sphereIndex = 0; sphereIndex < sphereCount; ++sphereIndex) {
 		CPhysCollide_Sphere *sphere = m_SphereCache[sphereIndex];
@@ -64,12 +47,18 @@ CPhysicsCollision::~CPhysicsCollision() {
 
 IPhysicsCollision *CPhysicsCollision::ThreadContextCreate() {
 	// IVP VPhysics v29 used to create a new CPhysicsCollision, but v31 returns this.
-	// Due to g_pPhysCollision references, and because object reference lists are thread-unsafe,
-	// this VPhysics implementation has to be single-threaded.
-	return this;
+	// Only queries and loading of VCollides are safe to do concurrently - they have their own scratch state.
+	// Other creation and destruction of collideables still has to be single-threaded
+	// because of the shared caches and object reference lists.
+	return VPhysicsNew(CPhysicsCollisionThreadContext);
 }
 
-void CPhysicsCollision::ThreadContextDestroy(IPhysicsCollision *pThreadContext) {}
+void CPhysicsCollision::ThreadContextDestroy(IPhysicsCollision *pThreadContext) {
+	if (pThreadContext != nullptr && pThreadContext != this) {
+		VPhysicsDelete(CPhysicsCollisionThreadContext,
+				static_cast<CPhysicsCollisionThreadContext *>(pThreadContext));
+	}
+}
 
 /***************************
  * Serialization structures
@@ -85,6 +74,7 @@ void CPhysicsCollision::ThreadContextDestroy(IPhysicsCollision *pThreadContext)
 // To completely prevent loading Bullet collideables in IVP and
 // other VPhysics implementations, and also to version separately.
 #define VCOLLIDE_VERSION_BULLET 0x3b00
+#define VCOLLIDE_MODEL_TYPE_BULLET_COMPOUND 1
 
 BEGIN_BYTESWAP_DATADESC(VCollide_SurfaceHeader)
 	DEFINE_FIELD(vphysicsID, FIELD_INTEGER),
@@ -149,6 +139,16 @@ btVector3 CPhysicsCollision::OffsetInertia(
 	return absolute ? newInertia.absolute() : newInertia;
 }
 
+static void SaveSerializedVector(const btVector3 &vector, float *output) {
+	output[0] = (float) vector.getX();
+	output[1] = (float) vector.getY();
+	output[2] = (float) vector.getZ();
+}
+
+static btVector3 LoadSerializedVector(const float *vector) {
+	return btVector3(vector[0], vector[1], vector[2]);
+}
+
 /***********
  * Convexes
  ***********/
@@ -181,6 +181,372 @@ void CPhysicsCollision::ConvexFree(CPhysConvex *pConvex) {
  * Convex hulls
  ***************/
 
+// Below this, a linear scan is about as fast as climbing.
+#define HULL_HILL_CLIMBING_MIN_POINTS 32
+// Quantizing to 16 bits keeps this up to about 4096 units, which covers props and most brushes.
+#define HULL_QUANTIZATION_MAX_ERROR HL2BULLET(1.0f / 32.0f)
+// Triangles with all vertices this close to the plane of a face are merged into it - the points are rounded.
+#define HULL_FACE_MERGE_DISTANCE (2.0f * HULL_QUANTIZATION_MAX_ERROR)
+
+// The warm start of the pair being processed on this thread, or nullptr outside collision algorithms.
+static CThreadLocalPtr<CPhysConvex_Hull::SupportWarmStart_t> s_SupportWarmStart;
+
+CPhysConvex_Hull::SupportWarmStartScope::SupportWarmStartScope(SupportWarmStart_t &warmStart,
+		const btCollisionShape *shape0, const btCollisionShape *shape1) {
+	if (warmStart.m_Shapes[0] != shape0 || warmStart.m_Shapes[1] != shape1) {
+		warmStart.m_Shapes[0] = shape0;
+		warmStart.m_Shapes[1] = shape1;
+		warmStart.m_Vertices[0] = warmStart.m_Vertices[1] = 0;
+	}
+	m_PreviousWarmStart = s_SupportWarmStart;
+	s_SupportWarmStart = &warmStart;
+}
+
+CPhysConvex_Hull::SupportWarmStartScope::~SupportWarmStartScope() {
+	s_SupportWarmStart = m_PreviousWarmStart;
+}
+
+CPhysConvex_Hull::HullShape::HullShape(const btScalar *points, int pointCount, int pointStride) {
+	// Bullet's non-virtual support mapping scans CONVEX_HULL_SHAPE_PROXYTYPE shapes itself,
+	// the virtual one is only called for other shape types.
+	m_shapeType = CUSTOM_POLYHEDRAL_SHAPE_TYPE;
+
+	Assert(pointCount > 0 && pointCount <= VPHYSICS_HULL_MAX_POINTS);
+	const byte *pointBytes = reinterpret_cast<const byte *>(points);
+	btVector3 pointsMin(BT_LARGE_FLOAT, BT_LARGE_FLOAT, BT_LARGE_FLOAT);
+	btVector3 pointsMax(-BT_LARGE_FLOAT, -BT_LARGE_FLOAT, -BT_LARGE_FLOAT);
+	for (int pointIndex = 0; pointIndex < pointCount; ++pointIndex) {
+		const btScalar *point = reinterpret_cast<const btScalar *>(pointBytes + pointIndex * pointStride);
+		btVector3 pointVector(point[0], point[1], point[2]);
+		pointsMin.setMin(pointVector);
+		pointsMax.setMax(pointVector);
+	}
+	m_QuantizationStep = (pointsMax - pointsMin) * (1.0f / 65535.0f);
+
+	if (m_QuantizationStep[m_QuantizationStep.maxAxis()] * 0.5f > HULL_QUANTIZATION_MAX_ERROR) {
+		// The support mapping multiplies by the step anyway.
+		m_QuantizationOrigin.setZero();
+		m_QuantizationStep.setValue(1.0f, 1.0f, 1.0f);
+		m_FullPrecisionPoints.resizeNoInitialize(pointCount);
+		for (int pointIndex = 0; pointIndex < pointCount; ++pointIndex) {
+			const btScalar *point = reinterpret_cast<const btScalar *>(pointBytes + pointIndex * pointStride);
+			m_FullPrecisionPoints[pointIndex].setValue(point[0], point[1], point[2]);
+		}
+		recalcLocalAabb();
+		return;
+	}
+
+	m_QuantizationOrigin = pointsMin;
+	btVector3 quantizationScale;
+	for (int axis = 0; axis < 3; ++axis) {
+		// Flat along this axis.
+		quantizationScale[axis] = (m_QuantizationStep[axis] > 0.0f ? 1.0f / m_QuantizationStep[axis] : 0.0f);
+	}
+
+	m_QuantizedPoints.resizeNoInitialize(pointCount * 3);
+	unsigned short *quantizedPoints = &m_QuantizedPoints[0];
+	for (int pointIndex = 0; pointIndex < pointCount; ++pointIndex) {
+		const btScalar *point = reinterpret_cast<const btScalar *>(pointBytes + pointIndex * pointStride);
+		btVector3 quantizedPoint = (btVector3(point[0], point[1], point[2]) - pointsMin) * quantizationScale;
+		for (int axis = 0; axis < 3; ++axis) {
+			quantizedPoints[pointIndex * 3 + axis] = (unsigned short) MIN((int) (quantizedPoint[axis] + 0.5f), 65535);
+		}
+	}
+
+	recalcLocalAabb();
+}
+
+void CPhysConvex_Hull::HullShape::GetPoints(btAlignedObjectArray<btVector3> &points) const {
+	int pointCount = GetPointCount();
+	points.resizeNoInitialize(pointCount);
+	for (int pointIndex = 0; pointIndex < pointCount; ++pointIndex) {
+		points[pointIndex] = GetPoint(pointIndex);
+	}
+}
+
+void CPhysConvex_Hull::HullShape::BuildAdjacency(const btAlignedObjectArray<unsigned short> &triangleIndices) {
+	int pointCount = GetPointCount();
+	int indexCount = triangleIndices.size();
+	if (pointCount < HULL_HILL_CLIMBING_MIN_POINTS || indexCount < 3) {
+		return;
+	}
+
+	// The windings from different sources are not consistent, so both directions of every edge are added,
+	// and then the duplicates are removed.
+	m_NeighborOffsets.resize(pointCount + 1, 0);
+	for (int indexIndex = 0; indexIndex < indexCount; ++indexIndex) {
+		int index = triangleIndices[indexIndex];
+		Assert(index < pointCount);
+		if (index >= pointCount) {
+			m_NeighborOffsets.clear();
+			return;
+		}
+		m_NeighborOffsets[index + 1] += 2;
+	}
+	for (int pointIndex = 0; pointIndex < pointCount; ++pointIndex) {
+		if (m_NeighborOffsets[pointIndex + 1] == 0) {
+			// Not on any triangle - if it's actually an extreme point, climbing would never reach it.
+			m_NeighborOffsets.clear();
+			return;
+		}
+		m_NeighborOffsets[pointIndex + 1] += m_NeighborOffsets[pointIndex];
+	}
+
+	m_Neighbors.resizeNoInitialize(m_NeighborOffsets[pointCount]);
+	btAlignedObjectArray<int> neighborCounts;
+	neighborCounts.resize(pointCount, 0);
+	int triangleCount = indexCount / 3;
+	for (int triangleIndex = 0; triangleIndex < triangleCount; ++triangleIndex) {
+		const unsigned short *indices = &triangleIndices[triangleIndex * 3];
+		for (int edgeIndex = 0; edgeIndex < 3; ++edgeIndex) {
+			int edgeStart = (int) indices[edgeIndex], edgeEnd = (int) indices[edgeIndex < 2 ? edgeIndex + 1 : 0];
+			m_Neighbors[m_NeighborOffsets[edgeStart] + neighborCounts[edgeStart]++] = (unsigned short) edgeEnd;
+			m_Neighbors[m_NeighborOffsets[edgeEnd] + neighborCounts[edgeEnd]++] = (unsigned short) edgeStart;
+		}
+	}
+
+	// Compact in place, also dropping the edges of degenerate triangles.
+	int neighborCount = 0;
+	for (int pointIndex = 0; pointIndex < pointCount; ++pointIndex) {
+		int listStart = m_NeighborOffsets[pointIndex], listEnd = m_NeighborOffsets[pointIndex + 1];
+		int compactedStart = neighborCount;
+		m_NeighborOffsets[pointIndex] = compactedStart;
+		for (int listIndex = listStart; listIndex < listEnd; ++listIndex) {
+			int neighbor = m_Neighbors[listIndex];
+			if (neighbor == pointIndex) {
+				continue;
+			}
+			int compactedIndex;
+			for (compactedIndex = compactedStart; compactedIndex < neighborCount; ++compactedIndex) {
+				if (m_Neighbors[compactedIndex] == neighbor) {
+					break;
+				}
+			}
+			if (compactedIndex == neighborCount) {
+				m_Neighbors[neighborCount++] = (unsigned short) neighbor;
+			}
+		}
+	}
+	m_NeighborOffsets[pointCount] = neighborCount;
+	m_Neighbors.resize(neighborCount);
+}
+
+void CPhysConvex_Hull::HullShape::BuildPolyhedralFeatures(
+		const btAlignedObjectArray<unsigned short> &triangleIndices) {
+	Assert(m_polyhedron == nullptr);
+	int pointCount = GetPointCount();
+	int triangleCount = triangleIndices.size() / 3;
+	if (triangleCount < 4) {
+		return;
+	}
+
+	btConvexPolyhedron *polyhedron = new(btAlignedAlloc(sizeof(btConvexPolyhedron), 16)) btConvexPolyhedron;
+	polyhedron->m_vertices.resizeNoInitialize(pointCount);
+	btVector3 center(0.0f, 0.0f, 0.0f);
+	for (int pointIndex = 0; pointIndex < pointCount; ++pointIndex) {
+		getVertex(pointIndex, polyhedron->m_vertices[pointIndex]);
+		center += polyhedron->m_vertices[pointIndex];
+	}
+	center /= btScalar(pointCount);
+	const btVector3 *vertices = &polyhedron->m_vertices[0];
+
+	// The windings from different sources are not consistent, so the normals are pointed away from the center,
+	// and the coplanar triangles are merged into polygons, ordered counterclockwise around the normal.
+	btAlignedObjectArray<bool> triangleMerged;
+	triangleMerged.resize(triangleCount, false);
+	btAlignedObjectArray<int> faceVertices;
+	btAlignedObjectArray<btScalar> faceAngles;
+	for (int triangleIndex = 0; triangleIndex < triangleCount; ++triangleIndex) {
+		if (triangleMerged[triangleIndex]) {
+			continue;
+		}
+		triangleMerged[triangleIndex] = true;
+		const unsigned short *indices = &triangleIndices[triangleIndex * 3];
+		const btVector3 &vertex0 = vertices[indices[0]];
+		btVector3 normal = (vertices[indices[1]] - vertex0).cross(vertices[indices[2]] - vertex0);
+		if (normal.length2() <= SIMD_EPSILON * SIMD_EPSILON) {
+			continue;
+		}
+		normal.normalize();
+		if (normal.dot(vertex0 - center) < 0.0f) {
+			normal = -normal;
+		}
+		btScalar planeDistance = normal.dot(vertex0);
+
+		faceVertices.resizeNoInitialize(0);
+		for (int mergedIndex = triangleIndex; mergedIndex < triangleCount; ++mergedIndex) {
+			const unsigned short *mergedIndices = &triangleIndices[mergedIndex * 3];
+			if (mergedIndex != triangleIndex) {
+				if (triangleMerged[mergedIndex]) {
+					continue;
+				}
+				const btVector3 &mergedVertex0 = vertices[mergedIndices[0]];
+				btVector3 mergedNormal = (vertices[mergedIndices[1]] - mergedVertex0).cross(
+						vertices[mergedIndices[2]] - mergedVertex0);
+				if (mergedNormal.length2() > SIMD_EPSILON * SIMD_EPSILON &&
+						mergedNormal.dot(mergedVertex0 - center) * mergedNormal.dot(normal) < 0.0f) {
+					// Facing the other way, such as the opposite side of a thin hull.
+					continue;
+				}
+				int vertexIndex;
+				for (vertexIndex = 0; vertexIndex < 3; ++vertexIndex) {
+					if (btFabs(normal.dot(vertices[mergedIndices[vertexIndex]]) - planeDistance) >
+							HULL_FACE_MERGE_DISTANCE) {
+						break;
+					}
+				}
+				if (vertexIndex < 3) {
+					continue;
+				}
+				triangleMerged[mergedIndex] = true;
+			}
+			for (int vertexIndex = 0; vertexIndex < 3; ++vertexIndex) {
+				int faceVertex = mergedIndices[vertexIndex];
+				if (faceVertices.findLinearSearch(faceVertex) == faceVertices.size()) {
+					faceVertices.push_back(faceVertex);
+				}
+			}
+		}
+
+		// Faces of a convex hull are convex, so the vertices can be ordered by the angle around the middle.
+		int faceVertexCount = faceVertices.size();
+		btVector3 faceCenter(0.0f, 0.0f, 0.0f);
+		for (int faceVertexIndex = 0; faceVertexIndex < faceVertexCount; ++faceVertexIndex) {
+			faceCenter += vertices[faceVertices[faceVertexIndex]];
+		}
+		faceCenter /= btScalar(faceVertexCount);
+		btVector3 tangent, bitangent; // tangent x bitangent = normal.
+		btPlaneSpace1(normal, tangent, bitangent);
+		faceAngles.resizeNoInitialize(faceVertexCount);
+		btScalar faceDistance = -BT_LARGE_FLOAT;
+		for (int faceVertexIndex = 0; faceVertexIndex < faceVertexCount; ++faceVertexIndex) {
+			const btVector3 &faceVertex = vertices[faceVertices[faceVertexIndex]];
+			btVector3 offset = faceVertex - faceCenter;
+			faceAngles[faceVertexIndex] = btAtan2(offset.dot(bitangent), offset.dot(tangent));
+			faceDistance = btMax(faceDistance, normal.dot(faceVertex));
+		}
+		btFace &face = polyhedron->m_faces.expand();
+		face.m_indices.resizeNoInitialize(faceVertexCount);
+		for (int faceVertexIndex = 0; faceVertexIndex < faceVertexCount; ++faceVertexIndex) {
+			int sortedIndex;
+			for (sortedIndex = faceVertexIndex; sortedIndex > 0; --sortedIndex) {
+				if (faceAngles[sortedIndex - 1] <= faceAngles[faceVertexIndex]) {
+					break;
+				}
+			}
+			btScalar angle = faceAngles[faceVertexIndex];
+			int vertex = faceVertices[faceVertexIndex];
+			for (int shiftedIndex = faceVertexIndex; shiftedIndex > sortedIndex; --shiftedIndex) {
+				faceAngles[shiftedIndex] = faceAngles[shiftedIndex - 1];
+				face.m_indices[shiftedIndex] = face.m_indices[shiftedIndex - 1];
+			}
+			faceAngles[sortedIndex] = angle;
+			face.m_indices[sortedIndex] = vertex;
+		}
+		face.m_plane[0] = normal.getX();
+		face.m_plane[1] = normal.getY();
+		face.m_plane[2] = normal.getZ();
+		face.m_plane[3] = -faceDistance;
+	}
+
+	if (polyhedron->m_faces.size() < 4) {
+		polyhedron->~btConvexPolyhedron();
+		btAlignedFree(polyhedron);
+		return;
+	}
+	polyhedron->initialize();
+	m_polyhedron = polyhedron;
+}
+
+int CPhysConvex_Hull::HullShape::FindSupportingPointLinear(const btVector3 &direction) const {
+	int pointCount = GetPointCount();
+	int supportingPoint = 0;
+	btScalar supportingDot = PointDot(0, direction);
+	for (int pointIndex = 1; pointIndex < pointCount; ++pointIndex) {
+		btScalar pointDot = PointDot(pointIndex, direction);
+		if (pointDot > supportingDot) {
+			supportingPoint = pointIndex;
+			supportingDot = pointDot;
+		}
+	}
+	return supportingPoint;
+}
+
+int CPhysConvex_Hull::HullShape::FindSupportingPoint(const btVector3 &direction) const {
+	if (m_NeighborOffsets.size() == 0) {
+		return FindSupportingPointLinear(direction);
+	}
+
+	const int *neighborOffsets = &m_NeighborOffsets[0];
+	const unsigned short *neighbors = &m_Neighbors[0];
+
+	// Queries outside collision algorithms, such as traces, aren't coherent, and start from the first vertex.
+	int *startVertex = nullptr;
+	SupportWarmStart_t *warmStart = s_SupportWarmStart;
+	if (warmStart != nullptr) {
+		if (warmStart->m_Shapes[0] == this) {
+			startVertex = &warmStart->m_Vertices[0];
+		} else if (warmStart->m_Shapes[1] == this) {
+			startVertex = &warmStart->m_Vertices[1];
+		}
+	}
+
+	// A vertex of a convex polyhedron with no neighbor further along a direction is the furthest one.
+	// However, rounding makes the points not exactly convex, so climbing may stop at a local maximum
+	// when an edge is nearly perpendicular to the direction - in this case, all points are checked instead.
+	// Quantized points are rounded by up to half a step on each axis, so two of them may be off by a step.
+	btScalar plateauTolerance = btFabs(direction.getX()) + btFabs(direction.getY()) + btFabs(direction.getZ());
+	if (!IsQuantized()) {
+		plateauTolerance *= HULL_QUANTIZATION_MAX_ERROR;
+	}
+	int vertex = (startVertex != nullptr ? *startVertex : 0);
+	btScalar vertexDot = PointDot(vertex, direction);
+	for (;;) {
+		int nextVertex = -1;
+		btScalar bestNeighborDot = -BT_LARGE_FLOAT;
+		int listEnd = neighborOffsets[vertex + 1];
+		for (int listIndex = neighborOffsets[vertex]; listIndex < listEnd; ++listIndex) {
+			int neighbor = neighbors[listIndex];
+			btScalar neighborDot = PointDot(neighbor, direction);
+			bestNeighborDot = btMax(bestNeighborDot, neighborDot);
+			if (neighborDot > vertexDot) {
+				nextVertex = neighbor;
+				vertexDot = neighborDot;
+			}
+		}
+		if (nextVertex < 0) {
+			if (bestNeighborDot >= vertexDot - plateauTolerance) {
+				vertex = FindSupportingPointLinear(direction);
+			}
+			break;
+		}
+		vertex = nextVertex;
+	}
+	if (startVertex != nullptr) {
+		*startVertex = vertex;
+	}
+	return vertex;
+}
+
+btVector3 CPhysConvex_Hull::HullShape::localGetSupportingVertexWithoutMargin(const btVector3 &vec) const {
+	// Like in btConvexHullShape, dot(a, b * c) = dot(a * b, c),
+	// and the quantization origin adds the same distance to every point.
+	return GetPoint(FindSupportingPoint(vec * m_localScaling * m_QuantizationStep)) * m_localScaling;
+}
+
+void CPhysConvex_Hull::HullShape::batchedUnitVectorGetSupportingVertexWithoutMargin(
+		const btVector3 *vectors, btVector3 *supportVerticesOut, int numVectors) const {
+	for (int vectorIndex = 0; vectorIndex < numVectors; ++vectorIndex) {
+		supportVerticesOut[vectorIndex] = localGetSupportingVertexWithoutMargin(vectors[vectorIndex]);
+	}
+}
+
+void CPhysConvex_Hull::HullShape::getEdge(int i, btVector3 &pa, btVector3 &pb) const {
+	int pointCount = GetPointCount();
+	getVertex(i % pointCount, pa);
+	getVertex((i + 1) % pointCount, pb);
+}
+
 void CPhysConvex_Hull::Initialize() {
 	CPhysConvex::Initialize();
 	m_Volume = -1.0;
@@ -196,7 +562,24 @@ CPhysConvex_Hull::CPhysConvex_Hull(const btVector3 *points, int pointCount,
 	Initialize();
 	int indexCount = triangleCount * 3;
 	m_TriangleIndices.resizeNoInitialize(indexCount);
-	memcpy(&m_TriangleIndices[0], indices, indexCount * sizeof(indices[0]));
+	for (int indexIndex = 0; indexIndex < indexCount; ++indexIndex) {
+		m_TriangleIndices[indexIndex] = (unsigned short) indices[indexIndex];
+	}
+	m_Shape.BuildAdjacency(m_TriangleIndices);
+	m_Shape.BuildPolyhedralFeatures(m_TriangleIndices);
+}
+
+CPhysConvex_Hull::CPhysConvex_Hull(const btScalar *points, int pointCount, int pointStride,
+		const unsigned int *indices, int triangleCount) :
+		m_Shape(points, pointCount, pointStride) {
+	Initialize();
+	int indexCount = triangleCount * 3;
+	m_TriangleIndices.resizeNoInitialize(indexCount);
+	for (int indexIndex = 0; indexIndex < indexCount; ++indexIndex) {
+		m_TriangleIndices[indexIndex] = (unsigned short) indices[indexIndex];
+	}
+	m_Shape.BuildAdjacency(m_TriangleIndices);
+	m_Shape.BuildPolyhedralFeatures(m_TriangleIndices);
 }
 
 CPhysConvex_Hull::CPhysConvex_Hull(const btVector3 *points, int pointCount, const CPolyhedron &polyhedron) :
@@ -218,7 +601,7 @@ CPhysConvex_Hull::CPhysConvex_Hull(const btVector3 *points, int pointCount, cons
 	}
 	m_TriangleIndices.resizeNoInitialize(triangleIndexCount);
 
-	unsigned int *triangleIndices = &m_TriangleIndices[0];
+	unsigned short *triangleIndices = &m_TriangleIndices[0];
 	triangleIndexCount = 0;
 	for (int polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex) {
 		const Polyhedron_IndexedPolygon_t &polygon = polygons[polygonIndex];
@@ -238,6 +621,8 @@ CPhysConvex_Hull::CPhysConvex_Hull(const btVector3 *points, int pointCount, cons
 					lines[lineReference->iLineIndex].iPointIndices[lineReference->iEndPointIndex];
 		}
 	}
+	m_Shape.BuildAdjacency(m_TriangleIndices);
+	m_Shape.BuildPolyhedralFeatures(m_TriangleIndices);
 }
 
 CPhysConvex_Hull::CPhysConvex_Hull(
@@ -247,7 +632,7 @@ CPhysConvex_Hull::CPhysConvex_Hull(
 	Initialize();
 	m_Shape.setUserIndex(userIndex);
 	m_TriangleIndices.resizeNoInitialize(triangleCount * 3);
-	unsigned int *indices = &m_TriangleIndices[0];
+	unsigned short *indices = &m_TriangleIndices[0];
 	for (int triangleIndex = 0; triangleIndex < triangleCount; ++triangleIndex) {
 		const VCollide_IVP_Compact_Triangle &triangle = swappedAndRemappedTriangles[triangleIndex];
 		int indexIndex = triangleIndex * 3;
@@ -262,9 +647,8 @@ CPhysConvex_Hull::CPhysConvex_Hull(
 			m_TriangleMaterials[triangleIndex] = triangle.material_index;
 		}
 	}
-	if (m_TriangleMaterials.size() != 0) {
-		CalculateTrianglePlanes();
-	}
+	m_Shape.BuildAdjacency(m_TriangleIndices);
+	m_Shape.BuildPolyhedralFeatures(m_TriangleIndices);
 }
 
 CPhysConvex_Hull *CPhysConvex_Hull::CreateFromBulletPoints(
@@ -279,12 +663,16 @@ CPhysConvex_Hull *CPhysConvex_Hull::CreateFromBulletPoints(
 		AssertMsg(false, "Convex hull creation failed");
 		return nullptr;
 	}
+	if (hull.mNumOutputVertices > VPHYSICS_HULL_MAX_POINTS) {
+		AssertMsg(false, "Convex hull has too many points");
+		return nullptr;
+	}
 	return VPhysicsNew(CPhysConvex_Hull, &hull.m_OutputVertices[0], hull.mNumOutputVertices,
 			&hull.m_Indices[0], hull.mNumFaces);
 }
 
 CPhysConvex_Hull *CPhysicsCollision::CreateConvexHullFromIVPCompactLedge(
-		const VCollide_IVP_Compact_Ledge *ledge, CByteswap &byteswap) {
+		const VCollide_IVP_Compact_Ledge *ledge, CByteswap &byteswap, CPhysCollideUnserializeContext &context) {
 	// IVP surfaces have a common array of points for all ledges, need to include only points referenced by triangles.
 
 	// Byte swapping triangles.
@@ -296,51 +684,53 @@ CPhysConvex_Hull *CPhysicsCollision::CreateConvexHullFromIVPCompactLedge(
 	}
 	const VCollide_IVP_Compact_Triangle *triangles =
 			reinterpret_cast<const VCollide_IVP_Compact_Triangle *>(ledge + 1);
-	m_SwappedAndRemappedIVPTriangles.EnsureCount(triangleCount);
-	byteswap.SwapBufferToTargetEndian(&m_SwappedAndRemappedIVPTriangles[0],
+	CUtlVector<VCollide_IVP_Compact_Triangle> &swappedAndRemappedTriangles = context.m_SwappedAndRemappedIVPTriangles;
+	swappedAndRemappedTriangles.EnsureCount(triangleCount);
+	byteswap.SwapBufferToTargetEndian(&swappedAndRemappedTriangles[0],
 			const_cast<VCollide_IVP_Compact_Triangle *>(triangles), triangleCount);
 
 	// Finding the first and the last points (for map size).
 	int pointFirst = INT_MAX, pointLast = 0;
 	for (int triangleIndex = 0; triangleIndex < triangleCount; ++triangleIndex) {
-		const VCollide_IVP_Compact_Triangle &triangle = m_SwappedAndRemappedIVPTriangles[triangleIndex];
+		const VCollide_IVP_Compact_Triangle &triangle = swappedAndRemappedTriangles[triangleIndex];
 		for (int vertexIndex = 0; vertexIndex < 3; ++vertexIndex) {
 			int pointIndex = (int) triangle.c_three_edges[vertexIndex].start_point_index;
 			pointFirst = MIN(pointIndex, pointFirst);
 			pointLast = MAX(pointIndex, pointLast);
 		}
 	}
-	m_IVPPointMap.EnsureCount(pointLast - pointFirst + 1);
-	memset(&m_IVPPointMap[0], 0xff, m_IVPPointMap.Count() * sizeof(m_IVPPointMap[0]));
+	CUtlVector<int> &pointMap = context.m_IVPPointMap;
+	pointMap.EnsureCount(pointLast - pointFirst + 1);
+	memset(&pointMap[0], 0xff, pointMap.Count() * sizeof(pointMap[0]));
 
 	// Remapping the points that are actually used.
 	const VCollide_IVP_U_Float_Point *ivpPoints = reinterpret_cast<const VCollide_IVP_U_Float_Point *>(
 			reinterpret_cast<const byte *>(ledge) + swappedLedge.c_point_offset);
-	btAlignedObjectArray<btVector3> &points = GetHullCreationPointArray();
+	btAlignedObjectArray<btVector3> &points = context.m_Points;
 	points.resizeNoInitialize(0);
 	points.reserve(swappedLedge.get_n_points());
 	for (int triangleIndex = 0; triangleIndex < triangleCount; ++triangleIndex) {
-		VCollide_IVP_Compact_Triangle &triangle = m_SwappedAndRemappedIVPTriangles[triangleIndex];
+		VCollide_IVP_Compact_Triangle &triangle = swappedAndRemappedTriangles[triangleIndex];
 		for (int vertexIndex = 0; vertexIndex < 3; ++vertexIndex) {
 			VCollide_IVP_Compact_Edge &edge = triangle.c_three_edges[vertexIndex];
 			int pointIndexInMap = edge.start_point_index - pointFirst;
-			int pointRemappedIndex = m_IVPPointMap[pointIndexInMap];
+			int pointRemappedIndex = pointMap[pointIndexInMap];
 			if (pointRemappedIndex < 0) {
 				VCollide_IVP_U_Float_Point swappedPoint;
 				byteswap.SwapBufferToTargetEndian(&swappedPoint, const_cast<VCollide_IVP_U_Float_Point *>(&ivpPoints[edge.start_point_index]));
 				pointRemappedIndex = points.size();
 				points.push_back(btVector3(swappedPoint.k[0], -swappedPoint.k[1], -swappedPoint.k[2]));
-				m_IVPPointMap[pointIndexInMap] = pointRemappedIndex;
+				pointMap[pointIndexInMap] = pointRemappedIndex;
 			}
 			edge.start_point_index = pointRemappedIndex;
 		}
 	}
 
-	m_IVPPointMap.RemoveAll();
+	pointMap.RemoveAll();
 
-	CPhysConvex_Hull *hull = VPhysicsNew(CPhysConvex_Hull, &m_SwappedAndRemappedIVPTriangles[0], triangleCount,
+	CPhysConvex_Hull *hull = VPhysicsNew(CPhysConvex_Hull, &swappedAndRemappedTriangles[0], triangleCount,
 			&points[0], points.size(), swappedLedge.client_data);
-	m_SwappedAndRemappedIVPTriangles.RemoveAll();
+	swappedAndRemappedTriangles.RemoveAll();
 	return hull;
 }
 
@@ -349,16 +739,15 @@ void CPhysConvex_Hull::CalculateVolumeProperties() {
 		return;
 	}
 	// Based on btConvexTriangleMeshShape::calculatePrincipalAxisTransform, but without rotation.
-	const btVector3 *points = &m_Shape.getPoints()[0];
-	const unsigned int *indices = &m_TriangleIndices[0];
-	const btVector3 &ref = points[indices[0]];
+	const unsigned short *indices = &m_TriangleIndices[0];
+	btVector3 ref = m_Shape.GetPoint(indices[0]);
 	int indexCount = m_TriangleIndices.size();
 	btScalar sixVolume = 0.0f;
 	btVector3 massCenterSum(0.0f, 0.0f, 0.0f);
 	for (int indexIndex = 3; indexIndex < indexCount; indexIndex += 3) {
-		const btVector3 &p0 = points[indices[indexIndex]];
-		const btVector3 &p1 = points[indices[indexIndex + 1]];
-		const btVector3 &p2 = points[indices[indexIndex + 2]];
+		btVector3 p0 = m_Shape.GetPoint(indices[indexIndex]);
+		btVector3 p1 = m_Shape.GetPoint(indices[indexIndex + 1]);
+		btVector3 p2 = m_Shape.GetPoint(indices[indexIndex + 2]);
 		btScalar tetrahedronSixVolume = btFabs((p0 - ref).triple(p1 - ref, p2 - ref));
 		sixVolume += tetrahedronSixVolume;
 		massCenterSum += tetrahedronSixVolume * (p0 + p1 + p2 + ref);
@@ -368,9 +757,9 @@ void CPhysConvex_Hull::CalculateVolumeProperties() {
 		m_MassCenter = massCenterSum / (4.0f * sixVolume);
 		m_Inertia.setZero();
 		for (int indexIndex = 0; indexIndex < indexCount; indexIndex += 3) {
-			btVector3 a = points[indices[indexIndex]] - m_MassCenter;
-			btVector3 b = points[indices[indexIndex + 1]] - m_MassCenter;
-			btVector3 c = points[indices[indexIndex + 2]] - m_MassCenter;
+			btVector3 a = m_Shape.GetPoint(indices[indexIndex]) - m_MassCenter;
+			btVector3 b = m_Shape.GetPoint(indices[indexIndex + 1]) - m_MassCenter;
+			btVector3 c = m_Shape.GetPoint(indices[indexIndex + 2]) - m_MassCenter;
 			btVector3 i = btFabs(a.triple(b, c)) * (0.1f / 6.0f) *
 					(a * a + b * b + c * c + a * b + a * c + b * c);
 			m_Inertia[0] += i[1] + i[2];
@@ -394,14 +783,13 @@ btScalar CPhysConvex_Hull::GetVolume() const {
 }
 
 btScalar CPhysConvex_Hull::GetSurfaceArea() const {
-	const btVector3 *points = m_Shape.getPoints();
-	const unsigned int *indices = &m_TriangleIndices[0];
+	const unsigned short *indices = &m_TriangleIndices[0];
 	int indexCount = m_TriangleIndices.size();
 	btScalar area = 0.0f;
 	for (int indexIndex = 0; indexIndex < indexCount; indexIndex += 3) {
-		const btVector3 &p0 = points[indices[indexIndex]];
-		const btVector3 &p1 = points[indices[indexIndex + 1]];
-		const btVector3 &p2 = points[indices[indexIndex + 2]];
+		btVector3 p0 = m_Shape.GetPoint(indices[indexIndex]);
+		btVector3 p1 = m_Shape.GetPoint(indices[indexIndex + 1]);
+		btVector3 p2 = m_Shape.GetPoint(indices[indexIndex + 2]);
 		area += (p1 - p0).cross(p2 - p0).length();
 	}
 	return 0.5f * area;
@@ -419,7 +807,7 @@ btVector3 CPhysConvex_Hull::GetInertia() const {
 
 bool CPhysConvex_Hull::GetConvexTriangleMeshSubmergedVolume(
 		const btVector3 &origin, const btVector3 *points, int pointCount,
-		const unsigned int *indices, int indexCount,
+		const unsigned short *indices, int indexCount,
 		const btVector4 &plane, btScalar &volume, btVector3 &volumeWeightedBuoyancyCenter) {
 	const btScalar onThreshold = HL2BULLET(VP_EPSILON);
 
@@ -555,7 +943,9 @@ bool CPhysConvex_Hull::GetConvexTriangleMeshSubmergedVolume(
 btScalar CPhysConvex_Hull::GetSubmergedVolume(const btVector4 &plane, btVector3 &volumeWeightedBuoyancyCenter) const {
 	btScalar volume;
 	const btVector3 &origin = GetOriginInCompound();
-	if (!GetConvexTriangleMeshSubmergedVolume(origin, m_Shape.getPoints(), m_Shape.getNumPoints(),
+	btAlignedObjectArray<btVector3> points;
+	m_Shape.GetPoints(points);
+	if (!GetConvexTriangleMeshSubmergedVolume(origin, &points[0], points.size(),
 			&m_TriangleIndices[0], m_TriangleIndices.size(), plane, volume, volumeWeightedBuoyancyCenter)) {
 		volume = GetVolume();
 		volumeWeightedBuoyancyCenter = (origin + GetMassCenter()) * volume;
@@ -568,12 +958,11 @@ int CPhysConvex_Hull::GetTriangleCount() const {
 }
 
 void CPhysConvex_Hull::GetTriangleVertices(int triangleIndex, btVector3 vertices[3]) const {
-	const btVector3 *points = m_Shape.getPoints();
-	const unsigned int *indices = &m_TriangleIndices[0];
+	const unsigned short *indices = &m_TriangleIndices[0];
 	int indexIndex = triangleIndex * 3;
-	vertices[0] = points[indices[indexIndex]];
-	vertices[1] = points[indices[indexIndex + 1]];
-	vertices[2] = points[indices[indexIndex + 2]];
+	vertices[0] = m_Shape.GetPoint(indices[indexIndex]);
+	vertices[1] = m_Shape.GetPoint(indices[indexIndex + 1]);
+	vertices[2] = m_Shape.GetPoint(indices[indexIndex + 2]);
 }
 
 int CPhysConvex_Hull::GetTriangleMaterialIndex(int triangleIndex) const {
@@ -602,11 +991,10 @@ int CPhysConvex_Hull::GetTriangleMaterialIndexAtPoint(const btVector3 &point) co
 	// Project the point onto each plane that isn't opposite to the contact direction,
 	// then choose the plane where the projected point is the closest to the center.
 	// The best projection should be on the shape, while other ones should be outside.
-	const btVector4 *planes = &m_TrianglePlanes[0];
 	int closestTriangle = 0; // Fall back to a random triangle within the brush in case of failure.
 	btScalar closestProjectionDistance2 = BT_LARGE_FLOAT;
 	for (int triangleIndex = 0; triangleIndex < triangleCount; ++triangleIndex) {
-		const btVector4 &plane = planes[triangleIndex];
+		btVector4 plane = CalculateTrianglePlane(triangleIndex, center);
 		btScalar planeDot = plane.dot(pointCenterRelative);
 		// Without this check, the opposite side of the convex would be treated as forward.
 		if (planeDot < 0.0000001f) {
@@ -630,38 +1018,94 @@ void CPhysConvex_Hull::SetTriangleMaterialIndex(int triangleIndex, int index7bit
 		m_TriangleMaterials.resizeNoInitialize(m_TriangleIndices.size() / 3);
 		memset(&m_TriangleMaterials[0], 0, m_TriangleMaterials.size() * sizeof(m_TriangleMaterials[0]));
 	}
-	CalculateTrianglePlanes();
 	m_TriangleMaterials[triangleIndex] = index7bits;
 }
 
-void CPhysConvex_Hull::CalculateTrianglePlanes() {
-	if (m_TrianglePlanes.size() != 0) {
+btVector4 CPhysConvex_Hull::CalculateTrianglePlane(int triangleIndex, const btVector3 &center) const {
+	btVector3 vertices[3];
+	GetTriangleVertices(triangleIndex, vertices);
+	btVector3 normal = (vertices[1] - vertices[0]).cross(vertices[2] - vertices[0]);
+	normal.normalize();
+	// TODO: Check the case when the AABB center is on a triangle.
+	// Maybe ensure the windings from all sources are correct:
+	// IVP surfaces, HullLibrary, polyhedra and convex polygons.
+	btScalar dist = (vertices[0] - center).dot(normal);
+	/* if (dist < 0.0f) {
+		normal = -normal;
+		dist = -dist;
+	} */
+	return btVector4(normal.getX(), normal.getY(), normal.getZ(), -dist);
+}
+
+int CPhysConvex_Hull::GetSerializedSize() const {
+	int triangleCount = GetTriangleCount();
+	int size = sizeof(VCollide_Bullet_Convex) + m_Shape.GetPointCount() * (4 * sizeof(float)) +
+			triangleCount * (3 * sizeof(unsigned int));
+	if (m_TriangleMaterials.size() != 0) {
+		size += triangleCount * (4 * sizeof(float) + sizeof(int));
+	}
+	return size;
+}
+
+void CPhysConvex_Hull::Serialize(VCollide_Bullet_Convex *output) const {
+	const_cast<CPhysConvex_Hull *>(this)->CalculateVolumeProperties();
+	int pointCount = m_Shape.GetPointCount();
+	int triangleCount = GetTriangleCount();
+	bool hasTriangleMaterials = (m_TriangleMaterials.size() != 0);
+
+	output->type = VCOLLIDE_BULLET_CONVEX_HULL;
+	output->byteSize = GetSerializedSize();
+	output->gameData = m_Shape.getUserIndex();
+	SaveSerializedVector(btVector3(0.0f, 0.0f, 0.0f), output->origin);
+	SaveSerializedVector(btVector3(0.0f, 0.0f, 0.0f), output->halfExtents);
+	output->volume = (float) m_Volume;
+	SaveSerializedVector(m_MassCenter, output->massCenter);
+	SaveSerializedVector(m_Inertia, output->inertia);
+	output->pointCount = pointCount;
+	output->triangleCount = triangleCount;
+	output->hasTriangleMaterials = (int) hasTriangleMaterials;
+
+	float *points = reinterpret_cast<float *>(output + 1);
+	for (int pointIndex = 0; pointIndex < pointCount; ++pointIndex) {
+		float *point = &points[pointIndex * 4];
+		SaveSerializedVector(m_Shape.GetPoint(pointIndex), point);
+		point[3] = 0.0f;
+	}
+	unsigned int *indices = reinterpret_cast<unsigned int *>(points + pointCount * 4);
+	int indexCount = triangleCount * 3;
+	for (int indexIndex = 0; indexIndex < indexCount; ++indexIndex) {
+		indices[indexIndex] = m_TriangleIndices[indexIndex];
+	}
+	if (!hasTriangleMaterials) {
 		return;
 	}
+	// Still stored for compatibility with the existing files.
 	btVector3 aabbMin, aabbMax;
 	m_Shape.getAabb(btTransform::getIdentity(), aabbMin, aabbMax);
 	btVector3 center = (aabbMin + aabbMax) * 0.5f;
-	int triangleCount = m_TriangleIndices.size() / 3;
-	m_TrianglePlanes.resizeNoInitialize(triangleCount);
-	btVector4 *planes = &m_TrianglePlanes[0];
-	const btVector3 *points = &m_Shape.getPoints()[0];
-	const unsigned int *indices = &m_TriangleIndices[0];
+	float *planes = reinterpret_cast<float *>(indices + indexCount);
+	int *materials = reinterpret_cast<int *>(planes + triangleCount * 4);
 	for (int triangleIndex = 0; triangleIndex < triangleCount; ++triangleIndex) {
-		int indexIndex = triangleIndex * 3;
-		const btVector3 &v1 = points[indices[indexIndex]];
-		const btVector3 &v2 = points[indices[indexIndex + 1]];
-		const btVector3 &v3 = points[indices[indexIndex + 2]];
-		btVector3 normal = (v2 - v1).cross(v3 - v1);
-		normal.normalize();
-		// TODO: Check the case when the AABB center is on a triangle.
-		// Maybe ensure the windings from all sources are correct:
-		// IVP surfaces, HullLibrary, polyhedra and convex polygons.
-		btScalar dist = (v1 - center).dot(normal);
-		/* if (dist < 0.0f) {
-			normal = -normal;
-			dist = -dist;
-		} */
-		planes[triangleIndex].setValue(normal.getX(), normal.getY(), normal.getZ(), -dist);
+		btVector4 trianglePlane = CalculateTrianglePlane(triangleIndex, center);
+		float *plane = &planes[triangleIndex * 4];
+		SaveSerializedVector(trianglePlane, plane);
+		plane[3] = (float) trianglePlane.getW();
+		materials[triangleIndex] = m_TriangleMaterials[triangleIndex];
+	}
+}
+
+void CPhysConvex_Hull::LoadVolumeProperties(
+		btScalar volume, const btVector3 &massCenter, const btVector3 &inertia) {
+	m_Volume = volume;
+	m_MassCenter = massCenter;
+	m_Inertia = inertia;
+}
+
+void CPhysConvex_Hull::LoadTriangleMaterials(const int *materials) {
+	int triangleCount = GetTriangleCount();
+	m_TriangleMaterials.resizeNoInitialize(triangleCount);
+	for (int triangleIndex = 0; triangleIndex < triangleCount; ++triangleIndex) {
+		m_TriangleMaterials[triangleIndex] = (unsigned char) materials[triangleIndex];
 	}
 }
 
@@ -774,11 +1218,25 @@ void CPhysConvex_Box::GetTriangleVertices(int triangleIndex, btVector3 vertices[
 	}
 }
 
+void CPhysConvex_Box::Serialize(VCollide_Bullet_Convex *output) const {
+	output->type = VCOLLIDE_BULLET_CONVEX_BOX;
+	output->byteSize = GetSerializedSize();
+	output->gameData = m_Shape.getUserIndex();
+	SaveSerializedVector(m_Origin, output->origin);
+	SaveSerializedVector(m_Shape.getHalfExtentsWithoutMargin(), output->halfExtents);
+	output->volume = (float) GetVolume();
+	SaveSerializedVector(GetMassCenter(), output->massCenter);
+	SaveSerializedVector(GetInertia(), output->inertia);
+	output->pointCount = 0;
+	output->triangleCount = 0;
+	output->hasTriangleMaterials = 0;
+}
+
 void CPhysConvex_Box::Release() {
 	VPhysicsDelete(CPhysConvex_Box, this);
 }
 
-const unsigned int CPhysConvex_Box::s_BoxTriangleIndices[36] = {
+const unsigned short CPhysConvex_Box::s_BoxTriangleIndices[36] = {
 	0, 1, 3,
 	0, 3, 2,
 	4, 5, 1,
@@ -1058,13 +1516,39 @@ void CPhysicsCollision::DestroyCollide(CPhysCollide *pCollide) {
  * Traces
  *********/
 
-void CPhysicsCollision::ClearTrace(trace_t *trace) {
+CPhysicsTraceContext::CPhysicsTraceContext() :
+		m_TraceBoxShape(btVector3(1.0f, 1.0f, 1.0f)),
+		m_TracePointShape(VPHYSICS_CONVEX_DISTANCE_MARGIN),
+		m_TraceConeShape(1.0f, 1.0f),
+		m_InContactTest(false) {
+	m_TraceBoxShape.setMargin(VPHYSICS_CONVEX_DISTANCE_MARGIN);
+	m_TraceConeShape.setMargin(VPHYSICS_CONVEX_DISTANCE_MARGIN);
+
+	// Only one pair is tested at once, so there's no need for big pools in every context.
+	btDefaultCollisionConstructionInfo collisionConstructionInfo;
+	collisionConstructionInfo.m_defaultMaxPersistentManifoldPoolSize = 16;
+	collisionConstructionInfo.m_defaultMaxCollisionAlgorithmPoolSize = 16;
+	m_ContactTestCollisionConfiguration = VPhysicsNew(btDefaultCollisionConfiguration, collisionConstructionInfo);
+	m_ContactTestDispatcher = VPhysicsNew(btCollisionDispatcher, m_ContactTestCollisionConfiguration);
+	m_ContactTestBroadphase = VPhysicsNew(btSimpleBroadphase, 2); // 0 is dangerous as it's array size.
+	m_ContactTestCollisionWorld = VPhysicsNew(btCollisionWorld,
+			m_ContactTestDispatcher, m_ContactTestBroadphase, m_ContactTestCollisionConfiguration);
+}
+
+CPhysicsTraceContext::~CPhysicsTraceContext() {
+	VPhysicsDelete(btCollisionWorld, m_ContactTestCollisionWorld);
+	VPhysicsDelete(btSimpleBroadphase, m_ContactTestBroadphase);
+	VPhysicsDelete(btCollisionDispatcher, m_ContactTestDispatcher);
+	VPhysicsDelete(btDefaultCollisionConfiguration, m_ContactTestCollisionConfiguration);
+}
+
+void CPhysicsTraceContext::ClearTrace(trace_t *trace) {
 	memset(trace, 0, sizeof(*trace));
 	trace->fraction = 1.0f;
 	trace->surface.name = "**empty**";
 }
 
-void CPhysicsCollision::TraceBox(const Ray_t &ray, unsigned int contentsMask,
+void CPhysicsTraceContext::TraceBox(const Ray_t &ray, unsigned int contentsMask,
 		IConvexInfo *pConvexInfo, const CPhysCollide *pCollide,
 		const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr) {
 	ClearTrace(ptr);
@@ -1164,6 +1648,12 @@ void CPhysicsCollision::TraceBox(const Ray_t &ray, unsigned int contentsMask,
 	ptr->plane.dist = DotProduct(hitPointHL + ray.m_Start, ptr->plane.normal);
 }
 
+void CPhysicsCollision::TraceBox(const Ray_t &ray, unsigned int contentsMask,
+		IConvexInfo *pConvexInfo, const CPhysCollide *pCollide,
+		const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr) {
+	m_TraceContext.TraceBox(ray, contentsMask, pConvexInfo, pCollide, collideOrigin, collideAngles, ptr);
+}
+
 void CPhysicsCollision::TraceBox(const Vector &start, const Vector &end,
 		const Vector &mins, const Vector &maxs, const CPhysCollide *pCollide,
 		const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr) {
@@ -1180,6 +1670,12 @@ void CPhysicsCollision::TraceBox(const Ray_t &ray, const CPhysCollide *pCollide,
 void CPhysicsCollision::TraceCollide(const Vector &start, const Vector &end,
 		const CPhysCollide *pSweepCollide, const QAngle &sweepAngles, const CPhysCollide *pCollide,
 		const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr) {
+	m_TraceContext.TraceCollide(start, end, pSweepCollide, sweepAngles, pCollide, collideOrigin, collideAngles, ptr);
+}
+
+void CPhysicsTraceContext::TraceCollide(const Vector &start, const Vector &end,
+		const CPhysCollide *pSweepCollide, const QAngle &sweepAngles, const CPhysCollide *pCollide,
+		const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr) {
 	ClearTrace(ptr);
 	const btCollisionShape *testShape = pSweepCollide->GetShape();
 	Assert(testShape->isCompound() || testShape->isConvex());
@@ -1287,6 +1783,11 @@ void CPhysicsCollision::TraceCollide(const Vector &start, const Vector &end,
 
 bool CPhysicsCollision::IsBoxIntersectingCone(
 		const Vector &boxAbsMins, const Vector &boxAbsMaxs, const truncatedcone_t &cone) {
+	return m_TraceContext.IsBoxIntersectingCone(boxAbsMins, boxAbsMaxs, cone);
+}
+
+bool CPhysicsTraceContext::IsBoxIntersectingCone(
+		const Vector &boxAbsMins, const Vector &boxAbsMaxs, const truncatedcone_t &cone) {
 	btVector3 boxHalfExtents;
 	ConvertPositionToBullet((boxAbsMaxs - boxAbsMins) * 0.5f, boxHalfExtents);
 	m_TraceBoxShape.setImplicitShapeDimensions(boxHalfExtents.absolute());
@@ -1331,7 +1832,7 @@ bool CPhysicsCollision::IsBoxIntersectingCone(
  ******************/
 
 CPhysCollide_Compound::CPhysCollide_Compound(CPhysConvex **pConvex, int convexCount) :
-		m_Shape(false, convexCount) {
+		m_Shape(convexCount) {
 	Assert(convexCount > 0);
 
 	Initialize();
@@ -1381,32 +1882,205 @@ CPhysCollide_Compound::CPhysCollide_Compound(CPhysConvex **pConvex, int convexCo
 CPhysCollide_Compound::CPhysCollide_Compound(
 		const VCollide_IVP_Compact_Ledgetree_Node *root, CByteswap &byteswap,
 		const btVector3 &massCenter, const btVector3 &inertia,
-		const btVector3 &orthographicAreas) :
+		const btVector3 &orthographicAreas, CPhysCollideUnserializeContext &context) :
 		CPhysCollide(orthographicAreas),
-		m_Shape(false),
 		m_Volume(-1.0f), m_MassCenter(massCenter), m_Inertia(inertia) {
 	Initialize();
-	g_pPhysCollision->PushIVPNode(root);
+
+	// The ledgetree is a bounding volume hierarchy of the ledges already, so its structure is reused for the AABB tree
+	// instead of inserting every child into a new one. The nodes are written in the native depth-first order,
+	// with the child popped first immediately following its parent, and the boxes are fitted to the children later.
+	CUtlVector<VCollide_Bullet_CompoundNode> &treeNodes = context.m_CompoundTreeNodes;
+	treeNodes.RemoveAll();
+	bool treeValid = true;
+	context.PushIVPNode(root, -1);
 	const VCollide_IVP_Compact_Ledgetree_Node *node;
-	while ((node = g_pPhysCollision->PopIVPNode()) != nullptr) {
+	int parentTreeNodeIndex;
+	while ((node = context.PopIVPNode(parentTreeNodeIndex)) != nullptr) {
+		int treeNodeIndex = treeNodes.AddToTail();
+		if (parentTreeNodeIndex >= 0) {
+			treeNodes[parentTreeNodeIndex].rightNodeOrConvex = treeNodeIndex;
+		}
 		VCollide_IVP_Compact_Ledgetree_Node swappedNode;
 		byteswap.SwapBufferToTargetEndian(&swappedNode, const_cast<VCollide_IVP_Compact_Ledgetree_Node *>(node));
 		if (swappedNode.offset_right_node == 0) {
 			CPhysConvex_Hull *convex = g_pPhysCollision->CreateConvexHullFromIVPCompactLedge(
 					reinterpret_cast<const VCollide_IVP_Compact_Ledge *>(
-							reinterpret_cast<const byte *>(node) + swappedNode.offset_compact_ledge), byteswap);
+							reinterpret_cast<const byte *>(node) + swappedNode.offset_compact_ledge), byteswap, context);
+			if (convex == nullptr) {
+				// The tree would have a leaf without a child.
+				treeValid = false;
+				continue;
+			}
+			treeNodes[treeNodeIndex].rightNodeOrConvex = ~m_Shape.getNumChildShapes();
 			convex->SetOwner(CPhysConvex::OWNER_COMPOUND);
 			m_Shape.addChildShape(btTransform(btMatrix3x3::getIdentity(),
 					convex->GetOriginInCompound() - m_MassCenter), convex->GetShape());
 		} else {
-			g_pPhysCollision->PushIVPNode(node + 1);
-			g_pPhysCollision->PushIVPNode(reinterpret_cast<const VCollide_IVP_Compact_Ledgetree_Node *>(
-					reinterpret_cast<const byte *>(node) + swappedNode.offset_right_node));
+			treeNodes[treeNodeIndex].rightNodeOrConvex = 0;
+			context.PushIVPNode(node + 1, treeNodeIndex);
+			context.PushIVPNode(reinterpret_cast<const VCollide_IVP_Compact_Ledgetree_Node *>(
+					reinterpret_cast<const byte *>(node) + swappedNode.offset_right_node), -1);
+		}
+	}
+
+	if (m_Shape.getNumChildShapes() <= 1) {
+		return;
+	}
+	int treeNodeCount = treeNodes.Count();
+	if (treeValid) {
+		// Children always follow their parent, so going backwards, the boxes of the children are already known.
+		const btCompoundShapeChild *children = m_Shape.getChildList();
+		for (int treeNodeIndex = treeNodeCount - 1; treeNodeIndex >= 0; --treeNodeIndex) {
+			VCollide_Bullet_CompoundNode &treeNode = treeNodes[treeNodeIndex];
+			btVector3 aabbMin, aabbMax;
+			if (treeNode.rightNodeOrConvex >= 0) {
+				const VCollide_Bullet_CompoundNode &left = treeNodes[treeNodeIndex + 1];
+				const VCollide_Bullet_CompoundNode &right = treeNodes[treeNode.rightNodeOrConvex];
+				aabbMin = LoadSerializedVector(left.aabbMin);
+				aabbMin.setMin(LoadSerializedVector(right.aabbMin));
+				aabbMax = LoadSerializedVector(left.aabbMax);
+				aabbMax.setMax(LoadSerializedVector(right.aabbMax));
+			} else {
+				const btCompoundShapeChild &child = children[~treeNode.rightNodeOrConvex];
+				child.m_childShape->getAabb(child.m_transform, aabbMin, aabbMax);
+			}
+			SaveSerializedVector(aabbMin, treeNode.aabbMin);
+			SaveSerializedVector(aabbMax, treeNode.aabbMax);
 		}
 	}
-	if (m_Shape.getNumChildShapes() > 1) {
+	if (!treeValid || !m_Shape.LoadAabbTree(&treeNodes[0], treeNodeCount)) {
 		m_Shape.createAabbTreeFromChildren();
 	}
+	treeNodes.RemoveAll();
+}
+
+CPhysCollide_Compound::CPhysCollide_Compound(CPhysConvex **pConvex, int convexCount,
+		btScalar volume, const btVector3 &massCenter, const btVector3 &inertia,
+		const btVector3 &orthographicAreas,
+		const VCollide_Bullet_CompoundNode *treeNodes, int treeNodeCount) :
+		CPhysCollide(orthographicAreas),
+		m_Shape(convexCount),
+		m_Volume(volume), m_MassCenter(massCenter), m_Inertia(inertia) {
+	Assert(convexCount > 0);
+	Initialize();
+	btTransform transform(btMatrix3x3::getIdentity());
+	for (int convexIndex = 0; convexIndex < convexCount; ++convexIndex) {
+		CPhysConvex *convex = pConvex[convexIndex];
+		convex->SetOwner(CPhysConvex::OWNER_COMPOUND);
+		transform.setOrigin(convex->GetOriginInCompound() - m_MassCenter);
+		m_Shape.addChildShape(transform, convex->GetShape());
+	}
+	if (convexCount > 1 && !m_Shape.LoadAabbTree(treeNodes, treeNodeCount)) {
+		DevMsg("Invalid serialized compound AABB tree, rebuilding\n");
+		m_Shape.createAabbTreeFromChildren();
+	}
+}
+
+bool CPhysCollide_Compound::CompoundShape::LoadAabbTree(
+		const VCollide_Bullet_CompoundNode *nodes, int nodeCount) {
+	// Linking the nodes directly instead of inserting the leaves, which would require rebalancing.
+	Assert(m_dynamicAabbTree == nullptr);
+	int childCount = m_children.size();
+	if (nodes == nullptr || nodeCount != 2 * childCount - 1 || m_dynamicAabbTree != nullptr) {
+		return false;
+	}
+
+	btAlignedObjectArray<btDbvtNode *> treeNodes;
+	treeNodes.resizeNoInitialize(nodeCount);
+	for (int nodeIndex = 0; nodeIndex < nodeCount; ++nodeIndex) {
+		const VCollide_Bullet_CompoundNode &node = nodes[nodeIndex];
+		btDbvtNode *treeNode = new(btAlignedAlloc(sizeof(btDbvtNode), 16)) btDbvtNode();
+		treeNode->volume = btDbvtVolume::FromMM(
+				LoadSerializedVector(node.aabbMin), LoadSerializedVector(node.aabbMax));
+		treeNode->parent = nullptr;
+		treeNode->childs[0] = treeNode->childs[1] = nullptr;
+		treeNodes[nodeIndex] = treeNode;
+	}
+
+	bool valid = true;
+	int leafCount = 0;
+	for (int nodeIndex = 0; nodeIndex < nodeCount; ++nodeIndex) {
+		btDbvtNode *treeNode = treeNodes[nodeIndex];
+		int rightNodeOrConvex = nodes[nodeIndex].rightNodeOrConvex;
+		if (rightNodeOrConvex >= 0) {
+			// Children always follow their parent, so the tree can't have cycles.
+			if (rightNodeOrConvex <= nodeIndex + 1 || rightNodeOrConvex >= nodeCount) {
+				valid = false;
+				break;
+			}
+			btDbvtNode *left = treeNodes[nodeIndex + 1], *right = treeNodes[rightNodeOrConvex];
+			if (left->parent != nullptr || right->parent != nullptr) {
+				valid = false;
+				break;
+			}
+			treeNode->childs[0] = left;
+			treeNode->childs[1] = right;
+			left->parent = right->parent = treeNode;
+		} else {
+			int childIndex = ~rightNodeOrConvex;
+			if (childIndex >= childCount || m_children[childIndex].m_node != nullptr) {
+				valid = false;
+				break;
+			}
+			// Same as in btCompoundShape::addChildShape.
+			treeNode->data = reinterpret_cast<void *>((size_t) childIndex);
+			m_children[childIndex].m_node = treeNode;
+			++leafCount;
+		}
+	}
+	// With every child referenced exactly once, all nodes except for the root have a parent.
+	if (!valid || leafCount != childCount) {
+		for (int nodeIndex = 0; nodeIndex < nodeCount; ++nodeIndex) {
+			btAlignedFree(treeNodes[nodeIndex]);
+		}
+		for (int childIndex = 0; childIndex < childCount; ++childIndex) {
+			m_children[childIndex].m_node = nullptr;
+		}
+		return false;
+	}
+
+	btDbvt *tree = new(btAlignedAlloc(sizeof(btDbvt), 16)) btDbvt();
+	tree->m_root = treeNodes[0];
+	tree->m_leaves = childCount;
+	m_dynamicAabbTree = tree;
+	return true;
+}
+
+int CPhysCollide_Compound::CompoundShape::SaveAabbTree(VCollide_Bullet_CompoundNode *nodes) const {
+	if (m_dynamicAabbTree == nullptr || m_dynamicAabbTree->m_root == nullptr) {
+		return 0;
+	}
+	struct StackEntry {
+		const btDbvtNode *m_Node;
+		int m_ParentIndex; // For the right child, to write the index of the node to the parent.
+	};
+	btAlignedObjectArray<StackEntry> stack;
+	StackEntry rootEntry = { m_dynamicAabbTree->m_root, -1 };
+	stack.push_back(rootEntry);
+	int nodeCount = 0;
+	while (stack.size() != 0) {
+		StackEntry entry = stack[stack.size() - 1];
+		stack.pop_back();
+		int nodeIndex = nodeCount++;
+		if (entry.m_ParentIndex >= 0) {
+			nodes[entry.m_ParentIndex].rightNodeOrConvex = nodeIndex;
+		}
+		VCollide_Bullet_CompoundNode &node = nodes[nodeIndex];
+		SaveSerializedVector(entry.m_Node->volume.Mins(), node.aabbMin);
+		SaveSerializedVector(entry.m_Node->volume.Maxs(), node.aabbMax);
+		if (entry.m_Node->isinternal()) {
+			node.rightNodeOrConvex = 0;
+			// The left child is popped first, so it immediately follows the node.
+			StackEntry rightEntry = { entry.m_Node->childs[1], nodeIndex };
+			stack.push_back(rightEntry);
+			StackEntry leftEntry = { entry.m_Node->childs[0], -1 };
+			stack.push_back(leftEntry);
+		} else {
+			node.rightNodeOrConvex = ~((int) reinterpret_cast<size_t>(entry.m_Node->data));
+		}
+	}
+	return nodeCount;
 }
 
 CPhysCollide *CPhysicsCollision::ConvertConvexToCollide(CPhysConvex **pConvex, int convexCount) {
@@ -1663,6 +2337,42 @@ void CPhysicsCollision::DestroyQueryModel(ICollisionQuery *pQuery) {
 	VPhysicsDelete(CCollisionQuery, pQuery);
 }
 
+int CPhysCollide_Compound::GetSerializedSize() const {
+	int convexCount = m_Shape.getNumChildShapes();
+	int size = sizeof(VCollide_Bullet_Compound);
+	for (int convexIndex = 0; convexIndex < convexCount; ++convexIndex) {
+		int convexSize = reinterpret_cast<const CPhysConvex *>(
+				m_Shape.getChildShape(convexIndex)->getUserPointer())->GetSerializedSize();
+		if (convexSize <= 0) {
+			return 0;
+		}
+		size += convexSize;
+	}
+	if (convexCount > 1 && m_Shape.getDynamicAabbTree() != nullptr) {
+		size += (2 * convexCount - 1) * sizeof(VCollide_Bullet_CompoundNode);
+	}
+	return size;
+}
+
+void CPhysCollide_Compound::Serialize(char *output) const {
+	int convexCount = m_Shape.getNumChildShapes();
+	VCollide_Bullet_Compound *compound = reinterpret_cast<VCollide_Bullet_Compound *>(output);
+	SaveSerializedVector(m_MassCenter, compound->massCenter);
+	SaveSerializedVector(m_Inertia, compound->inertia);
+	compound->volume = (float) GetVolume();
+	compound->convexCount = convexCount;
+	output += sizeof(VCollide_Bullet_Compound);
+	for (int convexIndex = 0; convexIndex < convexCount; ++convexIndex) {
+		const CPhysConvex *convex = reinterpret_cast<const CPhysConvex *>(
+				m_Shape.getChildShape(convexIndex)->getUserPointer());
+		convex->Serialize(reinterpret_cast<VCollide_Bullet_Convex *>(output));
+		output += convex->GetSerializedSize();
+	}
+	compound->treeNodeCount = (convexCount > 1 ?
+			m_Shape.SaveAabbTree(reinterpret_cast<VCollide_Bullet_CompoundNode *>(output)) : 0);
+	Assert(compound->treeNodeCount == 0 || compound->treeNodeCount == 2 * convexCount - 1);
+}
+
 CPhysCollide_Compound::~CPhysCollide_Compound() {
 	int childCount = m_Shape.getNumChildShapes();
 	for (int childIndex = 0; childIndex < childCount; ++childIndex) {
@@ -1846,7 +2556,7 @@ bool CPhysicsCollision::SupportsVirtualMesh() {
 
 CPhysCollide *CPhysicsCollision::UnserializeIVPCompactSurface(
 		const VCollide_IVP_Compact_Surface *surface, CByteswap &byteswap,
-		const btVector3 &orthographicAreas) {
+		const btVector3 &orthographicAreas, CPhysCollideUnserializeContext &context) {
 	VCollide_IVP_Compact_Surface swappedSurface;
 	byteswap.SwapBufferToTargetEndian(&swappedSurface, const_cast<VCollide_IVP_Compact_Surface *>(surface));
 	if (swappedSurface.dummy[2] != VCOLLIDE_IVP_COMPACT_SURFACE_ID) {
@@ -1858,11 +2568,135 @@ CPhysCollide *CPhysicsCollision::UnserializeIVPCompactSurface(
 			byteswap,
 			btVector3(swappedSurface.mass_center[0], -swappedSurface.mass_center[1], -swappedSurface.mass_center[2]),
 			btVector3(swappedSurface.rotation_inertia[0], swappedSurface.rotation_inertia[1], swappedSurface.rotation_inertia[2]),
-			orthographicAreas);
+			orthographicAreas, context);
+}
+
+CPhysConvex *CPhysicsCollision::UnserializeBulletConvex(const VCollide_Bullet_Convex *serializedConvex,
+		CPhysCollideUnserializeContext &context) {
+	CPhysConvex *convex;
+	switch (serializedConvex->type) {
+	case VCOLLIDE_BULLET_CONVEX_HULL: {
+		int pointCount = serializedConvex->pointCount, triangleCount = serializedConvex->triangleCount;
+		int dataSize = serializedConvex->byteSize - (int) sizeof(VCollide_Bullet_Convex);
+		int pointSize = 4 * sizeof(float), triangleSize = 3 * sizeof(unsigned int);
+		if (serializedConvex->hasTriangleMaterials) {
+			triangleSize += 4 * sizeof(float) + sizeof(int);
+		}
+		if (pointCount < 3 || pointCount > VPHYSICS_HULL_MAX_POINTS || triangleCount <= 0 ||
+				pointCount > dataSize / pointSize ||
+				triangleCount > (dataSize - pointCount * pointSize) / triangleSize) {
+			return nullptr;
+		}
+		const float *points = reinterpret_cast<const float *>(serializedConvex + 1);
+		const unsigned int *indices = reinterpret_cast<const unsigned int *>(points + pointCount * 4);
+		int indexCount = triangleCount * 3;
+		for (int indexIndex = 0; indexIndex < indexCount; ++indexIndex) {
+			if (indices[indexIndex] >= (unsigned int) pointCount) {
+				return nullptr;
+			}
+		}
+		const int *materials = nullptr;
+		if (serializedConvex->hasTriangleMaterials) {
+			// The planes are calculated when needed instead.
+			const float *planes = reinterpret_cast<const float *>(indices + indexCount);
+			materials = reinterpret_cast<const int *>(planes + triangleCount * 4);
+			for (int triangleIndex = 0; triangleIndex < triangleCount; ++triangleIndex) {
+				if ((unsigned int) materials[triangleIndex] > 127) {
+					return nullptr;
+				}
+			}
+		}
+#ifdef BT_USE_DOUBLE_PRECISION
+		btAlignedObjectArray<btVector3> &pointArray = context.m_Points;
+		pointArray.resizeNoInitialize(pointCount);
+		for (int pointIndex = 0; pointIndex < pointCount; ++pointIndex) {
+			pointArray[pointIndex] = LoadSerializedVector(&points[pointIndex * 4]);
+		}
+		CPhysConvex_Hull *hull = VPhysicsNew(CPhysConvex_Hull,
+				&pointArray[0][0], pointCount, sizeof(btVector3), indices, triangleCount);
+#else
+		// The points are already laid out like btVector3.
+		CPhysConvex_Hull *hull = VPhysicsNew(CPhysConvex_Hull,
+				points, pointCount, 4 * sizeof(float), indices, triangleCount);
+#endif
+		hull->LoadVolumeProperties(serializedConvex->volume,
+				LoadSerializedVector(serializedConvex->massCenter), LoadSerializedVector(serializedConvex->inertia));
+		if (materials != nullptr) {
+			hull->LoadTriangleMaterials(materials);
+		}
+		convex = hull;
+		break;
+	}
+	case VCOLLIDE_BULLET_CONVEX_BOX:
+		convex = VPhysicsNew(CPhysConvex_Box, LoadSerializedVector(serializedConvex->halfExtents),
+				LoadSerializedVector(serializedConvex->origin));
+		break;
+	default:
+		return nullptr;
+	}
+	convex->GetShape()->setUserIndex(serializedConvex->gameData);
+	return convex;
+}
+
+CPhysCollide *CPhysicsCollision::UnserializeBulletCompound(const char *surface, int surfaceSize,
+		CByteswap &byteswap, const btVector3 &orthographicAreas, CPhysCollideUnserializeContext &context) {
+	if (surfaceSize < (int) sizeof(VCollide_Bullet_Compound) || (surfaceSize & (sizeof(unsigned int) - 1))) {
+		return nullptr;
+	}
+	if (byteswap.IsSwappingBytes()) {
+		// Every field is 32-bit, so the whole surface is swapped at once.
+		int wordCount = surfaceSize / sizeof(unsigned int);
+		context.m_SwappedBulletSurface.EnsureCount(wordCount);
+		byteswap.SwapBufferToTargetEndian(&context.m_SwappedBulletSurface[0],
+				reinterpret_cast<unsigned int *>(const_cast<char *>(surface)), wordCount);
+		surface = reinterpret_cast<const char *>(&context.m_SwappedBulletSurface[0]);
+	}
+	const char *surfaceEnd = surface + surfaceSize;
+
+	const VCollide_Bullet_Compound *compound = reinterpret_cast<const VCollide_Bullet_Compound *>(surface);
+	int convexCount = compound->convexCount;
+	const char *convexData = surface + sizeof(VCollide_Bullet_Compound);
+	CUtlVector<CPhysConvex *> &convexes = context.m_UnserializedBulletConvexes;
+	convexes.RemoveAll();
+	for (int convexIndex = 0; convexIndex < convexCount; ++convexIndex) {
+		const VCollide_Bullet_Convex *serializedConvex = reinterpret_cast<const VCollide_Bullet_Convex *>(convexData);
+		CPhysConvex *convex = nullptr;
+		if (surfaceEnd - convexData >= (int) sizeof(VCollide_Bullet_Convex) &&
+				serializedConvex->byteSize >= (int) sizeof(VCollide_Bullet_Convex) &&
+				serializedConvex->byteSize <= surfaceEnd - convexData) {
+			convex = UnserializeBulletConvex(serializedConvex, context);
+		}
+		if (convex == nullptr) {
+			break;
+		}
+		convexes.AddToTail(convex);
+		convexData += serializedConvex->byteSize;
+	}
+
+	CPhysCollide *collide = nullptr;
+	if (convexCount > 0 && convexes.Count() == convexCount) {
+		int treeNodeCount = compound->treeNodeCount;
+		const VCollide_Bullet_CompoundNode *treeNodes = nullptr;
+		if (treeNodeCount > 0 &&
+				treeNodeCount <= (surfaceEnd - convexData) / (int) sizeof(VCollide_Bullet_CompoundNode)) {
+			treeNodes = reinterpret_cast<const VCollide_Bullet_CompoundNode *>(convexData);
+		}
+		collide = VPhysicsNew(CPhysCollide_Compound, &convexes[0], convexCount,
+				compound->volume, LoadSerializedVector(compound->massCenter),
+				LoadSerializedVector(compound->inertia), orthographicAreas,
+				treeNodes, treeNodes != nullptr ? treeNodeCount : 0);
+	} else {
+		for (int convexIndex = 0; convexIndex < convexes.Count(); ++convexIndex) {
+			convexes[convexIndex]->Release();
+		}
+	}
+	convexes.RemoveAll();
+	context.m_SwappedBulletSurface.RemoveAll();
+	return collide;
 }
 
 CPhysCollide *CPhysicsCollision::UnserializeCollideFromBuffer(
-		const char *pBuffer, int size, int index, bool swap) {
+		const char *pBuffer, int size, int index, bool swap, CPhysCollideUnserializeContext &context) {
 	CByteswap byteswap;
 	byteswap.ActivateByteSwapping(swap);
 	VCollide_SurfaceHeader swappedHeader;
@@ -1881,14 +2715,21 @@ CPhysCollide *CPhysicsCollision::UnserializeCollideFromBuffer(
 		case VCOLLIDE_MODEL_TYPE_IVP_COMPACT_SURFACE:
 			collide = UnserializeIVPCompactSurface(
 					reinterpret_cast<const VCollide_IVP_Compact_Surface *>(collideBuffer),
-					byteswap, orthographicAreas);
+					byteswap, orthographicAreas, context);
+			break;
+		case VCOLLIDE_MODEL_TYPE_BULLET_COMPOUND:
+			if (swappedHeader.version == VCOLLIDE_VERSION_BULLET) {
+				collide = UnserializeBulletCompound(collideBuffer,
+						MIN(swappedHeader.surfaceSize, size - (int) sizeof(VCollide_SurfaceHeader)),
+						byteswap, orthographicAreas, context);
+			}
 			break;
 		}
 	} else {
 		DevMsg("Old format .PHY file loaded!!!\n");
 		collide = UnserializeIVPCompactSurface(
 				reinterpret_cast<const VCollide_IVP_Compact_Surface *>(pBuffer),
-				byteswap, btVector3(1.0f, 1.0f, 1.0f));
+				byteswap, btVector3(1.0f, 1.0f, 1.0f), context);
 	}
 	if (collide != nullptr) {
 		collide->GetShape()->setUserIndex(index);
@@ -1899,14 +2740,75 @@ CPhysCollide *CPhysicsCollision::UnserializeCollideFromBuffer(
 }
 
 CPhysCollide *CPhysicsCollision::UnserializeCollide(char *pBuffer, int size, int index) {
-	return UnserializeCollideFromBuffer(pBuffer, size, index, false);
+	CPhysCollideUnserializeContext context;
+	return UnserializeCollideFromBuffer(pBuffer, size, index, false, context);
 }
 
+int CPhysicsCollision::CollideSize(CPhysCollide *pCollide) {
+	int surfaceSize = pCollide->GetSerializedSize();
+	if (surfaceSize <= 0) {
+		return 0;
+	}
+	return sizeof(VCollide_SurfaceHeader) + surfaceSize;
+}
+
+int CPhysicsCollision::CollideWrite(char *pDest, CPhysCollide *pCollide, bool bSwap) {
+	int surfaceSize = pCollide->GetSerializedSize();
+	if (surfaceSize <= 0) {
+		return 0;
+	}
+	CByteswap byteswap;
+	byteswap.ActivateByteSwapping(bSwap);
+
+	VCollide_SurfaceHeader header;
+	header.vphysicsID = VCOLLIDE_VPHYSICS_ID;
+	header.version = VCOLLIDE_VERSION_BULLET;
+	header.modelType = VCOLLIDE_MODEL_TYPE_BULLET_COMPOUND;
+	header.surfaceSize = surfaceSize;
+	ConvertAbsoluteDirectionToHL(pCollide->GetOrthographicAreas(), header.dragAxisAreas);
+	header.axisMapSize = 0;
+	byteswap.SwapFieldsToTargetEndian(reinterpret_cast<VCollide_SurfaceHeader *>(pDest), &header);
+
+	char *surface = pDest + sizeof(VCollide_SurfaceHeader);
+	memset(surface, 0, surfaceSize);
+	pCollide->Serialize(surface);
+	if (bSwap) {
+		unsigned int *surfaceWords = reinterpret_cast<unsigned int *>(surface);
+		byteswap.SwapBufferToTargetEndian(surfaceWords, surfaceWords, surfaceSize / sizeof(unsigned int));
+	}
+	return sizeof(VCollide_SurfaceHeader) + surfaceSize;
+}
+
+// Unserializes a range of solids with its own scratch state, so different ranges can be done on different threads.
+class CVCollideLoadLoop : public btIParallelForBody {
+public:
+	CVCollideLoadLoop(vcollide_t *output, const char *buffer, const int *solidPositions, bool swap) :
+			m_Output(output), m_Buffer(buffer), m_SolidPositions(solidPositions), m_Swap(swap) {}
+	virtual void forLoop(int iBegin, int iEnd) const {
+		CPhysCollideUnserializeContext context;
+		for (int solidIndex = iBegin; solidIndex < iEnd; ++solidIndex) {
+			int position = m_SolidPositions[solidIndex];
+			m_Output->solids[solidIndex] = g_pPhysCollision->UnserializeCollideFromBuffer(m_Buffer + position,
+					m_SolidPositions[solidIndex + 1] - (int) sizeof(int) - position, solidIndex, m_Swap, context);
+		}
+	}
+private:
+	vcollide_t *m_Output;
+	const char *m_Buffer;
+	const int *m_SolidPositions;
+	bool m_Swap;
+};
+
 void CPhysicsCollision::VCollideLoad(vcollide_t *pOutput,
 			int solidCount, const char *pBuffer, int size, bool swap) {
 	memset(pOutput, 0, sizeof(*pOutput));
 	pOutput->solidCount = solidCount;
 	pOutput->solids = new CPhysCollide *[solidCount]; // Safe.
+
+	// Locating the solids first, so they can be unserialized in parallel.
+	// For uniformity, the end of the last solid is stored as the position of the one after it.
+	CUtlVector<int> solidPositions;
+	solidPositions.EnsureCount(solidCount + 1);
 	int position = 0;
 	for (int solidIndex = 0; solidIndex < solidCount; ++solidIndex) {
 		union {
@@ -1921,15 +2823,93 @@ void CPhysicsCollision::VCollideLoad(vcollide_t *pOutput,
 			memcpy(&solidSize, pBuffer + position, sizeof(int));
 		}
 		position += sizeof(int);
-		pOutput->solids[solidIndex] = UnserializeCollideFromBuffer(
-				pBuffer + position, solidSize, solidIndex, swap);
+		solidPositions[solidIndex] = position;
 		position += solidSize;
 	}
+	solidPositions[solidCount] = position + (int) sizeof(int);
+
+	// Bullet's worker threads are only used by the main thread, which also steps the environments.
+	CVCollideLoadLoop loadLoop(pOutput, pBuffer, &solidPositions[0], swap);
+	if (ThreadInMainThread()) {
+		btParallelFor(0, solidCount, 1, loadLoop);
+	} else {
+		loadLoop.forLoop(0, solidCount);
+	}
+
 	int keySize = size - position;
 	pOutput->pKeyValues = new char[keySize]; // Safe.
 	memcpy(pOutput->pKeyValues, pBuffer + position, keySize);
 }
 
+void CPhysicsCollision::VCollideLoadAsync(vcollide_t *pOutput, int solidCount, const char *pBuffer, int size, bool swap,
+		IVCollideLoadCallback *pCallback) {
+	if (m_AsyncLoader == nullptr) {
+		AsyncLoaderThread *loader = VPhysicsNew(AsyncLoaderThread);
+		loader->SetName("VPhysics VCollide Loader");
+		if (!loader->Start()) {
+			DevMsg("Failed to start the physics model loader thread, loading synchronously.\n");
+			VPhysicsDelete(AsyncLoaderThread, loader);
+			VCollideLoad(pOutput, solidCount, pBuffer, size, swap);
+			pCallback->OnVCollideLoaded(pOutput);
+			return;
+		}
+		m_AsyncLoader = loader;
+	}
+	AsyncLoad_t load;
+	load.m_Output = pOutput;
+	load.m_SolidCount = solidCount;
+	load.m_Buffer = pBuffer;
+	load.m_Size = size;
+	load.m_Swap = swap;
+	load.m_Callback = pCallback;
+	m_AsyncLoader->AddLoad(load);
+}
+
+void CPhysicsCollision::ShutdownAsyncLoader() {
+	if (m_AsyncLoader == nullptr) {
+		return;
+	}
+	m_AsyncLoader->Stop();
+	VPhysicsDelete(AsyncLoaderThread, m_AsyncLoader);
+	m_AsyncLoader = nullptr;
+}
+
+void CPhysicsCollision::AsyncLoaderThread::AddLoad(const AsyncLoad_t &load) {
+	m_QueueMutex.Lock();
+	m_Queue.AddToTail(load);
+	m_QueueMutex.Unlock();
+	m_WakeEvent.Set();
+}
+
+void CPhysicsCollision::AsyncLoaderThread::Stop() {
+	m_Exiting = true;
+	m_WakeEvent.Set();
+	Join();
+}
+
+int CPhysicsCollision::AsyncLoaderThread::Run() {
+	for (;;) {
+		m_WakeEvent.Wait();
+		// Finishing the queued loads even when exiting, so callbacks are called for all of them.
+		for (;;) {
+			m_QueueMutex.Lock();
+			if (m_Queue.Count() == 0) {
+				m_QueueMutex.Unlock();
+				break;
+			}
+			AsyncLoad_t load = m_Queue[0];
+			m_Queue.Remove(0);
+			m_QueueMutex.Unlock();
+			g_pPhysCollision->VCollideLoad(load.m_Output, load.m_SolidCount, load.m_Buffer, load.m_Size, load.m_Swap);
+			load.m_Callback->OnVCollideLoaded(load.m_Output);
+		}
+		if (m_Exiting) {
+			break;
+		}
+	}
+	return 0;
+}
+
 void CPhysicsCollision::VCollideUnload(vcollide_t *pVCollide) {
 	for (int solidIndex = 0; solidIndex < pVCollide->solidCount; ++solidIndex) {
 		CPhysCollide *solid = pVCollide->solids[solidIndex];
@@ -8,10 +8,13 @@
 #include "vphysics/virtualmesh.h"
 #include <LinearMath/btConvexHull.h>
 #include "cmodel.h"
+#include "tier0/threadtools.h"
 #include "tier1/byteswap.h"
 #include "tier1/utlvector.h"
 
 #define VPHYSICS_CONVEX_DISTANCE_MARGIN HL2BULLET(0.25f)
+// Point indices of convex hulls are 16-bit.
+#define VPHYSICS_HULL_MAX_POINTS 65536
 
 /*************************************************************************
  * Serialization structures
@@ -106,6 +109,48 @@ struct VCollide_IVP_Compact_Surface {
 #pragma bitfield_order(pop)
 #endif
 
+/*********************************************************************************
+ * Native serialization structures
+ * Every field is 32-bit, so the whole surface is byte swapped as an array of words.
+ *********************************************************************************/
+
+// Followed by the convexes, and then by the AABB tree nodes if there's more than one convex.
+struct VCollide_Bullet_Compound {
+	float massCenter[3];
+	float inertia[3];
+	float volume;
+	int convexCount;
+	int treeNodeCount;
+};
+
+enum VCollide_Bullet_ConvexType {
+	VCOLLIDE_BULLET_CONVEX_HULL,
+	VCOLLIDE_BULLET_CONVEX_BOX
+};
+
+// Hulls are followed by pointCount points as float[4], triangleCount * 3 unsigned int indices, and, if the hull
+// has per-triangle materials, triangleCount planes as float[4] and triangleCount int materials.
+struct VCollide_Bullet_Convex {
+	int type;
+	int byteSize; // Including the data following the header.
+	int gameData;
+	float origin[3]; // In the compound, for boxes.
+	float halfExtents[3]; // For boxes.
+	float volume;
+	float massCenter[3];
+	float inertia[3];
+	int pointCount;
+	int triangleCount;
+	int hasTriangleMaterials;
+};
+
+// Nodes are in depth-first order - the left child of an internal node immediately follows it.
+struct VCollide_Bullet_CompoundNode {
+	float aabbMin[3];
+	float aabbMax[3];
+	int rightNodeOrConvex; // Index of the right child node if internal, ~convexIndex if a leaf.
+};
+
 /************************
  * Convex shape wrappers
  ************************/
@@ -148,6 +193,10 @@ public:
 
 	virtual btVector3 GetOriginInCompound() const { return btVector3(0.0f, 0.0f, 0.0f); }
 
+	// Native serialization, in the native byte order. Size is 0 if the convex can't be serialized.
+	virtual int GetSerializedSize() const { return 0; }
+	virtual void Serialize(VCollide_Bullet_Convex *output) const {}
+
 	virtual void Release() = 0;
 
 protected:
@@ -167,15 +216,16 @@ public:
 	CPhysConvex_Hull(
 			const VCollide_IVP_Compact_Triangle *swappedAndRemappedTriangles, int triangleCount,
 			const btVector3 *ledgePoints, int ledgePointCount, int userIndex);
+	// From serialized data, with the properties loaded afterwards rather than calculated.
+	CPhysConvex_Hull(const btScalar *points, int pointCount, int pointStride,
+			const unsigned int *indices, int triangleCount);
 	static CPhysConvex_Hull *CreateFromBulletPoints(
 			HullLibrary &hullLibrary, const btVector3 *points, int pointCount);
 
 	btCollisionShape *GetShape() { return &m_Shape; }
 	const btCollisionShape *GetShape() const { return &m_Shape; }
-	FORCEINLINE btConvexHullShape *GetConvexHullShape() { return &m_Shape; }
-	FORCEINLINE const btConvexHullShape *GetConvexHullShape() const { return &m_Shape; }
 	inline static bool IsHull(const CPhysConvex *convex) {
-		return convex->GetShape()->getShapeType() == CONVEX_HULL_SHAPE_PROXYTYPE;
+		return convex->GetShape()->getShapeType() == CUSTOM_POLYHEDRAL_SHAPE_TYPE;
 	}
 
 	// For IVP ledges, first calls to these will calculate the values.
@@ -186,7 +236,7 @@ public:
 	// Returns false if fully submerged (and doesn't write volume and center*volume in this case).
 	static bool GetConvexTriangleMeshSubmergedVolume(
 			const btVector3 &origin, const btVector3 *points, int pointCount,
-			const unsigned int *indices, int indexCount,
+			const unsigned short *indices, int indexCount,
 			const btVector4 &plane, btScalar &volume, btVector3 &volumeWeightedBuoyancyCenter);
 	virtual btScalar GetSubmergedVolume(const btVector4 &plane, btVector3 &volumeWeightedBuoyancyCenter) const;
 
@@ -197,19 +247,112 @@ public:
 	int GetTriangleMaterialIndexAtPoint(const btVector3 &point) const;
 	virtual void SetTriangleMaterialIndex(int triangleIndex, int index7bits);
 
+	virtual int GetSerializedSize() const;
+	virtual void Serialize(VCollide_Bullet_Convex *output) const;
+	void LoadVolumeProperties(btScalar volume, const btVector3 &massCenter, const btVector3 &inertia);
+	// Materials are already validated.
+	void LoadTriangleMaterials(const int *materials);
+
+	// Start vertices of hill climbing for one pair of shapes, kept by the collision algorithm of the pair,
+	// as support queries within a pair are coherent between steps, but those of different pairs aren't.
+	// Both sides of a pair of the same shape share the first one.
+	struct SupportWarmStart_t {
+		SupportWarmStart_t() {
+			m_Shapes[0] = m_Shapes[1] = nullptr;
+			m_Vertices[0] = m_Vertices[1] = 0;
+		}
+		const btCollisionShape *m_Shapes[2];
+		int m_Vertices[2];
+	};
+	// Support queries on the current thread start from the warm start while this is in scope.
+	class SupportWarmStartScope {
+	public:
+		SupportWarmStartScope(SupportWarmStart_t &warmStart,
+				const btCollisionShape *shape0, const btCollisionShape *shape1);
+		~SupportWarmStartScope();
+	private:
+		SupportWarmStart_t *m_PreviousWarmStart;
+	};
+
 	virtual void Release();
 
 protected:
 	virtual void Initialize();
 
 private:
-	btConvexHullShape m_Shape;
+	// Convex hull shape with the points quantized to 16 bits within the bounds of the hull,
+	// which finds supporting vertices of large hulls by hill climbing over the edges.
+	// The error is up to 1/131070 of the size of the hull along each axis, so points of hulls
+	// where it would exceed HULL_QUANTIZATION_MAX_ERROR are stored with full precision instead.
+	class HullShape : public btPolyhedralConvexAabbCachingShape {
+	public:
+		HullShape(const btScalar *points, int pointCount, int pointStride = sizeof(btVector3));
 
-	btAlignedObjectArray<unsigned int> m_TriangleIndices;
+		FORCEINLINE bool IsQuantized() const { return m_FullPrecisionPoints.size() == 0; }
+		FORCEINLINE int GetPointCount() const {
+			return (IsQuantized() ? m_QuantizedPoints.size() / 3 : m_FullPrecisionPoints.size());
+		}
+		// Without the local scaling.
+		FORCEINLINE btVector3 GetPoint(int index) const {
+			if (!IsQuantized()) {
+				return m_FullPrecisionPoints[index];
+			}
+			const unsigned short *quantizedPoint = &m_QuantizedPoints[index * 3];
+			return m_QuantizationOrigin + m_QuantizationStep *
+					btVector3(quantizedPoint[0], quantizedPoint[1], quantizedPoint[2]);
+		}
+		void GetPoints(btAlignedObjectArray<btVector3> &points) const;
+
+		// Switches to hill climbing if the hull is large and the triangles use all its points.
+		void BuildAdjacency(const btAlignedObjectArray<unsigned short> &triangleIndices);
+		// Faces and unique edges for clipping contact generation, which gives hulls resting on a face
+		// a full manifold in one step. Built from the triangles rather than by recomputing the hull,
+		// from the same rounded points as the support mapping.
+		void BuildPolyhedralFeatures(const btAlignedObjectArray<unsigned short> &triangleIndices);
+
+		virtual btVector3 localGetSupportingVertexWithoutMargin(const btVector3 &vec) const;
+		virtual void batchedUnitVectorGetSupportingVertexWithoutMargin(
+				const btVector3 *vectors, btVector3 *supportVerticesOut, int numVectors) const;
+		virtual const char *getName() const { return "VPhysicsHull"; }
+
+		// Same as in btConvexHullShape.
+		virtual int getNumVertices() const { return GetPointCount(); }
+		virtual int getNumEdges() const { return GetPointCount(); }
+		virtual void getEdge(int i, btVector3 &pa, btVector3 &pb) const;
+		virtual void getVertex(int i, btVector3 &vtx) const { vtx = GetPoint(i) * m_localScaling; }
+		virtual int getNumPlanes() const { return 0; }
+		virtual void getPlane(btVector3 &planeNormal, btVector3 &planeSupport, int i) const { btAssert(false); }
+		virtual bool isInside(const btVector3 &pt, btScalar tolerance) const { btAssert(false); return false; }
+
+	private:
+		btAlignedObjectArray<unsigned short> m_QuantizedPoints;
+		btVector3 m_QuantizationOrigin, m_QuantizationStep;
+		btAlignedObjectArray<btVector3> m_FullPrecisionPoints;
+
+		// For quantized points, the direction must be multiplied by the quantization step,
+		// and the quantization origin is not added.
+		FORCEINLINE btScalar PointDot(int index, const btVector3 &direction) const {
+			if (!IsQuantized()) {
+				return m_FullPrecisionPoints[index].dot(direction);
+			}
+			const unsigned short *quantizedPoint = &m_QuantizedPoints[index * 3];
+			return btScalar(quantizedPoint[0]) * direction.getX() + btScalar(quantizedPoint[1]) * direction.getY() +
+					btScalar(quantizedPoint[2]) * direction.getZ();
+		}
+		int FindSupportingPoint(const btVector3 &direction) const;
+		int FindSupportingPointLinear(const btVector3 &direction) const;
+
+		// Neighbors of vertex i are from m_NeighborOffsets[i] to m_NeighborOffsets[i + 1].
+		// Climbing starts where the last search of the pair ended, see SupportWarmStart_t.
+		btAlignedObjectArray<int> m_NeighborOffsets;
+		btAlignedObjectArray<unsigned short> m_Neighbors;
+	};
+	HullShape m_Shape;
 
-	void CalculateTrianglePlanes();
-	// For per-triangle materials.
-	btAlignedObjectArray<btVector4> m_TrianglePlanes;
+	btAlignedObjectArray<unsigned short> m_TriangleIndices;
+
+	// For per-triangle materials, calculated when needed rather than stored.
+	btVector4 CalculateTrianglePlane(int triangleIndex, const btVector3 &center) const;
 	// These are not remapped, as material table may be loaded after the collide.
 	btAlignedObjectArray<unsigned char> m_TriangleMaterials;
 
@@ -241,16 +384,70 @@ public:
 
 	virtual btVector3 GetOriginInCompound() const { return m_Origin; }
 
+	virtual int GetSerializedSize() const { return sizeof(VCollide_Bullet_Convex); }
+	virtual void Serialize(VCollide_Bullet_Convex *output) const;
+
 	virtual void Release();
 
 	// These are correctly oriented for the ---, --+, -+-... sequence.
-	static const unsigned int s_BoxTriangleIndices[36];
+	static const unsigned short s_BoxTriangleIndices[36];
 
 private:
 	btBoxShape m_Shape;
 	btVector3 m_Origin;
 };
 
+/****************
+ * Unserializing
+ ****************/
+
+// Scratch state for unserializing collideables, reducing the number of memory allocations.
+// Owned by the caller rather than by the interface, so collideables can be loaded on multiple threads at once.
+class CPhysCollideUnserializeContext {
+public:
+	btAlignedObjectArray<btVector3> m_Points;
+
+	// IVP surfaces.
+	CUtlVector<VCollide_IVP_Compact_Triangle> m_SwappedAndRemappedIVPTriangles;
+	CUtlVector<int> m_IVPPointMap;
+	// The parent index is of the compound tree node to link the node to as the right child, or -1.
+	FORCEINLINE void PushIVPNode(const VCollide_IVP_Compact_Ledgetree_Node *node, int parentTreeNodeIndex) {
+		IVPNodeStackEntry_t entry = { node, parentTreeNodeIndex };
+		m_IVPNodeStack.AddToTail(entry);
+	}
+	inline const VCollide_IVP_Compact_Ledgetree_Node *PopIVPNode(int &parentTreeNodeIndex) {
+		int stackDepth = m_IVPNodeStack.Count();
+		if (stackDepth == 0) {
+			return nullptr;
+		}
+		const IVPNodeStackEntry_t &entry = m_IVPNodeStack[stackDepth - 1];
+		const VCollide_IVP_Compact_Ledgetree_Node *node = entry.m_Node;
+		parentTreeNodeIndex = entry.m_ParentTreeNodeIndex;
+		m_IVPNodeStack.Remove(stackDepth - 1);
+		return node;
+	}
+	// The ledgetree converted to the native format to be loaded as the AABB tree of the compound.
+	CUtlVector<VCollide_Bullet_CompoundNode> m_CompoundTreeNodes;
+
+	// Native surfaces.
+	CUtlVector<unsigned int> m_SwappedBulletSurface;
+	CUtlVector<CPhysConvex *> m_UnserializedBulletConvexes;
+
+private:
+	struct IVPNodeStackEntry_t {
+		const VCollide_IVP_Compact_Ledgetree_Node *m_Node;
+		int m_ParentTreeNodeIndex;
+	};
+	CUtlVector<IVPNodeStackEntry_t> m_IVPNodeStack;
+};
+
+// Receives the result of CPhysicsCollision::VCollideLoadAsync on the loader thread.
+class IVCollideLoadCallback {
+public:
+	virtual ~IVCollideLoadCallback() {}
+	virtual void OnVCollideLoaded(vcollide_t *pOutput) = 0;
+};
+
 /***************
  * Collideables
  ***************/
@@ -291,6 +488,11 @@ public:
 	// Returns the true number of convexes, not clamped, for possibility of multiple calls.
 	virtual int GetConvexes(CPhysConvex **output, int limit) const { return 0; }
 
+	// Native serialization of the surface following the header, in the native byte order.
+	// Size is 0 if the collideable can't be serialized.
+	virtual int GetSerializedSize() const { return 0; }
+	virtual void Serialize(char *output) const {}
+
 	FORCEINLINE IPhysicsObject *GetObjectReferenceList() const {
 		return m_ObjectReferenceList;
 	}
@@ -331,7 +533,12 @@ public:
 	CPhysCollide_Compound(
 			const VCollide_IVP_Compact_Ledgetree_Node *root, CByteswap &byteswap,
 			const btVector3 &massCenter, const btVector3 &inertia,
-			const btVector3 &orthographicAreas);
+			const btVector3 &orthographicAreas, CPhysCollideUnserializeContext &context);
+	// From serialized data - the tree is built if the nodes are not provided or are invalid.
+	CPhysCollide_Compound(CPhysConvex **pConvex, int convexCount,
+			btScalar volume, const btVector3 &massCenter, const btVector3 &inertia,
+			const btVector3 &orthographicAreas,
+			const VCollide_Bullet_CompoundNode *treeNodes, int treeNodeCount);
 	virtual ~CPhysCollide_Compound();
 	btCollisionShape *GetShape() { return &m_Shape; }
 	const btCollisionShape *GetShape() const { return &m_Shape; }
@@ -354,10 +561,22 @@ public:
 
 	virtual int GetConvexes(CPhysConvex **output, int limit) const;
 
+	virtual int GetSerializedSize() const;
+	virtual void Serialize(char *output) const;
+
 	virtual void Release();
 
 private:
-	btCompoundShape m_Shape;
+	// Compound shape which can have its AABB tree loaded rather than built from the children.
+	class CompoundShape : public btCompoundShape {
+	public:
+		CompoundShape(int initialChildCapacity = 0) : btCompoundShape(false, initialChildCapacity) {}
+		// Returns false if the tree is invalid for the children.
+		bool LoadAabbTree(const VCollide_Bullet_CompoundNode *nodes, int nodeCount);
+		// Returns the number of nodes written.
+		int SaveAabbTree(VCollide_Bullet_CompoundNode *nodes) const;
+	};
+	CompoundShape m_Shape;
 
 	void CalculateInertia();
 	btScalar m_Volume;
@@ -458,175 +677,31 @@ private:
 	int m_SurfacePropsIndex; // Doesn't need remapping.
 };
 
-/************
- * Interface
- ************/
+/*********
+ * Traces
+ *********/
 
-class CPhysicsCollision : public IPhysicsCollision {
+// Scratch state of collideable queries. Queries using different contexts can be done concurrently.
+class CPhysicsTraceContext {
 public:
-	CPhysicsCollision();
-	virtual ~CPhysicsCollision();
+	CPhysicsTraceContext();
+	~CPhysicsTraceContext();
 
-	// IPhysicsCollision methods.
+	static void ClearTrace(trace_t *trace);
 
-	virtual CPhysConvex *ConvexFromVerts(Vector **pVerts, int vertCount);
-	virtual CPhysConvex *ConvexFromPlanes(float *pPlanes, int planeCount, float mergeDistance);
-	virtual float ConvexVolume(CPhysConvex *pConvex);
-	virtual float ConvexSurfaceArea(CPhysConvex *pConvex);
-	virtual void SetConvexGameData(CPhysConvex *pConvex, unsigned int gameData);
-	virtual void ConvexFree(CPhysConvex *pConvex);
-	virtual CPhysConvex *BBoxToConvex(const Vector &mins, const Vector &maxs);
-	virtual CPhysConvex *ConvexFromConvexPolyhedron(const CPolyhedron &ConvexPolyhedron);
-	/* DUMMY */ virtual void ConvexesFromConvexPolygon(
-			const Vector &vPolyNormal, const Vector *pPoints, int iPointCount, CPhysConvex **pOutput) {
-		*pOutput = nullptr;
-	}
-	virtual CPhysPolysoup *PolysoupCreate();
-	virtual void PolysoupDestroy(CPhysPolysoup *pSoup);
-	virtual void PolysoupAddTriangle(CPhysPolysoup *pSoup,
-			const Vector &a, const Vector &b, const Vector &c, int materialIndex7bits);
-	virtual CPhysCollide *ConvertPolysoupToCollide(CPhysPolysoup *pSoup, bool useMOPP);
-	virtual CPhysCollide *ConvertConvexToCollide(CPhysConvex **pConvex, int convexCount);
-	virtual CPhysCollide *ConvertConvexToCollideParams(CPhysConvex **pConvex, int convexCount,
-			const convertconvexparams_t &convertParams);
-	virtual void DestroyCollide(CPhysCollide *pCollide);
-	/* DUMMY */ virtual int CollideSize(CPhysCollide *pCollide) { return 0; }
-	/* DUMMY */ virtual int CollideWrite(char *pDest, CPhysCollide *pCollide, bool bSwap) { return 0; }
-	virtual CPhysCollide *UnserializeCollide(char *pBuffer, int size, int index);
-	virtual float CollideVolume(CPhysCollide *pCollide);
-	virtual float CollideSurfaceArea(CPhysCollide *pCollide);
-	virtual Vector CollideGetExtent(const CPhysCollide *pCollide,
-			const Vector &collideOrigin, const QAngle &collideAngles, const Vector &direction);
-	virtual void CollideGetAABB(Vector *pMins, Vector *pMaxs, const CPhysCollide *pCollide,
-			const Vector &collideOrigin, const QAngle &collideAngles);
-	virtual void CollideGetMassCenter(CPhysCollide *pCollide, Vector *pOutMassCenter);
-	virtual void CollideSetMassCenter(CPhysCollide *pCollide, const Vector &massCenter);
-	virtual Vector CollideGetOrthographicAreas(const CPhysCollide *pCollide);
-	virtual void CollideSetOrthographicAreas(CPhysCollide *pCollide, const Vector &areas);
-	virtual int CollideIndex(const CPhysCollide *pCollide);
-	virtual CPhysCollide *BBoxToCollide(const Vector &mins, const Vector &maxs);
-	virtual int GetConvexesUsedInCollideable(const CPhysCollide *pCollideable,
-			CPhysConvex **pOutputArray, int iOutputArrayLimit);
-	virtual void TraceBox(const Vector &start, const Vector &end,
-			const Vector &mins, const Vector &maxs, const CPhysCollide *pCollide,
-			const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr);
-	virtual void TraceBox(const Ray_t &ray, const CPhysCollide *pCollide,
-			const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr);
-	virtual void TraceBox(const Ray_t &ray, unsigned int contentsMask,
+	void TraceBox(const Ray_t &ray, unsigned int contentsMask,
 			IConvexInfo *pConvexInfo, const CPhysCollide *pCollide,
 			const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr);
-	virtual void TraceCollide(const Vector &start, const Vector &end,
+	void TraceCollide(const Vector &start, const Vector &end,
 			const CPhysCollide *pSweepCollide, const QAngle &sweepAngles, const CPhysCollide *pCollide,
 			const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr);
-	virtual bool IsBoxIntersectingCone(
+	bool IsBoxIntersectingCone(
 			const Vector &boxAbsMins, const Vector &boxAbsMaxs, const truncatedcone_t &cone);
-	virtual void VCollideLoad(vcollide_t *pOutput,
-			int solidCount, const char *pBuffer, int size, bool swap);
-	virtual void VCollideUnload(vcollide_t *pVCollide);
-	virtual IVPhysicsKeyParser *VPhysicsKeyParserCreate(const char *pKeyData);
-	virtual void VPhysicsKeyParserDestroy(IVPhysicsKeyParser *pParser);
-	/* DUMMY */ virtual int CreateDebugMesh(CPhysCollide const *pCollisionModel, Vector **outVerts) {
-		*outVerts = nullptr;
-		return 0;
-	}
-	/* DUMMY */ virtual void DestroyDebugMesh(int vertCount, Vector *outVerts) {}
-	virtual ICollisionQuery *CreateQueryModel(CPhysCollide *pCollide);
-	virtual void DestroyQueryModel(ICollisionQuery *pQuery);
-	virtual IPhysicsCollision *ThreadContextCreate();
-	virtual void ThreadContextDestroy(IPhysicsCollision *pThreadContext);
-	virtual CPhysCollide *CreateVirtualMesh(const virtualmeshparams_t &params);
-	virtual bool SupportsVirtualMesh();
-	/* DUMMY */ virtual bool GetBBoxCacheSize(int *pCachedSize, int *pCachedCount) {
-		*pCachedSize = 0;
-		*pCachedCount = m_BBoxCache.Count();
-		return true;
-	}
-	/* DUMMY */ virtual CPolyhedron *PolyhedronFromConvex(CPhysConvex * const pConvex, bool bUseTempPolyhedron) { return nullptr; }
-	/* DUMMY */ virtual void OutputDebugInfo(const CPhysCollide *pCollide) {}
-	virtual unsigned int ReadStat(int statID);
-
-	// Internal methods.
-
-	// To reduce the number of memory allocations.
-	FORCEINLINE btAlignedObjectArray<btVector3> &GetHullCreationPointArray() { return m_HullCreationPoints; }
-
-	CPhysConvex_Hull *CreateConvexHullFromIVPCompactLedge(const VCollide_IVP_Compact_Ledge *ledge, CByteswap &byteswap);
-
-	CPhysCollide *UnserializeCollideFromBuffer(
-			const char *pBuffer, int size, int index, bool swap);
-
-	FORCEINLINE void PushIVPNode(const VCollide_IVP_Compact_Ledgetree_Node *node) {
-		m_IVPNodeStack.AddToTail(node);
-	}
-	inline const VCollide_IVP_Compact_Ledgetree_Node *PopIVPNode() {
-		int stackDepth = m_IVPNodeStack.Count();
-		if (stackDepth == 0) {
-			return nullptr;
-		}
-		const VCollide_IVP_Compact_Ledgetree_Node *node = m_IVPNodeStack[stackDepth - 1];
-		m_IVPNodeStack.Remove(stackDepth - 1);
-		return node;
-	}
-
-	static btVector3 BoxInertia(const btVector3 &extents);
-	static btVector3 OffsetInertia(
-			const btVector3 &inertia, const btVector3 &origin, bool absolute = true);
 
 	FORCEINLINE btCollisionObject *GetTraceCollisionObject() { return &m_TraceCollisionObject; }
 	FORCEINLINE bool IsInContactTest() const { return m_InContactTest; } // To suppress callbacks.
 
-	CPhysCollide_Sphere *CreateCachedSphereCollide(btScalar radius);
-
-	// Destruction of convexes owned by compound collideables
-	// (can't delete child shapes until CPhysCollide_Compound destructor is finished).
-	void AddCompoundConvexToDeleteQueue(CPhysConvex *convex);
-	void CleanupCompoundConvexDeleteQueue();
-
 private:
-	/***************
-	 * Convex hulls
-	 ***************/
-
-	btAlignedObjectArray<btVector3> m_HullCreationPoints;
-
-	HullLibrary m_HullLibrary;
-
-	// Reducing the number of allocations during IVP surface unserialization.
-	CUtlVector<VCollide_IVP_Compact_Triangle> m_SwappedAndRemappedIVPTriangles;
-	CUtlVector<int> m_IVPPointMap;
-
-	/*****************
-	 * Bounding boxes
-	 *****************/
-
-	CPhysCollide_Compound *CreateBBox(const Vector &mins, const Vector &maxs);
-	CUtlVector<CPhysCollide_Compound *> m_BBoxCache;
-
-	/******************
-	 * Compound shapes
-	 ******************/
-
-	CPhysCollide *UnserializeIVPCompactSurface(
-			const VCollide_IVP_Compact_Surface *surface, CByteswap &byteswap,
-			const btVector3 &orthographicAreas);
-	CUtlVector<const VCollide_IVP_Compact_Ledgetree_Node *> m_IVPNodeStack;
-
-	CUtlVector<CPhysConvex *> m_CompoundConvexDeleteQueue;
-
-	/**********
-	 * Spheres
-	 **********/
-
-	CUtlVector<CPhysCollide_Sphere *> m_SphereCache;
-
-	/*********
-	 * Traces
-	 *********/
-
-	// Common.
-
-	static void ClearTrace(trace_t *trace);
-
 	btCollisionObject m_TraceCollisionObject;
 
 	struct TraceContentsFilter {
@@ -823,6 +898,201 @@ private:
 	};
 };
 
+/************
+ * Interface
+ ************/
+
+class CPhysicsCollision : public IPhysicsCollision {
+public:
+	CPhysicsCollision();
+	virtual ~CPhysicsCollision();
+
+	// IPhysicsCollision methods.
+
+	virtual CPhysConvex *ConvexFromVerts(Vector **pVerts, int vertCount);
+	virtual CPhysConvex *ConvexFromPlanes(float *pPlanes, int planeCount, float mergeDistance);
+	virtual float ConvexVolume(CPhysConvex *pConvex);
+	virtual float ConvexSurfaceArea(CPhysConvex *pConvex);
+	virtual void SetConvexGameData(CPhysConvex *pConvex, unsigned int gameData);
+	virtual void ConvexFree(CPhysConvex *pConvex);
+	virtual CPhysConvex *BBoxToConvex(const Vector &mins, const Vector &maxs);
+	virtual CPhysConvex *ConvexFromConvexPolyhedron(const CPolyhedron &ConvexPolyhedron);
+	/* DUMMY */ virtual void ConvexesFromConvexPolygon(
+			const Vector &vPolyNormal, const Vector *pPoints, int iPointCount, CPhysConvex **pOutput) {
+		*pOutput = nullptr;
+	}
+	virtual CPhysPolysoup *PolysoupCreate();
+	virtual void PolysoupDestroy(CPhysPolysoup *pSoup);
+	virtual void PolysoupAddTriangle(CPhysPolysoup *pSoup,
+			const Vector &a, const Vector &b, const Vector &c, int materialIndex7bits);
+	virtual CPhysCollide *ConvertPolysoupToCollide(CPhysPolysoup *pSoup, bool useMOPP);
+	virtual CPhysCollide *ConvertConvexToCollide(CPhysConvex **pConvex, int convexCount);
+	virtual CPhysCollide *ConvertConvexToCollideParams(CPhysConvex **pConvex, int convexCount,
+			const convertconvexparams_t &convertParams);
+	virtual void DestroyCollide(CPhysCollide *pCollide);
+	virtual int CollideSize(CPhysCollide *pCollide);
+	virtual int CollideWrite(char *pDest, CPhysCollide *pCollide, bool bSwap);
+	virtual CPhysCollide *UnserializeCollide(char *pBuffer, int size, int index);
+	virtual float CollideVolume(CPhysCollide *pCollide);
+	virtual float CollideSurfaceArea(CPhysCollide *pCollide);
+	virtual Vector CollideGetExtent(const CPhysCollide *pCollide,
+			const Vector &collideOrigin, const QAngle &collideAngles, const Vector &direction);
+	virtual void CollideGetAABB(Vector *pMins, Vector *pMaxs, const CPhysCollide *pCollide,
+			const Vector &collideOrigin, const QAngle &collideAngles);
+	virtual void CollideGetMassCenter(CPhysCollide *pCollide, Vector *pOutMassCenter);
+	virtual void CollideSetMassCenter(CPhysCollide *pCollide, const Vector &massCenter);
+	virtual Vector CollideGetOrthographicAreas(const CPhysCollide *pCollide);
+	virtual void CollideSetOrthographicAreas(CPhysCollide *pCollide, const Vector &areas);
+	virtual int CollideIndex(const CPhysCollide *pCollide);
+	virtual CPhysCollide *BBoxToCollide(const Vector &mins, const Vector &maxs);
+	virtual int GetConvexesUsedInCollideable(const CPhysCollide *pCollideable,
+			CPhysConvex **pOutputArray, int iOutputArrayLimit);
+	virtual void TraceBox(const Vector &start, const Vector &end,
+			const Vector &mins, const Vector &maxs, const CPhysCollide *pCollide,
+			const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr);
+	virtual void TraceBox(const Ray_t &ray, const CPhysCollide *pCollide,
+			const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr);
+	virtual void TraceBox(const Ray_t &ray, unsigned int contentsMask,
+			IConvexInfo *pConvexInfo, const CPhysCollide *pCollide,
+			const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr);
+	virtual void TraceCollide(const Vector &start, const Vector &end,
+			const CPhysCollide *pSweepCollide, const QAngle &sweepAngles, const CPhysCollide *pCollide,
+			const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr);
+	virtual bool IsBoxIntersectingCone(
+			const Vector &boxAbsMins, const Vector &boxAbsMaxs, const truncatedcone_t &cone);
+	virtual void VCollideLoad(vcollide_t *pOutput,
+			int solidCount, const char *pBuffer, int size, bool swap);
+	virtual void VCollideUnload(vcollide_t *pVCollide);
+	virtual IVPhysicsKeyParser *VPhysicsKeyParserCreate(const char *pKeyData);
+	virtual void VPhysicsKeyParserDestroy(IVPhysicsKeyParser *pParser);
+	/* DUMMY */ virtual int CreateDebugMesh(CPhysCollide const *pCollisionModel, Vector **outVerts) {
+		*outVerts = nullptr;
+		return 0;
+	}
+	/* DUMMY */ virtual void DestroyDebugMesh(int vertCount, Vector *outVerts) {}
+	virtual ICollisionQuery *CreateQueryModel(CPhysCollide *pCollide);
+	virtual void DestroyQueryModel(ICollisionQuery *pQuery);
+	virtual IPhysicsCollision *ThreadContextCreate();
+	virtual void ThreadContextDestroy(IPhysicsCollision *pThreadContext);
+	virtual CPhysCollide *CreateVirtualMesh(const virtualmeshparams_t &params);
+	virtual bool SupportsVirtualMesh();
+	/* DUMMY */ virtual bool GetBBoxCacheSize(int *pCachedSize, int *pCachedCount) {
+		*pCachedSize = 0;
+		*pCachedCount = m_BBoxCache.Count();
+		return true;
+	}
+	/* DUMMY */ virtual CPolyhedron *PolyhedronFromConvex(CPhysConvex * const pConvex, bool bUseTempPolyhedron) { return nullptr; }
+	/* DUMMY */ virtual void OutputDebugInfo(const CPhysCollide *pCollide) {}
+	virtual unsigned int ReadStat(int statID);
+
+	// Internal methods.
+
+	// To reduce the number of memory allocations.
+	FORCEINLINE btAlignedObjectArray<btVector3> &GetHullCreationPointArray() { return m_HullCreationPoints; }
+
+	CPhysConvex_Hull *CreateConvexHullFromIVPCompactLedge(const VCollide_IVP_Compact_Ledge *ledge, CByteswap &byteswap,
+			CPhysCollideUnserializeContext &context);
+
+	// Can be called on any thread, with a context owned by it.
+	CPhysCollide *UnserializeCollideFromBuffer(
+			const char *pBuffer, int size, int index, bool swap, CPhysCollideUnserializeContext &context);
+
+	// Same as VCollideLoad, but done on a background thread, with the callback called there when done.
+	// The buffer must be valid until then. Calls must be made from one thread.
+	void VCollideLoadAsync(vcollide_t *pOutput, int solidCount, const char *pBuffer, int size, bool swap,
+			IVCollideLoadCallback *pCallback);
+	// Finishes the pending asynchronous loads and stops the loader thread.
+	void ShutdownAsyncLoader();
+
+	static btVector3 BoxInertia(const btVector3 &extents);
+	static btVector3 OffsetInertia(
+			const btVector3 &inertia, const btVector3 &origin, bool absolute = true);
+
+	FORCEINLINE btCollisionObject *GetTraceCollisionObject() { return m_TraceContext.GetTraceCollisionObject(); }
+
+	CPhysCollide_Sphere *CreateCachedSphereCollide(btScalar radius);
+
+	// Destruction of convexes owned by compound collideables
+	// (can't delete child shapes until CPhysCollide_Compound destructor is finished).
+	void AddCompoundConvexToDeleteQueue(CPhysConvex *convex);
+	void CleanupCompoundConvexDeleteQueue();
+
+private:
+	/***************
+	 * Convex hulls
+	 ***************/
+
+	btAlignedObjectArray<btVector3> m_HullCreationPoints;
+
+	HullLibrary m_HullLibrary;
+
+	/*****************
+	 * Bounding boxes
+	 *****************/
+
+	CPhysCollide_Compound *CreateBBox(const Vector &mins, const Vector &maxs);
+	CUtlVector<CPhysCollide_Compound *> m_BBoxCache;
+
+	/******************
+	 * Compound shapes
+	 ******************/
+
+	CPhysCollide *UnserializeIVPCompactSurface(
+			const VCollide_IVP_Compact_Surface *surface, CByteswap &byteswap,
+			const btVector3 &orthographicAreas, CPhysCollideUnserializeContext &context);
+
+	// Native surfaces.
+	CPhysCollide *UnserializeBulletCompound(const char *surface, int surfaceSize, CByteswap &byteswap,
+			const btVector3 &orthographicAreas, CPhysCollideUnserializeContext &context);
+	// The convex must be validated to fit in the buffer.
+	CPhysConvex *UnserializeBulletConvex(const VCollide_Bullet_Convex *serializedConvex,
+			CPhysCollideUnserializeContext &context);
+
+	/*******************
+	 * VCollide loading
+	 *******************/
+
+	struct AsyncLoad_t {
+		vcollide_t *m_Output;
+		int m_SolidCount;
+		const char *m_Buffer;
+		int m_Size;
+		bool m_Swap;
+		IVCollideLoadCallback *m_Callback;
+	};
+	class AsyncLoaderThread : public CThread {
+	public:
+		AsyncLoaderThread() : m_Exiting(false) {}
+		void AddLoad(const AsyncLoad_t &load);
+		// Returns after the queued loads are done.
+		void Stop();
+	protected:
+		virtual int Run();
+	private:
+		CThreadFastMutex m_QueueMutex;
+		CUtlVector<AsyncLoad_t> m_Queue;
+		CThreadEvent m_WakeEvent;
+		volatile bool m_Exiting;
+	};
+	// Started when needed.
+	AsyncLoaderThread *m_AsyncLoader;
+
+	CUtlVector<CPhysConvex *> m_CompoundConvexDeleteQueue;
+
+	/**********
+	 * Spheres
+	 **********/
+
+	CUtlVector<CPhysCollide_Sphere *> m_SphereCache;
+
+	/*********
+	 * Traces
+	 *********/
+
+	// Only for queries through the main interface, thread contexts have their own.
+	CPhysicsTraceContext m_TraceContext;
+};
+
 class CCollisionQuery : public ICollisionQuery {
 public:
 	CCollisionQuery(CPhysCollide *collide);
@@ -848,4 +1118,185 @@ private:
 
 extern CPhysicsCollision *g_pPhysCollision;
 
+// Returned by ThreadContextCreate. Queries use the scratch state of the context,
+// so they can be done concurrently with queries in other contexts,
+// everything else is forwarded to the main interface.
+class CPhysicsCollisionThreadContext : public IPhysicsCollision {
+public:
+	virtual CPhysConvex *ConvexFromVerts(Vector **pVerts, int vertCount) {
+		return g_pPhysCollision->ConvexFromVerts(pVerts, vertCount);
+	}
+	virtual CPhysConvex *ConvexFromPlanes(float *pPlanes, int planeCount, float mergeDistance) {
+		return g_pPhysCollision->ConvexFromPlanes(pPlanes, planeCount, mergeDistance);
+	}
+	virtual float ConvexVolume(CPhysConvex *pConvex) {
+		return g_pPhysCollision->ConvexVolume(pConvex);
+	}
+	virtual float ConvexSurfaceArea(CPhysConvex *pConvex) {
+		return g_pPhysCollision->ConvexSurfaceArea(pConvex);
+	}
+	virtual void SetConvexGameData(CPhysConvex *pConvex, unsigned int gameData) {
+		g_pPhysCollision->SetConvexGameData(pConvex, gameData);
+	}
+	virtual void ConvexFree(CPhysConvex *pConvex) {
+		g_pPhysCollision->ConvexFree(pConvex);
+	}
+	virtual CPhysConvex *BBoxToConvex(const Vector &mins, const Vector &maxs) {
+		return g_pPhysCollision->BBoxToConvex(mins, maxs);
+	}
+	virtual CPhysConvex *ConvexFromConvexPolyhedron(const CPolyhedron &ConvexPolyhedron) {
+		return g_pPhysCollision->ConvexFromConvexPolyhedron(ConvexPolyhedron);
+	}
+	virtual void ConvexesFromConvexPolygon(
+			const Vector &vPolyNormal, const Vector *pPoints, int iPointCount, CPhysConvex **pOutput) {
+		g_pPhysCollision->ConvexesFromConvexPolygon(vPolyNormal, pPoints, iPointCount, pOutput);
+	}
+	virtual CPhysPolysoup *PolysoupCreate() {
+		return g_pPhysCollision->PolysoupCreate();
+	}
+	virtual void PolysoupDestroy(CPhysPolysoup *pSoup) {
+		g_pPhysCollision->PolysoupDestroy(pSoup);
+	}
+	virtual void PolysoupAddTriangle(CPhysPolysoup *pSoup,
+			const Vector &a, const Vector &b, const Vector &c, int materialIndex7bits) {
+		g_pPhysCollision->PolysoupAddTriangle(pSoup, a, b, c, materialIndex7bits);
+	}
+	virtual CPhysCollide *ConvertPolysoupToCollide(CPhysPolysoup *pSoup, bool useMOPP) {
+		return g_pPhysCollision->ConvertPolysoupToCollide(pSoup, useMOPP);
+	}
+	virtual CPhysCollide *ConvertConvexToCollide(CPhysConvex **pConvex, int convexCount) {
+		return g_pPhysCollision->ConvertConvexToCollide(pConvex, convexCount);
+	}
+	virtual CPhysCollide *ConvertConvexToCollideParams(CPhysConvex **pConvex, int convexCount,
+			const convertconvexparams_t &convertParams) {
+		return g_pPhysCollision->ConvertConvexToCollideParams(pConvex, convexCount, convertParams);
+	}
+	virtual void DestroyCollide(CPhysCollide *pCollide) {
+		g_pPhysCollision->DestroyCollide(pCollide);
+	}
+	virtual int CollideSize(CPhysCollide *pCollide) {
+		return g_pPhysCollision->CollideSize(pCollide);
+	}
+	virtual int CollideWrite(char *pDest, CPhysCollide *pCollide, bool bSwap) {
+		return g_pPhysCollision->CollideWrite(pDest, pCollide, bSwap);
+	}
+	virtual CPhysCollide *UnserializeCollide(char *pBuffer, int size, int index) {
+		return g_pPhysCollision->UnserializeCollide(pBuffer, size, index);
+	}
+	virtual float CollideVolume(CPhysCollide *pCollide) {
+		return g_pPhysCollision->CollideVolume(pCollide);
+	}
+	virtual float CollideSurfaceArea(CPhysCollide *pCollide) {
+		return g_pPhysCollision->CollideSurfaceArea(pCollide);
+	}
+	virtual Vector CollideGetExtent(const CPhysCollide *pCollide,
+			const Vector &collideOrigin, const QAngle &collideAngles, const Vector &direction) {
+		return g_pPhysCollision->CollideGetExtent(pCollide, collideOrigin, collideAngles, direction);
+	}
+	virtual void CollideGetAABB(Vector *pMins, Vector *pMaxs, const CPhysCollide *pCollide,
+			const Vector &collideOrigin, const QAngle &collideAngles) {
+		g_pPhysCollision->CollideGetAABB(pMins, pMaxs, pCollide, collideOrigin, collideAngles);
+	}
+	virtual void CollideGetMassCenter(CPhysCollide *pCollide, Vector *pOutMassCenter) {
+		g_pPhysCollision->CollideGetMassCenter(pCollide, pOutMassCenter);
+	}
+	virtual void CollideSetMassCenter(CPhysCollide *pCollide, const Vector &massCenter) {
+		g_pPhysCollision->CollideSetMassCenter(pCollide, massCenter);
+	}
+	virtual Vector CollideGetOrthographicAreas(const CPhysCollide *pCollide) {
+		return g_pPhysCollision->CollideGetOrthographicAreas(pCollide);
+	}
+	virtual void CollideSetOrthographicAreas(CPhysCollide *pCollide, const Vector &areas) {
+		g_pPhysCollision->CollideSetOrthographicAreas(pCollide, areas);
+	}
+	virtual int CollideIndex(const CPhysCollide *pCollide) {
+		return g_pPhysCollision->CollideIndex(pCollide);
+	}
+	virtual CPhysCollide *BBoxToCollide(const Vector &mins, const Vector &maxs) {
+		return g_pPhysCollision->BBoxToCollide(mins, maxs);
+	}
+	virtual int GetConvexesUsedInCollideable(const CPhysCollide *pCollideable,
+			CPhysConvex **pOutputArray, int iOutputArrayLimit) {
+		return g_pPhysCollision->GetConvexesUsedInCollideable(pCollideable, pOutputArray, iOutputArrayLimit);
+	}
+	virtual void TraceBox(const Vector &start, const Vector &end,
+			const Vector &mins, const Vector &maxs, const CPhysCollide *pCollide,
+			const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr) {
+		Ray_t ray;
+		ray.Init(start, end, mins, maxs);
+		m_TraceContext.TraceBox(ray, MASK_ALL, nullptr, pCollide, collideOrigin, collideAngles, ptr);
+	}
+	virtual void TraceBox(const Ray_t &ray, const CPhysCollide *pCollide,
+			const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr) {
+		m_TraceContext.TraceBox(ray, MASK_ALL, nullptr, pCollide, collideOrigin, collideAngles, ptr);
+	}
+	virtual void TraceBox(const Ray_t &ray, unsigned int contentsMask,
+			IConvexInfo *pConvexInfo, const CPhysCollide *pCollide,
+			const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr) {
+		m_TraceContext.TraceBox(ray, contentsMask, pConvexInfo, pCollide, collideOrigin, collideAngles, ptr);
+	}
+	virtual void TraceCollide(const Vector &start, const Vector &end,
+			const CPhysCollide *pSweepCollide, const QAngle &sweepAngles, const CPhysCollide *pCollide,
+			const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr) {
+		m_TraceContext.TraceCollide(start, end, pSweepCollide, sweepAngles, pCollide,
+				collideOrigin, collideAngles, ptr);
+	}
+	virtual bool IsBoxIntersectingCone(
+			const Vector &boxAbsMins, const Vector &boxAbsMaxs, const truncatedcone_t &cone) {
+		return m_TraceContext.IsBoxIntersectingCone(boxAbsMins, boxAbsMaxs, cone);
+	}
+	virtual void VCollideLoad(vcollide_t *pOutput,
+			int solidCount, const char *pBuffer, int size, bool swap) {
+		g_pPhysCollision->VCollideLoad(pOutput, solidCount, pBuffer, size, swap);
+	}
+	virtual void VCollideUnload(vcollide_t *pVCollide) {
+		g_pPhysCollision->VCollideUnload(pVCollide);
+	}
+	virtual IVPhysicsKeyParser *VPhysicsKeyParserCreate(const char *pKeyData) {
+		return g_pPhysCollision->VPhysicsKeyParserCreate(pKeyData);
+	}
+	virtual void VPhysicsKeyParserDestroy(IVPhysicsKeyParser *pParser) {
+		g_pPhysCollision->VPhysicsKeyParserDestroy(pParser);
+	}
+	virtual int CreateDebugMesh(CPhysCollide const *pCollisionModel, Vector **outVerts) {
+		return g_pPhysCollision->CreateDebugMesh(pCollisionModel, outVerts);
+	}
+	virtual void DestroyDebugMesh(int vertCount, Vector *outVerts) {
+		g_pPhysCollision->DestroyDebugMesh(vertCount, outVerts);
+	}
+	virtual ICollisionQuery *CreateQueryModel(CPhysCollide *pCollide) {
+		return g_pPhysCollision->CreateQueryModel(pCollide);
+	}
+	virtual void DestroyQueryModel(ICollisionQuery *pQuery) {
+		g_pPhysCollision->DestroyQueryModel(pQuery);
+	}
+	virtual IPhysicsCollision *ThreadContextCreate() {
+		return g_pPhysCollision->ThreadContextCreate();
+	}
+	virtual void ThreadContextDestroy(IPhysicsCollision *pThreadContext) {
+		g_pPhysCollision->ThreadContextDestroy(pThreadContext);
+	}
+	virtual CPhysCollide *CreateVirtualMesh(const virtualmeshparams_t &params) {
+		return g_pPhysCollision->CreateVirtualMesh(params);
+	}
+	virtual bool SupportsVirtualMesh() {
+		return g_pPhysCollision->SupportsVirtualMesh();
+	}
+	virtual bool GetBBoxCacheSize(int *pCachedSize, int *pCachedCount) {
+		return g_pPhysCollision->GetBBoxCacheSize(pCachedSize, pCachedCount);
+	}
+	virtual CPolyhedron *PolyhedronFromConvex(CPhysConvex * const pConvex, bool bUseTempPolyhedron) {
+		return g_pPhysCollision->PolyhedronFromConvex(pConvex, bUseTempPolyhedron);
+	}
+	virtual void OutputDebugInfo(const CPhysCollide *pCollide) {
+		g_pPhysCollision->OutputDebugInfo(pCollide);
+	}
+	virtual unsigned int ReadStat(int statID) {
+		return g_pPhysCollision->ReadStat(statID);
+	}
+
+private:
+	CPhysicsTraceContext m_TraceContext;
+};
+
 #endif
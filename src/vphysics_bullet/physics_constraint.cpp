@@ -7,7 +7,8 @@
 // TODO: Breakability, mass ratio, etc.
 
 CPhysicsConstraint::CPhysicsConstraint(IPhysicsObject *objectReference, IPhysicsObject *objectAttached) :
-		m_ObjectReference(objectReference), m_ObjectAttached(objectAttached), m_GameData(nullptr) {}
+		m_ObjectReference(objectReference), m_ObjectAttached(objectAttached),
+		m_GameData(nullptr), m_ConstraintIndex(-1) {}
 
 void CPhysicsConstraint::Activate() {
 	btTypedConstraint *constraint = GetBulletConstraint();
@@ -52,6 +53,11 @@ bool CPhysicsConstraint::AreObjectsValid() const {
 			m_ObjectReference != m_ObjectAttached && !m_ObjectAttached->IsStatic();
 }
 
+btRigidBody &CPhysicsConstraint::GetConstraintRigidBody(IPhysicsObject *object) {
+	btRigidBody *rigidBody = static_cast<CPhysicsObject *>(object)->GetRigidBody();
+	return (rigidBody != nullptr ? *rigidBody : btTypedConstraint::getFixedBody());
+}
+
 /******************
  * Hinge
  * A attached to B
@@ -68,16 +74,16 @@ CPhysicsConstraint_Hinge::CPhysicsConstraint_Hinge(
 		return;
 	}
 
-	btRigidBody *rigidBodyA = static_cast<CPhysicsObject *>(m_ObjectAttached)->GetRigidBody();
-	btRigidBody *rigidBodyB = static_cast<CPhysicsObject *>(m_ObjectReference)->GetRigidBody();
-	const btTransform &transformA = rigidBodyA->getCenterOfMassTransform();
-	const btTransform &transformB = rigidBodyB->getCenterOfMassTransform();
+	btRigidBody &rigidBodyA = GetConstraintRigidBody(m_ObjectAttached);
+	btRigidBody &rigidBodyB = GetConstraintRigidBody(m_ObjectReference);
+	const btTransform &transformA = rigidBodyA.getCenterOfMassTransform();
+	const btTransform &transformB = rigidBodyB.getCenterOfMassTransform();
 
 	btVector3 worldPosition, worldAxisDirection;
 	ConvertPositionToBullet(params.worldPosition, worldPosition);
 	ConvertDirectionToBullet(params.worldAxisDirection, worldAxisDirection);
 
-	m_Constraint = VPhysicsNew(btHingeConstraint, *rigidBodyA, *rigidBodyB,
+	m_Constraint = VPhysicsNew(btHingeConstraint, rigidBodyA, rigidBodyB,
 			transformA.invXform(worldPosition), transformB.invXform(worldPosition),
 			worldAxisDirection * transformA.getBasis(), worldAxisDirection * transformB.getBasis());
 	InitializeBulletConstraint(&params.constraint);
@@ -140,9 +146,13 @@ CPhysicsConstraint_Ballsocket::CPhysicsConstraint_Ballsocket(
 	ConvertPositionToBullet(params.constraintPosition[1], objectLocalPositionA);
 	ConvertPositionToBullet(params.constraintPosition[0], objectLocalPositionB);
 
-	m_Constraint = VPhysicsNew(btPoint2PointConstraint, *objectA->GetRigidBody(), *objectB->GetRigidBody(),
-			objectLocalPositionA - (transformA.getBasis() * objectA->GetBulletMassCenter()),
-			objectLocalPositionB - (transformB.getBasis() * objectB->GetBulletMassCenter()));
+	btVector3 pivotInB = objectLocalPositionB - (transformB.getBasis() * objectB->GetBulletMassCenter());
+	if (objectB->IsStatic()) {
+		pivotInB = transformB * pivotInB;
+	}
+
+	m_Constraint = VPhysicsNew(btPoint2PointConstraint, *objectA->GetRigidBody(), GetConstraintRigidBody(objectB),
+			objectLocalPositionA - (transformA.getBasis() * objectA->GetBulletMassCenter()), pivotInB);
 	InitializeBulletConstraint(&params.constraint);
 }
 
@@ -184,11 +194,14 @@ CPhysicsConstraint_Suspension::CPhysicsConstraint_Suspension(
 	frameInA.getBasis().setIdentity();
 	ConvertPositionToBullet(wheelPositionInReference, frameInA.getOrigin());
 	frameInA.getOrigin() -= objectA->GetBulletMassCenter();
+	if (objectA->IsStatic()) {
+		frameInA = objectA->GetCollisionObject()->getWorldTransform() * frameInA;
+	}
 	// Force the body's coordinate system for wheels, so frame in B is identity.
 	// Assume that the wheel is rotated the same as the body when creating.
 
 	m_Constraint = VPhysicsNew(SpringConstraint,
-			*objectA->GetRigidBody(), *objectB->GetRigidBody(),
+			GetConstraintRigidBody(objectA), *objectB->GetRigidBody(),
 			frameInA, btTransform::getIdentity(), RO_YZX /* Naming is in reverse */);
 	InitializeBulletConstraint();
 
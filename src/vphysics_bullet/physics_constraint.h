@@ -46,6 +46,10 @@ public:
 
 	virtual btTypedConstraint *GetBulletConstraint() const = 0;
 
+	// Index in the environment's constraint array for removal without searching, -1 if not there.
+	FORCEINLINE int GetConstraintIndex() const { return m_ConstraintIndex; }
+	FORCEINLINE void SetConstraintIndex(int constraintIndex) { m_ConstraintIndex = constraintIndex; }
+
 	// Safe to call when the constraint is already invalid.
 	FORCEINLINE void NotifyObjectRemoving() {
 		DeleteBulletConstraint();
@@ -60,10 +64,15 @@ protected:
 	IPhysicsObject *m_ObjectReference, *m_ObjectAttached;
 	virtual bool AreObjectsValid() const;
 
+	// Static objects aren't rigid bodies, constraints to them use Bullet's fixed body at the origin instead,
+	// with the frame in that body specified in world space.
+	static btRigidBody &GetConstraintRigidBody(IPhysicsObject *object);
+
 	virtual void DeleteBulletConstraint() = 0; // May be called when the constraint is null.
 
 private:
 	void *m_GameData;
+	int m_ConstraintIndex;
 };
 
 /* DUMMY */ class CPhysicsConstraint_Dummy : public CPhysicsConstraint {
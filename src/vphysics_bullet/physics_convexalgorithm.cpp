@@ -0,0 +1,144 @@
+// Copyright Valve Corporation, All rights reserved.
+// Bullet integration by Triang3l, derivative work, in public domain if detached from Valve's work.
+
+#include "physics_convexalgorithm.h"
+
+// Same as in btDefaultCollisionConfiguration::setConvexConvexMultipointIterations.
+#define CONVEX_MULTIPOINT_ITERATIONS 3
+#define CONVEX_MULTIPOINT_MIN_POINTS 3
+
+CPhysicsConvexConvexAlgorithm::CPhysicsConvexConvexAlgorithm(const btCollisionAlgorithmConstructionInfo &ci,
+		const btCollisionObjectWrapper *body0Wrap, const btCollisionObjectWrapper *body1Wrap,
+		btConvexPenetrationDepthSolver *pdSolver, btScalar multipointMaxAngularSpeed) :
+		btActivatingCollisionAlgorithm(ci, body0Wrap, body1Wrap),
+		m_Manifold(ci.m_manifold), m_OwnManifold(false), // Shared by compound shapes.
+		m_PenetrationDepthSolver(pdSolver), m_MultipointMaxAngularSpeed(multipointMaxAngularSpeed),
+		m_AlgorithmCreated(false), m_AlgorithmMultipoint(false),
+		m_LastContactCount(0) {}
+
+CPhysicsConvexConvexAlgorithm::~CPhysicsConvexConvexAlgorithm() {
+	// Bullet's algorithm doesn't own the manifold, so it doesn't release it.
+	DestroyAlgorithm();
+	if (m_OwnManifold && m_Manifold != nullptr) {
+		m_dispatcher->releaseManifold(m_Manifold);
+	}
+}
+
+void CPhysicsConvexConvexAlgorithm::SetAlgorithmMode(bool multipoint) {
+	if (m_AlgorithmCreated && m_AlgorithmMultipoint == multipoint) {
+		return;
+	}
+	DestroyAlgorithm();
+	Assert(m_Manifold != nullptr);
+	btCollisionAlgorithmConstructionInfo ci(m_dispatcher, 1);
+	ci.m_manifold = m_Manifold;
+	new(m_AlgorithmStorage) btConvexConvexAlgorithm(m_Manifold, ci, nullptr, nullptr, m_PenetrationDepthSolver,
+			multipoint ? CONVEX_MULTIPOINT_ITERATIONS : 0, multipoint ? CONVEX_MULTIPOINT_MIN_POINTS : 0);
+	m_AlgorithmCreated = true;
+	m_AlgorithmMultipoint = multipoint;
+}
+
+void CPhysicsConvexConvexAlgorithm::DestroyAlgorithm() {
+	if (m_AlgorithmCreated) {
+		GetAlgorithm()->~btConvexConvexAlgorithm();
+		m_AlgorithmCreated = false;
+	}
+}
+
+bool CPhysicsConvexConvexAlgorithm::NeedsMultipoint(
+		const btCollisionObjectWrapper *body0Wrap, const btCollisionObjectWrapper *body1Wrap) const {
+	// Only polyhedra can rest on a face - perturbing round shapes gives the same point again.
+	if (!body0Wrap->getCollisionShape()->isPolyhedral() || !body1Wrap->getCollisionShape()->isPolyhedral()) {
+		return false;
+	}
+
+	// Perturbation is only done for manifolds that aren't full, so don't recreate the algorithm for nothing.
+	int contactCount = m_Manifold->getNumContacts();
+	if (contactCount >= CONVEX_MULTIPOINT_MIN_POINTS) {
+		return m_AlgorithmCreated && m_AlgorithmMultipoint;
+	}
+
+	// Points were lost in the last step, for instance, after sliding or tipping over an edge - refill the manifold.
+	if (contactCount < m_LastContactCount) {
+		return true;
+	}
+
+	// Objects rotating relatively to each other don't stay on a face long enough for a full manifold to help,
+	// and they're kept apart by the points added over the steps.
+	btVector3 relativeAngularVelocity(0.0f, 0.0f, 0.0f);
+	const btRigidBody *rigidBody0 = btRigidBody::upcast(body0Wrap->getCollisionObject());
+	if (rigidBody0 != nullptr) {
+		relativeAngularVelocity += rigidBody0->getAngularVelocity();
+	}
+	const btRigidBody *rigidBody1 = btRigidBody::upcast(body1Wrap->getCollisionObject());
+	if (rigidBody1 != nullptr) {
+		relativeAngularVelocity -= rigidBody1->getAngularVelocity();
+	}
+	return relativeAngularVelocity.length2() < m_MultipointMaxAngularSpeed * m_MultipointMaxAngularSpeed;
+}
+
+void CPhysicsConvexConvexAlgorithm::processCollision(
+		const btCollisionObjectWrapper *body0Wrap, const btCollisionObjectWrapper *body1Wrap,
+		const btDispatcherInfo &dispatchInfo, btManifoldResult *resultOut) {
+	if (m_Manifold == nullptr) {
+		m_Manifold = m_dispatcher->getNewManifold(body0Wrap->getCollisionObject(), body1Wrap->getCollisionObject());
+		m_OwnManifold = true;
+	}
+
+	SetAlgorithmMode(NeedsMultipoint(body0Wrap, body1Wrap));
+	m_LastContactCount = m_Manifold->getNumContacts();
+	{
+		// A pair is processed by one thread at a time, so the warm start can be stored here.
+		CPhysConvex_Hull::SupportWarmStartScope warmStartScope(m_SupportWarmStart,
+				body0Wrap->getCollisionShape(), body1Wrap->getCollisionShape());
+		GetAlgorithm()->processCollision(body0Wrap, body1Wrap, dispatchInfo, resultOut);
+	}
+
+	// Bullet's algorithm only does this for its own manifold, compound shapes refresh the shared one themselves.
+	if (m_OwnManifold) {
+		resultOut->refreshContactPoints();
+	}
+}
+
+btScalar CPhysicsConvexConvexAlgorithm::calculateTimeOfImpact(btCollisionObject *body0, btCollisionObject *body1,
+		const btDispatcherInfo &dispatchInfo, btManifoldResult *resultOut) {
+	// Doesn't depend on the contact generation mode.
+	if (!m_AlgorithmCreated) {
+		// Only called with continuous dispatch, after processCollision.
+		return btScalar(1.0f);
+	}
+	return GetAlgorithm()->calculateTimeOfImpact(body0, body1, dispatchInfo, resultOut);
+}
+
+void CPhysicsConvexConvexAlgorithm::getAllContactManifolds(btManifoldArray &manifoldArray) {
+	if (m_OwnManifold && m_Manifold != nullptr) {
+		manifoldArray.push_back(m_Manifold);
+	}
+}
+
+/******************
+ * Create function
+ ******************/
+
+void CPhysicsConvexConvexAlgorithm::CreateFunc::Register(
+		btCollisionDispatcher *dispatcher, btCollisionConfiguration *configuration) {
+	btCollisionAlgorithmCreateFunc *convexConvexCreateFunc = configuration->getCollisionAlgorithmCreateFunc(
+			CONVEX_HULL_SHAPE_PROXYTYPE, CONVEX_HULL_SHAPE_PROXYTYPE);
+	for (int proxyType0 = 0; proxyType0 < CONCAVE_SHAPES_START_HERE; ++proxyType0) {
+		for (int proxyType1 = 0; proxyType1 < CONCAVE_SHAPES_START_HERE; ++proxyType1) {
+			// Keeping the specialized algorithms, such as sphere-sphere and box-box.
+			if (configuration->getCollisionAlgorithmCreateFunc(proxyType0, proxyType1) == convexConvexCreateFunc) {
+				dispatcher->registerCollisionCreateFunc(proxyType0, proxyType1, this);
+			}
+		}
+	}
+}
+
+btCollisionAlgorithm *CPhysicsConvexConvexAlgorithm::CreateFunc::CreateCollisionAlgorithm(
+		btCollisionAlgorithmConstructionInfo &ci,
+		const btCollisionObjectWrapper *body0Wrap, const btCollisionObjectWrapper *body1Wrap) {
+	// The pool element size is raised for this algorithm by the environment.
+	void *memblock = ci.m_dispatcher1->allocateCollisionAlgorithm(sizeof(CPhysicsConvexConvexAlgorithm));
+	return new(memblock) CPhysicsConvexConvexAlgorithm(ci, body0Wrap, body1Wrap,
+			&m_PenetrationDepthSolver, m_MultipointMaxAngularSpeed);
+}
@@ -0,0 +1,64 @@
+// Copyright Valve Corporation, All rights reserved.
+// Bullet integration by Triang3l, derivative work, in public domain if detached from Valve's work.
+
+#ifndef PHYSICS_CONVEXALGORITHM_H
+#define PHYSICS_CONVEXALGORITHM_H
+
+#include "physics_internal.h"
+#include "physics_collide.h"
+#include <BulletCollision/CollisionDispatch/btActivatingCollisionAlgorithm.h>
+#include <BulletCollision/CollisionDispatch/btConvexConvexAlgorithm.h>
+#include <BulletCollision/NarrowPhaseCollision/btGjkEpaPenetrationDepthSolver.h>
+
+// Convex-convex collision with multipoint (perturbed) contact generation enabled per pair only when needed.
+// Perturbation fills the manifold of polyhedra resting on a face in one step rather than over several,
+// but for every pair with less than 3 points it runs GJK several more times, which is a huge narrowphase cost
+// for objects touching by an edge or a vertex, or rotating quickly, where persistence alone works fine.
+// Bullet's algorithm is kept inside this one, in the same block of the dispatcher's pool, and is recreated
+// in place when the mode changes - the manifold is shared, so switching loses no points.
+class CPhysicsConvexConvexAlgorithm : public btActivatingCollisionAlgorithm {
+public:
+	CPhysicsConvexConvexAlgorithm(const btCollisionAlgorithmConstructionInfo &ci,
+			const btCollisionObjectWrapper *body0Wrap, const btCollisionObjectWrapper *body1Wrap,
+			btConvexPenetrationDepthSolver *pdSolver, btScalar multipointMaxAngularSpeed);
+	virtual ~CPhysicsConvexConvexAlgorithm();
+
+	virtual void processCollision(const btCollisionObjectWrapper *body0Wrap, const btCollisionObjectWrapper *body1Wrap,
+			const btDispatcherInfo &dispatchInfo, btManifoldResult *resultOut);
+	virtual btScalar calculateTimeOfImpact(btCollisionObject *body0, btCollisionObject *body1,
+			const btDispatcherInfo &dispatchInfo, btManifoldResult *resultOut);
+	virtual void getAllContactManifolds(btManifoldArray &manifoldArray);
+
+	struct CreateFunc : public btCollisionAlgorithmCreateFunc {
+		CreateFunc() : m_MultipointMaxAngularSpeed(0.0f) {}
+		// Registers itself for the shape pairs Bullet's convex-convex algorithm is used for.
+		void Register(btCollisionDispatcher *dispatcher, btCollisionConfiguration *configuration);
+		virtual btCollisionAlgorithm *CreateCollisionAlgorithm(btCollisionAlgorithmConstructionInfo &ci,
+				const btCollisionObjectWrapper *body0Wrap, const btCollisionObjectWrapper *body1Wrap);
+
+		btGjkEpaPenetrationDepthSolver m_PenetrationDepthSolver;
+		// Relative angular speed below which perturbation is used for polyhedra, radians per second.
+		btScalar m_MultipointMaxAngularSpeed;
+	};
+
+private:
+	btPersistentManifold *m_Manifold;
+	bool m_OwnManifold;
+	btConvexPenetrationDepthSolver *m_PenetrationDepthSolver;
+	btScalar m_MultipointMaxAngularSpeed;
+
+	// Bullet's algorithm only keeps the settings and scratch arrays between steps, so it can be recreated freely.
+	ATTRIBUTE_ALIGNED16(char m_AlgorithmStorage[sizeof(btConvexConvexAlgorithm)]);
+	bool m_AlgorithmCreated, m_AlgorithmMultipoint;
+	FORCEINLINE btConvexConvexAlgorithm *GetAlgorithm() {
+		return reinterpret_cast<btConvexConvexAlgorithm *>(m_AlgorithmStorage);
+	}
+	void SetAlgorithmMode(bool multipoint);
+	void DestroyAlgorithm();
+
+	int m_LastContactCount;
+	CPhysConvex_Hull::SupportWarmStart_t m_SupportWarmStart;
+	bool NeedsMultipoint(const btCollisionObjectWrapper *body0Wrap, const btCollisionObjectWrapper *body1Wrap) const;
+};
+
+#endif
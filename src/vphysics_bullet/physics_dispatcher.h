@@ -0,0 +1,72 @@
+// Copyright Valve Corporation, All rights reserved.
+// Bullet integration by Triang3l, derivative work, in public domain if detached from Valve's work.
+
+#ifndef PHYSICS_DISPATCHER_H
+#define PHYSICS_DISPATCHER_H
+
+#include "physics_internal.h"
+#include "physics_object.h"
+#include "tier0/threadtools.h"
+
+// Collision dispatcher keeping the manifold lists of the objects in sync with the manifolds that exist,
+// so queries about the contacts of one object don't have to go through all manifolds in the world.
+// BaseDispatcher is either btCollisionDispatcher or btCollisionDispatcherMt - the latter creates and releases manifolds
+// from worker threads during narrowphase, so list updates are locked in this case.
+template<class BaseDispatcher>
+class CPhysicsCollisionDispatcher : public BaseDispatcher {
+public:
+	CPhysicsCollisionDispatcher(btCollisionConfiguration *collisionConfiguration, bool multithreaded) :
+			BaseDispatcher(collisionConfiguration), m_Multithreaded(multithreaded) {}
+
+	virtual btPersistentManifold *getNewManifold(const btCollisionObject *body0, const btCollisionObject *body1) {
+		btPersistentManifold *manifold = BaseDispatcher::getNewManifold(body0, body1);
+		if (m_Multithreaded) {
+			m_ManifoldListMutex.Lock();
+		}
+		UpdateObjectManifoldList(body0, manifold, true);
+		UpdateObjectManifoldList(body1, manifold, true);
+		if (m_Multithreaded) {
+			m_ManifoldListMutex.Unlock();
+		}
+		return manifold;
+	}
+
+	// Triggers are handled by the environment using broadphase pairs, they don't need contact points.
+	virtual bool needsCollision(const btCollisionObject *body0, const btCollisionObject *body1) {
+		if (!body0->hasContactResponse() || !body1->hasContactResponse()) {
+			return false;
+		}
+		return BaseDispatcher::needsCollision(body0, body1);
+	}
+
+	// Compound algorithms destroy the algorithms of their children, releasing their manifolds, during narrowphase.
+	virtual void releaseManifold(btPersistentManifold *manifold) {
+		if (m_Multithreaded) {
+			m_ManifoldListMutex.Lock();
+		}
+		UpdateObjectManifoldList(manifold->getBody0(), manifold, false);
+		UpdateObjectManifoldList(manifold->getBody1(), manifold, false);
+		if (m_Multithreaded) {
+			m_ManifoldListMutex.Unlock();
+		}
+		BaseDispatcher::releaseManifold(manifold);
+	}
+
+private:
+	bool m_Multithreaded;
+	CThreadFastMutex m_ManifoldListMutex;
+
+	static void UpdateObjectManifoldList(const btCollisionObject *body, btPersistentManifold *manifold, bool add) {
+		CPhysicsObject *object = reinterpret_cast<CPhysicsObject *>(body->getUserPointer());
+		if (object == nullptr) {
+			return;
+		}
+		if (add) {
+			object->AddContactManifold(manifold);
+		} else {
+			object->RemoveContactManifold(manifold);
+		}
+	}
+};
+
+#endif
@@ -4,23 +4,76 @@
 #include "physics_environment.h"
 #include "physics_collide.h"
 #include "physics_constraint.h"
+#include "physics_convexalgorithm.h"
+#include "physics_dispatcher.h"
 #include "physics_fluid.h"
 #include "physics_friction.h"
 #include "physics_motioncontroller.h"
 #include "physics_object.h"
 #include "physics_shadow.h"
 #include "physics_spring.h"
+#include "physics_taskscheduler.h"
 #include "physics_vehicle.h"
-#include "vphysics/stats.h"
+#include "physics_world.h"
 #include "const.h"
+#include "worldsize.h"
 #include "tier1/convar.h"
 
+#if BT_THREADSAFE
+#include <BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+#include <BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+#endif
+
+// Space around the static objects of the map in the sweep and prune bounds, in inches.
+#define AXIS_SWEEP_WORLD_MARGIN 1024.0f
+
+// Read when an environment is created. Bullet only parallelizes narrowphase, island solving and integration -
+// broadphase pair filtering, tick callbacks and actions still run on the thread calling Simulate,
+// so ShouldCollide, trigger and sleep events are never called from worker threads.
+static ConVar physics_bullet_threads("physics_bullet_threads", "0", FCVAR_NONE,
+		"Number of threads to simulate newly created physics environments on, 0 or 1 to use only the calling thread.",
+		true, 0.0f, true, (float) BT_MAX_THREAD_COUNT);
+
+// Read when an environment is created. Compare the broadphase time in physics_bullet_stats on a map to choose.
+// Sweep and prune is often cheaper for bounded maps with many small slow props, but its cost grows with the
+// number of objects moving along each axis, while the trees handle many fast objects and object churn better.
+static ConVar physics_bullet_broadphase("physics_bullet_broadphase", "0", FCVAR_NONE,
+		"Broadphase of newly created physics environments: 0 - dynamic AABB trees, "
+		"1 - sweep and prune over the world bounds.",
+		true, 0.0f, true, (float) (CPhysicsEnvironment::BROADPHASE_COUNT - 1));
+static ConVar physics_bullet_axis_sweep_max_objects("physics_bullet_axis_sweep_max_objects", "16384", FCVAR_NONE,
+		"Number of objects the sweep and prune broadphase of newly created physics environments preallocates.",
+		true, 16.0f, true, 1048576.0f);
+// Bullet re-inserts one leaf plus this percentage every step, from the least recently updated one.
+static ConVar physics_bullet_dbvt_dynamic_optimize("physics_bullet_dbvt_dynamic_optimize", "1", FCVAR_NONE,
+		"Percentage of the moving object AABB tree rebalanced every step in newly created physics environments.",
+		true, 0.0f, true, 100.0f);
+static ConVar physics_bullet_dbvt_static_optimize("physics_bullet_dbvt_static_optimize", "1", FCVAR_NONE,
+		"Percentage of the static object AABB tree rebalanced every step in newly created physics environments.",
+		true, 0.0f, true, 100.0f);
+
+// Read when an environment is created. Faster objects get single-point contacts with persistence only.
+static ConVar physics_bullet_multipoint_max_angular_speed("physics_bullet_multipoint_max_angular_speed", "30",
+		FCVAR_NONE, "Relative angular speed in degrees per second below which contacts of polyhedra are generated "
+		"at multiple points at once in newly created physics environments.",
+		true, 0.0f, false, 0.0f);
+
+// Thresholds are per kilogram of the object receiving the energy, so light debris doesn't flood the game with
+// events, while heavy objects still report slow impacts. An event is sent if any object exceeds the threshold.
+static ConVar physics_bullet_impact_min_energy("physics_bullet_impact_min_energy", "0.05", FCVAR_NONE,
+		"Minimum kinetic energy per kilogram an impact must transfer to an object to be reported to the game.",
+		true, 0.0f, false, 0.0f);
+static ConVar physics_bullet_friction_min_energy("physics_bullet_friction_min_energy", "0.01", FCVAR_NONE,
+		"Minimum energy per kilogram friction must dissipate in a tick for a scrape to be reported to the game.",
+		true, 0.0f, false, 0.0f);
+
 #ifdef WIN32
 #pragma warning(push)
 #pragma warning(disable : 4355) // 'this' : used in base member initializer list
 #endif
 
 CPhysicsEnvironment::CPhysicsEnvironment() :
+		m_AxisSweepMaxProxies(0), m_AxisSweepFullReported(false), m_AxisSweepFitted(false),
 		m_Gravity(0.0f, 0.0f, 0.0f),
 		m_AirDensity(2.0f),
 		m_ObjectEvents(nullptr),
@@ -29,20 +82,65 @@ CPhysicsEnvironment::CPhysicsEnvironment() :
 		m_SimulationInvTimeStep(1.0f / btScalar(DEFAULT_TICK_INTERVAL)),
 		m_InSimulation(false),
 		m_LastPSITime(0.0f), m_TimeSinceLastPSI(0.0f),
-		m_CollisionSolver(nullptr), m_OverlapFilterCallback(this),
+		m_CollisionSolver(nullptr), m_PSICollisionCheckCount(0),
+		m_OverlapFilterCallback(this),
 		m_CollisionEvents(nullptr),
+		m_DeliveringCollisionEvents(false),
 		m_HighestActiveFrictionSnapshot(-1),
-		m_QuickDelete(false) {
+		m_BroadphasePairCallback(this),
+		m_QuickDelete(false),
+		m_StatsPSICount(0),
+		m_StatsRequested(false) {
 	m_PerformanceSettings.Defaults();
 
-	m_CollisionConfiguration = VPhysicsNew(btDefaultCollisionConfiguration);
-	// TODO: Do this per-overlap for small or fast-moving objects, has a huge post-load performance hit.
-	m_CollisionConfiguration->setConvexConvexMultipointIterations();
-	m_Dispatcher = VPhysicsNew(btCollisionDispatcher, m_CollisionConfiguration);
-	m_Broadphase = VPhysicsNew(btDbvtBroadphase);
-	m_Solver = VPhysicsNew(btSequentialImpulseConstraintSolver);
-	m_DynamicsWorld = VPhysicsNew(btDiscreteDynamicsWorld, m_Dispatcher, m_Broadphase, m_Solver, m_CollisionConfiguration);
+	btDefaultCollisionConstructionInfo collisionConstructionInfo;
+	// Convex pairs keep Bullet's algorithm inside their own, in one block of the pool.
+	collisionConstructionInfo.m_customCollisionAlgorithmMaxElementSize = sizeof(CPhysicsConvexConvexAlgorithm);
+	m_CollisionConfiguration = VPhysicsNew(btDefaultCollisionConfiguration, collisionConstructionInfo);
+	m_BroadphaseType = (Broadphase_t) physics_bullet_broadphase.GetInt();
+	if (m_BroadphaseType == BROADPHASE_AXIS_SWEEP) {
+		// Fitted to the map when its static objects are added. Objects outside the bounds are still collided,
+		// just less efficiently. The ray cast accelerator (a tree mirroring the proxies) keeps world traces
+		// from testing every object.
+		btScalar worldExtent = HL2BULLET(MAX_COORD_INTEGER);
+		int axisSweepMaxHandles = physics_bullet_axis_sweep_max_objects.GetInt();
+		m_Broadphase = VPhysicsNew(bt32BitAxisSweep3,
+				btVector3(-worldExtent, -worldExtent, -worldExtent), btVector3(worldExtent, worldExtent, worldExtent),
+				(unsigned int) axisSweepMaxHandles);
+		// Handle 0 is the sentinel.
+		m_AxisSweepMaxProxies = axisSweepMaxHandles - 1;
+	} else {
+		m_BroadphaseType = BROADPHASE_DBVT;
+		btDbvtBroadphase *dbvtBroadphase = VPhysicsNew(btDbvtBroadphase);
+		dbvtBroadphase->m_dupdates = physics_bullet_dbvt_dynamic_optimize.GetInt();
+		dbvtBroadphase->m_fupdates = physics_bullet_dbvt_static_optimize.GetInt();
+		m_Broadphase = dbvtBroadphase;
+	}
+	int threadCount = VPhysicsSetupTaskScheduler(physics_bullet_threads.GetInt());
+	m_Multithreaded = (threadCount > 1);
+#if BT_THREADSAFE
+	if (m_Multithreaded) {
+		m_Dispatcher = VPhysicsNew(CPhysicsCollisionDispatcher<btCollisionDispatcherMt>, m_CollisionConfiguration, true);
+		btConstraintSolverPoolMt *solverPool = VPhysicsNew(btConstraintSolverPoolMt, threadCount);
+		m_Solver = solverPool;
+		m_DynamicsWorld = VPhysicsNew(CPhysicsDynamicsWorld<btDiscreteDynamicsWorldMt>, this,
+				m_Dispatcher, m_Broadphase, solverPool, nullptr, m_CollisionConfiguration);
+	} else
+#endif
+	{
+		m_Dispatcher = VPhysicsNew(CPhysicsCollisionDispatcher<btCollisionDispatcher>, m_CollisionConfiguration, false);
+		m_Solver = VPhysicsNew(btSequentialImpulseConstraintSolver);
+		m_DynamicsWorld = VPhysicsNew(CPhysicsDynamicsWorld<btDiscreteDynamicsWorld>, this,
+				m_Dispatcher, m_Broadphase, m_Solver, m_CollisionConfiguration);
+	}
 	m_DynamicsWorld->setWorldUserInfo(this);
+	// Updating the AABBs of static objects would move them back to the dynamic set of the broadphase tree.
+	// Objects not simulated are updated explicitly when teleported.
+	m_DynamicsWorld->setForceUpdateAllAabbs(false);
+
+	// Multipoint contact generation only for pairs that need it, not globally - it has a huge post-load cost.
+	m_ConvexConvexCreateFunc.m_MultipointMaxAngularSpeed = DEG2RAD(physics_bullet_multipoint_max_angular_speed.GetFloat());
+	m_ConvexConvexCreateFunc.Register(m_Dispatcher, m_CollisionConfiguration);
 
 	m_DynamicsWorld->setDebugDrawer(&m_DebugDrawer);
 
@@ -50,8 +148,11 @@ CPhysicsEnvironment::CPhysicsEnvironment() :
 	m_DynamicsWorld->setGravity(btVector3(0.0f, 0.0f, 0.0f));
 
 	m_Broadphase->getOverlappingPairCache()->setOverlapFilterCallback(&m_OverlapFilterCallback);
+	m_Broadphase->getOverlappingPairCache()->setInternalGhostPairCallback(&m_BroadphasePairCallback);
 
 	m_DynamicsWorld->getDispatchInfo().m_allowedCcdPenetration = VPHYSICS_CONVEX_DISTANCE_MARGIN;
+	// Hulls with polyhedral features are clipped along the GJK normal - SAT would test every pair of edges.
+	m_DynamicsWorld->getDispatchInfo().m_enableSatConvex = false;
 	btContactSolverInfo &solverInfo = m_DynamicsWorld->getSolverInfo();
 	// Performance.
 	solverInfo.m_numIterations = 4;
@@ -59,11 +160,11 @@ CPhysicsEnvironment::CPhysicsEnvironment() :
 	solverInfo.m_splitImpulse = false;
 	solverInfo.m_solverMode |= SOLVER_RANDMIZE_ORDER | SOLVER_USE_2_FRICTION_DIRECTIONS;
 
-	m_TriggerTouches.SetLessFunc(TriggerTouchLessFunc);
-
 	m_DynamicsWorld->setInternalTickCallback(PreTickCallback, this, true);
 	m_DynamicsWorld->setInternalTickCallback(TickCallback, this, false);
 	m_DynamicsWorld->addAction(&m_TickAction);
+
+	ClearStats();
 }
 
 #ifdef WIN32
@@ -76,14 +177,42 @@ CPhysicsEnvironment::~CPhysicsEnvironment() {
 		VPhysicsDelete(CPhysicsFrictionSnapshot, m_FrictionSnapshots[snapshotIndex]);
 	}
 
-	VPhysicsDelete(btDiscreteDynamicsWorld, m_DynamicsWorld);
-	VPhysicsDelete(btSequentialImpulseConstraintSolver, m_Solver);
-	VPhysicsDelete(btDbvtBroadphase, m_Broadphase);
-	VPhysicsDelete(btCollisionDispatcher, m_Dispatcher);
+	DeleteWorld();
+}
+
+void CPhysicsEnvironment::DeleteWorld() {
+#if BT_THREADSAFE
+	if (m_Multithreaded) {
+		VPhysicsDelete(CPhysicsDynamicsWorld<btDiscreteDynamicsWorldMt>, m_DynamicsWorld);
+		VPhysicsDelete(btConstraintSolverPoolMt, m_Solver);
+		VPhysicsDelete(CPhysicsCollisionDispatcher<btCollisionDispatcherMt>, m_Dispatcher);
+	} else
+#endif
+	{
+		VPhysicsDelete(CPhysicsDynamicsWorld<btDiscreteDynamicsWorld>, m_DynamicsWorld);
+		VPhysicsDelete(btSequentialImpulseConstraintSolver, m_Solver);
+		VPhysicsDelete(CPhysicsCollisionDispatcher<btCollisionDispatcher>, m_Dispatcher);
+	}
+	if (m_BroadphaseType == BROADPHASE_AXIS_SWEEP) {
+		VPhysicsDelete(bt32BitAxisSweep3, m_Broadphase);
+	} else {
+		VPhysicsDelete(btDbvtBroadphase, m_Broadphase);
+	}
 	VPhysicsDelete(btDefaultCollisionConfiguration, m_CollisionConfiguration);
+	m_DynamicsWorld = nullptr;
+	m_Solver = nullptr;
+	m_Dispatcher = nullptr;
+	m_Broadphase = nullptr;
+	m_CollisionConfiguration = nullptr;
 }
 
 void CPhysicsEnvironment::Release() {
+	if (m_QuickDelete) {
+		ReleaseWorldQuick();
+		VPhysicsDelete(CPhysicsEnvironment, this);
+		return;
+	}
+
 	CleanupDeleteList();
 
 	int constraintCount = m_ConstraintObjects.Count();
@@ -91,6 +220,9 @@ void CPhysicsEnvironment::Release() {
 		DeleteConstraint(m_ConstraintObjects[constraintIndex], false);
 	}
 
+	// Not in the world, so there's nothing to remove them from.
+	m_PendingStaticObjects.RemoveAll();
+
 	int objectCount = m_Objects.Count();
 	for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex) {
 		CPhysicsObject *object = static_cast<CPhysicsObject *>(m_Objects[objectIndex]);
@@ -101,6 +233,80 @@ void CPhysicsEnvironment::Release() {
 	VPhysicsDelete(CPhysicsEnvironment, this);
 }
 
+void CPhysicsEnvironment::ReleaseWorldQuick() {
+	// Vehicles destroy their wheels and suspension constraints through the environment,
+	// do it while the world still exists. Going backwards because wheels are removed from the list,
+	// objects moved from the end are notified again, which does nothing.
+	for (int objectIndex = m_Objects.Count() - 1; objectIndex >= 0; --objectIndex) {
+		if (objectIndex < m_Objects.Count()) {
+			static_cast<CPhysicsObject *>(m_Objects[objectIndex])->NotifyQueuedForRemoval();
+		}
+	}
+	CleanupDeleteList();
+
+	// The world doesn't need the constraints removed from it, but the bodies reference them.
+	int constraintCount = m_ConstraintObjects.Count();
+	for (int constraintIndex = 0; constraintIndex < constraintCount; ++constraintIndex) {
+		CPhysicsConstraint *constraint = static_cast<CPhysicsConstraint *>(m_ConstraintObjects[constraintIndex]);
+		btTypedConstraint *bulletConstraint = constraint->GetBulletConstraint();
+		if (bulletConstraint != nullptr) {
+			bulletConstraint->getRigidBodyA().removeConstraintRef(bulletConstraint);
+			bulletConstraint->getRigidBodyB().removeConstraintRef(bulletConstraint);
+		}
+		constraint->Release();
+	}
+	m_ConstraintObjects.RemoveAll();
+
+	// Free the collision algorithms and the manifolds in one pass over the pairs, rather than
+	// going through all pairs for every object, as btCollisionWorld does when removing objects.
+	btOverlappingPairCache *pairCache = m_Broadphase->getOverlappingPairCache();
+	btBroadphasePairArray &pairs = pairCache->getOverlappingPairArray();
+	int pairCount = pairs.size();
+	for (int pairIndex = 0; pairIndex < pairCount; ++pairIndex) {
+		pairCache->cleanOverlappingPair(pairs[pairIndex], m_Dispatcher);
+	}
+
+	// Detach the proxies so the world destructor doesn't clean them up one by one.
+	// btDbvtBroadphase allocates proxies with btAlignedAlloc and doesn't free them when destroyed.
+	// Sweep and prune handles are owned by the broadphase, but each has a proxy in the ray cast accelerator,
+	// which is a btDbvtBroadphase too, so those are freed instead.
+	const btCollisionObjectArray &collisionObjects = m_DynamicsWorld->getCollisionObjectArray();
+	int collisionObjectCount = collisionObjects.size();
+	btAlignedObjectArray<btBroadphaseProxy *> proxies;
+	proxies.reserve(collisionObjectCount);
+	for (int collisionObjectIndex = 0; collisionObjectIndex < collisionObjectCount; ++collisionObjectIndex) {
+		btCollisionObject *collisionObject = collisionObjects[collisionObjectIndex];
+		btBroadphaseProxy *proxy = collisionObject->getBroadphaseHandle();
+		if (proxy == nullptr) {
+			continue;
+		}
+		if (m_BroadphaseType == BROADPHASE_AXIS_SWEEP) {
+			proxy = static_cast<bt32BitAxisSweep3::Handle *>(proxy)->m_dbvtProxy;
+		}
+		if (proxy != nullptr) {
+			proxies.push_back(proxy);
+		}
+		collisionObject->setBroadphaseHandle(nullptr);
+	}
+
+	DeleteWorld();
+
+	int proxyCount = proxies.size();
+	for (int proxyIndex = 0; proxyIndex < proxyCount; ++proxyIndex) {
+		btAlignedFree(proxies[proxyIndex]);
+	}
+
+	// Pending static objects aren't in the world, so they're freed along with the rest.
+	int objectCount = m_Objects.Count();
+	for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex) {
+		static_cast<CPhysicsObject *>(m_Objects[objectIndex])->ReleaseWithWorld();
+	}
+	m_Objects.RemoveAll();
+	m_PendingStaticObjects.RemoveAll();
+	m_NonStaticObjects.RemoveAll();
+	m_ActiveNonStaticObjects.RemoveAll();
+}
+
 /****************
  * Debug overlay
  ****************/
@@ -166,16 +372,47 @@ IVPhysicsDebugOverlay *CPhysicsEnvironment::GetDebugOverlay() {
 
 void CPhysicsEnvironment::AddObject(IPhysicsObject *object) {
 	CPhysicsObject *physicsObject = static_cast<CPhysicsObject *>(object);
-	m_DynamicsWorld->addRigidBody(physicsObject->GetRigidBody());
-	m_Objects.AddToTail(object);
+	btCollisionObject *collisionObject = physicsObject->GetCollisionObject();
+	if (object->IsStatic() && !IsInSimulation() && !m_DeliveringCollisionEvents) {
+		m_PendingStaticObjects.AddToTail(physicsObject);
+	} else {
+		AddCollisionObjectToWorld(physicsObject);
+		if (object->IsStatic() && collisionObject->getBroadphaseHandle() != nullptr) {
+			MoveToFixedSet(collisionObject->getBroadphaseHandle());
+		}
+	}
+	physicsObject->SetObjectIndex(m_Objects.AddToTail(object));
 	if (!object->IsStatic()) {
-		m_NonStaticObjects.AddToTail(object);
-		if (!physicsObject->WasAsleep()) {
-			m_ActiveNonStaticObjects.AddToTail(object);
+		physicsObject->SetNonStaticIndex(m_NonStaticObjects.AddToTail(object));
+		if (!object->IsAsleep()) {
+			NotifyObjectActive(physicsObject);
 		}
 	}
 }
 
+void CPhysicsEnvironment::AddCollisionObjectToWorld(CPhysicsObject *object) {
+	// Every collision object in the world has a proxy.
+	if (m_BroadphaseType == BROADPHASE_AXIS_SWEEP &&
+			m_DynamicsWorld->getNumCollisionObjects() >= m_AxisSweepMaxProxies) {
+		// Bullet asserts in debug builds and corrupts the handles in release ones.
+		// The object is left without collisions, which code using the broadphase handle accounts for.
+		if (!m_AxisSweepFullReported) {
+			Warning("The sweep and prune broadphase is full (%d objects), objects beyond that won't collide. "
+					"Increase physics_bullet_axis_sweep_max_objects or use physics_bullet_broadphase 0.\n",
+					m_AxisSweepMaxProxies);
+			m_AxisSweepFullReported = true;
+		}
+		return;
+	}
+	if (object->IsStatic()) {
+		m_DynamicsWorld->addCollisionObject(object->GetCollisionObject(),
+				object->GetCollisionFilterGroup(), object->GetCollisionFilterMask());
+	} else {
+		m_DynamicsWorld->addRigidBody(object->GetRigidBody(),
+				object->GetCollisionFilterGroup(), object->GetCollisionFilterMask());
+	}
+}
+
 IPhysicsObject *CPhysicsEnvironment::CreatePolyObject(
 		const CPhysCollide *pCollisionModel, int materialIndex,
 		const Vector &position, const QAngle &angles, objectparams_t *pParams) {
@@ -207,26 +444,234 @@ void CPhysicsEnvironment::SetObjectEventHandler(IPhysicsObjectEvent *pObjectEven
 	m_ObjectEvents = pObjectEvents;
 }
 
+void CPhysicsEnvironment::NotifyObjectActive(CPhysicsObject *object) {
+	if (object->GetActiveIndex() >= 0) {
+		return;
+	}
+	object->SetActiveIndex(m_ActiveNonStaticObjects.AddToTail(object));
+}
+
+void CPhysicsEnvironment::RemoveActiveObject(CPhysicsObject *object) {
+	int activeIndex = object->GetActiveIndex();
+	if (activeIndex < 0) {
+		return;
+	}
+	object->ClearPrePSIVelocity();
+	m_ActiveNonStaticObjects.FastRemove(activeIndex);
+	if (activeIndex < m_ActiveNonStaticObjects.Count()) {
+		static_cast<CPhysicsObject *>(m_ActiveNonStaticObjects[activeIndex])->SetActiveIndex(activeIndex);
+	}
+	object->SetActiveIndex(-1);
+}
+
+void CPhysicsEnvironment::AddPendingStaticObjects() {
+	int objectCount = m_PendingStaticObjects.Count();
+	if (objectCount == 0) {
+		return;
+	}
+
+	btDbvtBroadphase *dbvtBroadphase = GetDbvtBroadphase();
+	if (dbvtBroadphase == nullptr) {
+		if (!m_AxisSweepFitted) {
+			FitAxisSweepToPendingStaticObjects();
+		}
+		// Sweep and prune finds the pairs while inserting anyway.
+		for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex) {
+			AddCollisionObjectToWorld(m_PendingStaticObjects[objectIndex]);
+		}
+		m_PendingStaticObjects.RemoveAll();
+		return;
+	}
+
+	// Only insert the leaves, pairs are found after the tree is built.
+	bool deferredCollide = dbvtBroadphase->m_deferedcollide;
+	dbvtBroadphase->m_deferedcollide = true;
+	for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex) {
+		AddCollisionObjectToWorld(m_PendingStaticObjects[objectIndex]);
+	}
+	dbvtBroadphase->m_deferedcollide = deferredCollide;
+
+	// Move the proxies to the fixed set directly, and build it top-down once.
+	for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex) {
+		btBroadphaseProxy *proxy = m_PendingStaticObjects[objectIndex]->GetCollisionObject()->getBroadphaseHandle();
+		if (proxy != nullptr) {
+			MoveToFixedSet(proxy);
+		}
+	}
+	btDbvt &dynamicSet = dbvtBroadphase->m_sets[btDbvtBroadphase::DYNAMIC_SET];
+	btDbvt &fixedSet = dbvtBroadphase->m_sets[btDbvtBroadphase::FIXED_SET];
+	fixedSet.optimizeTopDown();
+
+	struct PairCollider : public btDbvt::ICollide {
+		btOverlappingPairCache *m_PairCache;
+		btDbvtProxy *m_Proxy;
+		virtual void Process(const btDbvtNode *leaf) {
+			btDbvtProxy *otherProxy = reinterpret_cast<btDbvtProxy *>(leaf->data);
+			if (otherProxy != m_Proxy) {
+				// Filtered by the pair cache.
+				m_PairCache->addOverlappingPair(m_Proxy, otherProxy);
+			}
+		}
+	};
+	PairCollider collider;
+	collider.m_PairCache = dbvtBroadphase->getOverlappingPairCache();
+	for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex) {
+		collider.m_Proxy = static_cast<btDbvtProxy *>(
+				m_PendingStaticObjects[objectIndex]->GetCollisionObject()->getBroadphaseHandle());
+		if (collider.m_Proxy == nullptr) {
+			continue;
+		}
+		const btDbvtVolume &volume = collider.m_Proxy->leaf->volume;
+		dynamicSet.collideTV(dynamicSet.m_root, volume, collider);
+		fixedSet.collideTV(fixedSet.m_root, volume, collider);
+	}
+
+	m_PendingStaticObjects.RemoveAll();
+}
+
+void CPhysicsEnvironment::FitAxisSweepToPendingStaticObjects() {
+	m_AxisSweepFitted = true;
+
+	// The world model and the static props, normally all created before the first simulation.
+	btVector3 worldMin(BT_LARGE_FLOAT, BT_LARGE_FLOAT, BT_LARGE_FLOAT);
+	btVector3 worldMax(-BT_LARGE_FLOAT, -BT_LARGE_FLOAT, -BT_LARGE_FLOAT);
+	int pendingCount = m_PendingStaticObjects.Count();
+	for (int objectIndex = 0; objectIndex < pendingCount; ++objectIndex) {
+		const btCollisionObject *collisionObject = m_PendingStaticObjects[objectIndex]->GetCollisionObject();
+		btVector3 aabbMin, aabbMax;
+		collisionObject->getCollisionShape()->getAabb(collisionObject->getWorldTransform(), aabbMin, aabbMax);
+		worldMin.setMin(aabbMin);
+		worldMax.setMax(aabbMax);
+	}
+	// Room for objects that are slightly outside the map, such as ones falling out of it.
+	btScalar margin = HL2BULLET(AXIS_SWEEP_WORLD_MARGIN);
+	btScalar maxExtent = HL2BULLET(MAX_COORD_INTEGER);
+	worldMin -= btVector3(margin, margin, margin);
+	worldMin.setMax(btVector3(-maxExtent, -maxExtent, -maxExtent));
+	worldMax += btVector3(margin, margin, margin);
+	worldMax.setMin(btVector3(maxExtent, maxExtent, maxExtent));
+	if (worldMin.getX() >= worldMax.getX() || worldMin.getY() >= worldMax.getY() ||
+			worldMin.getZ() >= worldMax.getZ()) {
+		return; // No static objects yet, keep the maximum extents.
+	}
+
+	bt32BitAxisSweep3 *oldBroadphase = static_cast<bt32BitAxisSweep3 *>(m_Broadphase);
+	bt32BitAxisSweep3 *newBroadphase = VPhysicsNew(bt32BitAxisSweep3,
+			worldMin, worldMax, (unsigned int) (m_AxisSweepMaxProxies + 1));
+	newBroadphase->getOverlappingPairCache()->setOverlapFilterCallback(&m_OverlapFilterCallback);
+	newBroadphase->getOverlappingPairCache()->setInternalGhostPairCallback(&m_BroadphasePairCallback);
+
+	// Objects created before the static ones (rarely any) are moved to the new broadphase, the way
+	// addCollisionObject inserts them. Their pairs are removed with the old proxies and found again on insertion.
+	const btCollisionObjectArray &collisionObjects = m_DynamicsWorld->getCollisionObjectArray();
+	int collisionObjectCount = collisionObjects.size();
+	for (int collisionObjectIndex = 0; collisionObjectIndex < collisionObjectCount; ++collisionObjectIndex) {
+		btCollisionObject *collisionObject = collisionObjects[collisionObjectIndex];
+		btBroadphaseProxy *proxy = collisionObject->getBroadphaseHandle();
+		if (proxy == nullptr) {
+			continue;
+		}
+		int filterGroup = proxy->m_collisionFilterGroup, filterMask = proxy->m_collisionFilterMask;
+		oldBroadphase->destroyProxy(proxy, m_Dispatcher);
+		btVector3 aabbMin, aabbMax;
+		collisionObject->getCollisionShape()->getAabb(collisionObject->getWorldTransform(), aabbMin, aabbMax);
+		collisionObject->setBroadphaseHandle(newBroadphase->createProxy(aabbMin, aabbMax,
+				collisionObject->getCollisionShape()->getShapeType(), collisionObject,
+				filterGroup, filterMask, m_Dispatcher));
+	}
+
+	m_DynamicsWorld->setBroadphase(newBroadphase);
+	m_Broadphase = newBroadphase;
+	VPhysicsDelete(bt32BitAxisSweep3, oldBroadphase);
+}
+
+void CPhysicsEnvironment::MoveToFixedSet(btBroadphaseProxy *proxy) {
+	btDbvtBroadphase *dbvtBroadphase = GetDbvtBroadphase();
+	if (dbvtBroadphase == nullptr) {
+		return;
+	}
+	// Rather than letting the broadphase move static objects one by one after they stay still,
+	// keeping them in the dynamic set, which is rebalanced and collided with itself every step, until then.
+	btDbvtProxy *dbvtProxy = static_cast<btDbvtProxy *>(proxy);
+	if (dbvtProxy->stage == btDbvtBroadphase::STAGECOUNT) {
+		return;
+	}
+	// Same as listremove and listappend in btDbvtBroadphase.cpp.
+	if (dbvtProxy->links[0] != nullptr) {
+		dbvtProxy->links[0]->links[1] = dbvtProxy->links[1];
+	} else {
+		dbvtBroadphase->m_stageRoots[dbvtProxy->stage] = dbvtProxy->links[1];
+	}
+	if (dbvtProxy->links[1] != nullptr) {
+		dbvtProxy->links[1]->links[0] = dbvtProxy->links[0];
+	}
+	dbvtBroadphase->m_sets[btDbvtBroadphase::DYNAMIC_SET].remove(dbvtProxy->leaf);
+	dbvtProxy->leaf = dbvtBroadphase->m_sets[btDbvtBroadphase::FIXED_SET].insert(
+			btDbvtVolume::FromMM(dbvtProxy->m_aabbMin, dbvtProxy->m_aabbMax), dbvtProxy);
+	dbvtProxy->stage = btDbvtBroadphase::STAGECOUNT;
+	btDbvtProxy *&fixedStageRoot = dbvtBroadphase->m_stageRoots[btDbvtBroadphase::STAGECOUNT];
+	dbvtProxy->links[0] = nullptr;
+	dbvtProxy->links[1] = fixedStageRoot;
+	if (fixedStageRoot != nullptr) {
+		fixedStageRoot->links[0] = dbvtProxy;
+	}
+	fixedStageRoot = dbvtProxy;
+	dbvtBroadphase->m_needcleanup = true;
+}
+
+void CPhysicsEnvironment::UpdateInactiveObjectAabb(CPhysicsObject *object) {
+	btCollisionObject *collisionObject = object->GetCollisionObject();
+	btBroadphaseProxy *proxy = collisionObject->getBroadphaseHandle();
+	if (proxy == nullptr || collisionObject->isActive()) {
+		return; // Pending static objects get their AABBs when added, active ones after every PSI.
+	}
+	m_DynamicsWorld->updateSingleAabb(collisionObject);
+	if (object->IsStatic()) {
+		// Setting the AABB takes the proxy out of the fixed set.
+		MoveToFixedSet(proxy);
+	}
+}
+
+void CPhysicsEnvironment::RemoveFromObjectList(CPhysicsObject *object) {
+	int objectIndex = object->GetObjectIndex();
+	if (objectIndex < 0) {
+		return;
+	}
+	m_Objects.FastRemove(objectIndex);
+	if (objectIndex < m_Objects.Count()) {
+		static_cast<CPhysicsObject *>(m_Objects[objectIndex])->SetObjectIndex(objectIndex);
+	}
+	object->SetObjectIndex(-1);
+}
+
+void CPhysicsEnvironment::RemoveFromNonStaticObjectList(CPhysicsObject *object) {
+	int nonStaticIndex = object->GetNonStaticIndex();
+	if (nonStaticIndex < 0) {
+		return;
+	}
+	m_NonStaticObjects.FastRemove(nonStaticIndex);
+	if (nonStaticIndex < m_NonStaticObjects.Count()) {
+		static_cast<CPhysicsObject *>(m_NonStaticObjects[nonStaticIndex])->SetNonStaticIndex(nonStaticIndex);
+	}
+	object->SetNonStaticIndex(-1);
+}
+
 void CPhysicsEnvironment::UpdateActiveObjects() {
+	// Objects woken up by Bullet are added when their contacts with awake objects are read, or otherwise when their
+	// motion states are synchronized, which happens after this callback, so their wake events are sent after the next PSI.
 	for (int objectIndex = 0; objectIndex < m_ActiveNonStaticObjects.Count(); ++objectIndex) {
 		CPhysicsObject *object = static_cast<CPhysicsObject *>(m_ActiveNonStaticObjects[objectIndex]);
-		if (object->UpdateEventSleepState() != object->IsAsleep()) {
-			Assert(object->IsAsleep());
-			m_ActiveNonStaticObjects.FastRemove(objectIndex--);
-			if (m_ObjectEvents != nullptr) {
+		bool wasAsleep = object->UpdateEventSleepState();
+		if (object->IsAsleep()) {
+			RemoveActiveObject(object);
+			--objectIndex;
+			// Not synchronized by Bullet anymore - stop extrapolating the transform.
+			object->UpdateAfterPSI();
+			if (!wasAsleep && m_ObjectEvents != nullptr) {
 				m_ObjectEvents->ObjectSleep(object);
 			}
-		}
-	}
-	int nonStaticObjectCount = m_NonStaticObjects.Count();
-	for (int objectIndex = 0; objectIndex < nonStaticObjectCount; ++objectIndex) {
-		CPhysicsObject *object = static_cast<CPhysicsObject *>(m_NonStaticObjects[objectIndex]);
-		if (object->UpdateEventSleepState() != object->IsAsleep()) {
-			Assert(!object->IsAsleep());
-			m_ActiveNonStaticObjects.AddToTail(object);
-			if (m_ObjectEvents != nullptr) {
-				m_ObjectEvents->ObjectWake(object);
-			}
+		} else if (wasAsleep && m_ObjectEvents != nullptr) {
+			m_ObjectEvents->ObjectWake(object);
 		}
 	}
 }
@@ -247,13 +692,6 @@ const IPhysicsObject **CPhysicsEnvironment::GetObjectList(int *pOutputObjectCoun
 	return const_cast<const IPhysicsObject **>(m_Objects.Base());
 }
 
-void CPhysicsEnvironment::UpdateNonStaticObjectsAfterPSI() {
-	int objectCount = m_NonStaticObjects.Count();
-	for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex) {
-		static_cast<CPhysicsObject *>(m_NonStaticObjects[objectIndex])->UpdateAfterPSI();
-	}
-}
-
 bool CPhysicsEnvironment::IsCollisionModelUsed(CPhysCollide *pCollide) const {
 	return pCollide->GetObjectReferenceList() != nullptr;
 }
@@ -262,22 +700,17 @@ void CPhysicsEnvironment::WakeContactingObjects(IPhysicsObject *object) {
 	if (!object->IsCollisionEnabled() || object->IsTrigger()) {
 		return;
 	}
-	const btCollisionObject *body = static_cast<const CPhysicsObject *>(object)->GetRigidBody();
-	int manifoldCount = m_Dispatcher->getNumManifolds();
+	const CPhysicsObject *physicsObject = static_cast<const CPhysicsObject *>(object);
+	const btCollisionObject *body = physicsObject->GetCollisionObject();
+	const CUtlVector<btPersistentManifold *> &manifolds = physicsObject->GetContactManifolds();
+	int manifoldCount = manifolds.Count();
 	for (int manifoldIndex = 0; manifoldIndex < manifoldCount; ++manifoldIndex) {
-		const btPersistentManifold *manifold = m_Dispatcher->getManifoldByIndexInternal(manifoldIndex);
-		int contactCount = manifold->getNumContacts();
-		if (contactCount == 0) {
-			continue;
-		}
-		const btCollisionObject *otherBody;
-		if (body == manifold->getBody0()) {
-			otherBody = manifold->getBody1();
-		} else if (body == manifold->getBody1()) {
-			otherBody = manifold->getBody0();
-		} else {
+		const btPersistentManifold *manifold = manifolds[manifoldIndex];
+		if (manifold->getNumContacts() == 0) {
 			continue;
 		}
+		const btCollisionObject *otherBody =
+				(body == manifold->getBody0() ? manifold->getBody1() : manifold->getBody0());
 		IPhysicsObject *otherObject = reinterpret_cast<IPhysicsObject *>(otherBody->getUserPointer());
 		if (otherObject != nullptr && !otherObject->IsTrigger()) {
 			otherObject->Wake();
@@ -305,8 +738,8 @@ void CPhysicsEnvironment::DestroyObject(IPhysicsObject *pObject) {
 
 	static_cast<CPhysicsObject *>(pObject)->NotifyQueuedForRemoval();
 
-	m_Objects.FindAndFastRemove(pObject);
-	if (IsInSimulation() || m_QueueDeleteObject) {
+	RemoveFromObjectList(static_cast<CPhysicsObject *>(pObject));
+	if (IsInSimulation() || m_QueueDeleteObject || m_DeliveringCollisionEvents) {
 		pObject->SetCallbackFlags(pObject->GetCallbackFlags() | CALLBACK_MARKED_FOR_DELETE);
 		m_DeadObjects.AddToTail(pObject);
 	} else {
@@ -321,9 +754,17 @@ void CPhysicsEnvironment::CleanupDeleteList() {
 	}
 	m_DeadConstraints.RemoveAll();
 
+	// Called before every PSI too, when events of the previous PSIs of the step may still reference the objects.
+	bool eventsBuffered = (m_CollisionEventBuffer.size() != 0);
 	int objectCount = m_DeadObjects.Count();
 	for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex) {
-		static_cast<CPhysicsObject *>(m_DeadObjects[objectIndex])->Release();
+		CPhysicsObject *object = static_cast<CPhysicsObject *>(m_DeadObjects[objectIndex]);
+		if (eventsBuffered) {
+			object->ReleaseKeepingMemory();
+			m_ReleasedObjectsReferencedByEvents.AddToTail(object);
+		} else {
+			object->Release();
+		}
 	}
 	m_DeadObjects.RemoveAll();
 }
@@ -331,25 +772,11 @@ void CPhysicsEnvironment::CleanupDeleteList() {
 void CPhysicsEnvironment::NotifyObjectRemoving(IPhysicsObject *object) {
 	CPhysicsObject *physicsObject = static_cast<CPhysicsObject *>(object);
 
-	if (physicsObject->IsAttachedToConstraintObjects()) {
-		if (physicsObject->IsAttachedToConstraint(false)) {
-			for (int constraintIndex = m_DynamicsWorld->getNumConstraints() - 1; constraintIndex >= 0; --constraintIndex) {
-				btTypedConstraint *constraint = m_DynamicsWorld->getConstraint(constraintIndex);
-				if (constraint->getRigidBodyA().getUserPointer() == object ||
-						constraint->getRigidBodyB().getUserPointer() == object) {
-					// Force remove it - if it's fine to destroy objects, it's fine to remove constraints too.
-					m_DynamicsWorld->removeConstraint(constraint);
-				}
-			}
-		}
-		int constraintCount = m_ConstraintObjects.Count();
-		for (int constraintIndex = 0; constraintIndex < constraintCount; ++constraintIndex) {
-			IPhysicsConstraint *constraint = m_ConstraintObjects[constraintIndex];
-			if (constraint->GetReferenceObject() == object || constraint->GetAttachedObject() == object) {
-				static_cast<CPhysicsConstraint *>(constraint)->NotifyObjectRemoving();
-			}
-		}
-		physicsObject->NotifyAllConstraintsRemoved();
+	// Detaching removes the constraint from the lists of both objects.
+	const CUtlVector<IPhysicsConstraint *> &constraints = physicsObject->GetConstraintObjects();
+	while (constraints.Count() > 0) {
+		// Force remove it - if it's fine to destroy objects, it's fine to remove constraints too.
+		DetachConstraint(constraints.Tail());
 	}
 
 	int playerCount = m_PlayerControllers.Count();
@@ -358,25 +785,11 @@ void CPhysicsEnvironment::NotifyObjectRemoving(IPhysicsObject *object) {
 				m_PlayerControllers[playerIndex])->NotifyPotentialGroundRemoving(object);
 	}
 
-	if (object->IsTrigger()) {
-		NotifyTriggerRemoved(object);
-	}
+	RemoveTriggerPairsForObject(object);
+	Assert(!physicsObject->IsTouchingTriggers());
 
-	if (physicsObject->IsTouchingTriggers()) {
-		unsigned short touchIndex = m_TriggerTouches.FirstInorder();
-		while (touchIndex != m_TriggerTouches.InvalidIndex()) {
-			unsigned short nextTouch = m_TriggerTouches.NextInorder(touchIndex);
-			if (m_TriggerTouches[touchIndex].m_Object == object) {
-				physicsObject->RemoveTriggerTouchReference();
-				m_TriggerTouches.RemoveAt(touchIndex);
-				if (!physicsObject->IsTouchingTriggers()) {
-					break;
-				}
-			}
-			touchIndex = nextTouch;
-		}
-		Assert(!physicsObject->IsTouchingTriggers());
-	}
+	RemoveContactPairsForObject(object);
+	RemoveShouldNotCollidePairsForObject(object);
 
 	for (int snapshotIndex = m_HighestActiveFrictionSnapshot; snapshotIndex >= 0; --snapshotIndex) {
 		CPhysicsFrictionSnapshot *snapshot = static_cast<CPhysicsFrictionSnapshot *>(
@@ -388,15 +801,19 @@ void CPhysicsEnvironment::NotifyObjectRemoving(IPhysicsObject *object) {
 	UpdateHighestActiveFrictionSnapshot();
 
 	if (!object->IsStatic()) {
-		if (!physicsObject->WasAsleep()) {
-			m_ActiveNonStaticObjects.FindAndFastRemove(object);
-		}
-		m_NonStaticObjects.FindAndFastRemove(object);
+		RemoveActiveObject(physicsObject);
+		RemoveFromNonStaticObjectList(physicsObject);
 	}
 
 	// Already removed from m_Objects by the method which requested removal.
 
-	m_DynamicsWorld->removeRigidBody(physicsObject->GetRigidBody());
+	btCollisionObject *collisionObject = physicsObject->GetCollisionObject();
+	if (collisionObject->getBroadphaseHandle() != nullptr) {
+		// Removes rigid bodies from the list of the simulated ones too.
+		m_DynamicsWorld->removeCollisionObject(collisionObject);
+	} else {
+		m_PendingStaticObjects.FindAndFastRemove(physicsObject);
+	}
 }
 
 /****************
@@ -533,9 +950,9 @@ void CPhysicsEnvironment::DestroyConstraint(IPhysicsConstraint *pConstraint) {
 }
 
 void CPhysicsEnvironment::AddConstraint(IPhysicsConstraint *constraint) {
-	m_ConstraintObjects.AddToTail(constraint);
-	btTypedConstraint *bulletConstraint = static_cast<CPhysicsConstraint *>(
-			constraint)->GetBulletConstraint();
+	CPhysicsConstraint *physicsConstraint = static_cast<CPhysicsConstraint *>(constraint);
+	physicsConstraint->SetConstraintIndex(m_ConstraintObjects.AddToTail(constraint));
+	btTypedConstraint *bulletConstraint = physicsConstraint->GetBulletConstraint();
 	bool valid = (bulletConstraint != nullptr);
 	if (valid) {
 		m_DynamicsWorld->addConstraint(bulletConstraint);
@@ -543,15 +960,15 @@ void CPhysicsEnvironment::AddConstraint(IPhysicsConstraint *constraint) {
 
 	IPhysicsObject *object = constraint->GetReferenceObject();
 	if (object != nullptr) {
-		static_cast<CPhysicsObject *>(object)->NotifyConstraintAdded(valid);
+		static_cast<CPhysicsObject *>(object)->NotifyConstraintAdded(constraint, valid);
 	}
 	object = constraint->GetAttachedObject();
 	if (object != nullptr) {
-		static_cast<CPhysicsObject *>(object)->NotifyConstraintAdded(valid);
+		static_cast<CPhysicsObject *>(object)->NotifyConstraintAdded(constraint, valid);
 	}
 }
 
-void CPhysicsEnvironment::DeleteConstraint(IPhysicsConstraint *constraint, bool removeFromList) {
+void CPhysicsEnvironment::DetachConstraint(IPhysicsConstraint *constraint) {
 	CPhysicsConstraint *physicsConstraint = static_cast<CPhysicsConstraint *>(constraint);
 
 	btTypedConstraint *bulletConstraint = physicsConstraint->GetBulletConstraint();
@@ -560,17 +977,33 @@ void CPhysicsEnvironment::DeleteConstraint(IPhysicsConstraint *constraint, bool
 		m_DynamicsWorld->removeConstraint(bulletConstraint);
 	}
 
-	if (removeFromList) {
-		m_ConstraintObjects.FindAndFastRemove(constraint);
-	}
-
 	IPhysicsObject *object = constraint->GetReferenceObject();
 	if (object != nullptr) {
-		static_cast<CPhysicsObject *>(object)->NotifyConstraintRemoved(valid);
+		static_cast<CPhysicsObject *>(object)->NotifyConstraintRemoved(constraint, valid);
 	}
 	object = constraint->GetAttachedObject();
 	if (object != nullptr) {
-		static_cast<CPhysicsObject *>(object)->NotifyConstraintRemoved(valid);
+		static_cast<CPhysicsObject *>(object)->NotifyConstraintRemoved(constraint, valid);
+	}
+
+	physicsConstraint->NotifyObjectRemoving();
+}
+
+void CPhysicsEnvironment::DeleteConstraint(IPhysicsConstraint *constraint, bool removeFromList) {
+	CPhysicsConstraint *physicsConstraint = static_cast<CPhysicsConstraint *>(constraint);
+
+	// Remove from the world and from the objects if it hasn't been done because of object removal.
+	DetachConstraint(constraint);
+
+	if (removeFromList) {
+		int constraintIndex = physicsConstraint->GetConstraintIndex();
+		if (constraintIndex >= 0) {
+			m_ConstraintObjects.FastRemove(constraintIndex);
+			if (constraintIndex < m_ConstraintObjects.Count()) {
+				static_cast<CPhysicsConstraint *>(m_ConstraintObjects[constraintIndex])->SetConstraintIndex(constraintIndex);
+			}
+			physicsConstraint->SetConstraintIndex(-1);
+		}
 	}
 
 	physicsConstraint->Release();
@@ -646,6 +1079,8 @@ void CPhysicsEnvironment::DestroyVehicleController(IPhysicsVehicleController *pC
  *******************/
 
 void CPhysicsEnvironment::Simulate(float deltaTime) {
+	AddPendingStaticObjects();
+
 	if (deltaTime > 0.0f && deltaTime < 1.0f) { // Trap interrupts and clock changes.
 		deltaTime = MIN(deltaTime, 0.1f);
 		m_TimeSinceLastPSI += deltaTime;
@@ -660,13 +1095,19 @@ void CPhysicsEnvironment::Simulate(float deltaTime) {
 				m_DynamicsWorld->stepSimulation(m_SimulationTimeStep, 0, m_SimulationTimeStep);
 				m_LastPSITime += m_SimulationTimeStep;
 			}
+			m_StatsPSICount += psiCount;
 			m_TimeSinceLastPSI = oldTimeSinceLastPSI - psiCount * m_SimulationTimeStep;
 		}
-		int objectCount = m_ActiveNonStaticObjects.Count();
-		for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex) {
-			CPhysicsObject *object = static_cast<CPhysicsObject *>(m_ActiveNonStaticObjects[objectIndex]);
-			object->InterpolateBetweenPSIs();
+		{
+			CTimeAdder timeAdder(&m_PhaseTimes[PHASE_INTERPOLATION]);
+			int objectCount = m_ActiveNonStaticObjects.Count();
+			for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex) {
+				CPhysicsObject *object = static_cast<CPhysicsObject *>(m_ActiveNonStaticObjects[objectIndex]);
+				object->InterpolateBetweenPSIs();
+			}
 		}
+		CTimeAdder timeAdder(&m_PhaseTimes[PHASE_EVENT_DELIVERY]);
+		DeliverCollisionEvents();
 	}
 	if (!m_QueueDeleteObject) {
 		CleanupDeleteList();
@@ -717,30 +1158,75 @@ void CPhysicsEnvironment::PreTickCallback(btDynamicsWorld *world, btScalar timeS
 
 	environment->m_InSimulation = true;
 
-	IPhysicsObject * const *objects = environment->m_NonStaticObjects.Base();
-	int objectCount = environment->m_NonStaticObjects.Count();
-	for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex) {
-		CPhysicsObject *object = static_cast<CPhysicsObject *>(objects[objectIndex]);
+	CTimeAdder timeAdder(&environment->m_PhaseTimes[PHASE_PRE_TICK]);
+
+	environment->m_PSICollisionCheckCount = 0;
+
+	// Sleeping objects aren't simulated, like in IVP. Callbacks may wake up more objects,
+	// which are appended to the array, so the objects are processed in batches until no new ones are added.
+	// Each stage is done for the whole batch, like IVP runs controllers of each priority for all objects,
+	// so the stages not calling into the game can be processed for multiple objects at once.
+	const CUtlVector<IPhysicsObject *> &objects = environment->m_ActiveNonStaticObjects;
+	int batchStart = 0;
+	while (batchStart < objects.Count()) {
+		int batchEnd = objects.Count();
+		int objectIndex;
 
 		// Async force fields.
-		object->SimulateMotionControllers(IPhysicsMotionController::HIGH_PRIORITY, timeStep);
+		for (objectIndex = batchStart; objectIndex < batchEnd; ++objectIndex) {
+			static_cast<CPhysicsObject *>(objects[objectIndex])->SimulateMotionControllers(
+					IPhysicsMotionController::HIGH_PRIORITY, timeStep);
+		}
 
 		// Gravity.
-		object->ApplyDamping(timeStep);
-		object->ApplyForcesAndSpeedLimit(timeStep);
-		object->ApplyGravity(timeStep);
+#ifdef BT_USE_DOUBLE_PRECISION
+		for (objectIndex = batchStart; objectIndex < batchEnd; ++objectIndex) {
+			CPhysicsObject *object = static_cast<CPhysicsObject *>(objects[objectIndex]);
+			object->ApplyDamping(timeStep);
+			object->ApplyForcesAndSpeedLimit(timeStep);
+			object->ApplyGravity(timeStep);
+		}
+#else
+		CPhysicsVelocityBatch &velocityBatch = environment->m_VelocityBatch;
+		velocityBatch.BeginForceStage();
+		for (objectIndex = batchStart; objectIndex < batchEnd; ++objectIndex) {
+			static_cast<CPhysicsObject *>(objects[objectIndex])->AddToForceBatch(velocityBatch, timeStep);
+		}
+		velocityBatch.RunForceStage(environment->GetMaxSpeed(), environment->GetMaxAngularSpeed());
+#endif
 
 		// Shadows.
-		object->SimulateShadowAndPlayer(timeStep);
+		for (objectIndex = batchStart; objectIndex < batchEnd; ++objectIndex) {
+			static_cast<CPhysicsObject *>(objects[objectIndex])->SimulateShadowAndPlayer(timeStep);
+		}
 
 		// Unconstrained motion.
-		object->ApplyDrag(timeStep);
-		object->SimulateMotionControllers(IPhysicsMotionController::MEDIUM_PRIORITY, timeStep);
+#ifdef BT_USE_DOUBLE_PRECISION
+		for (objectIndex = batchStart; objectIndex < batchEnd; ++objectIndex) {
+			static_cast<CPhysicsObject *>(objects[objectIndex])->ApplyDrag(timeStep);
+		}
+#else
+		velocityBatch.BeginDragStage();
+		for (objectIndex = batchStart; objectIndex < batchEnd; ++objectIndex) {
+			static_cast<CPhysicsObject *>(objects[objectIndex])->AddToDragBatch(velocityBatch, timeStep);
+		}
+		velocityBatch.RunDragStage();
+#endif
+
+		for (objectIndex = batchStart; objectIndex < batchEnd; ++objectIndex) {
+			CPhysicsObject *object = static_cast<CPhysicsObject *>(objects[objectIndex]);
+
+			object->SimulateMotionControllers(IPhysicsMotionController::MEDIUM_PRIORITY, timeStep);
 
-		// Vehicle.
-		object->SimulateVehicle(timeStep);
+			// Vehicle.
+			object->SimulateVehicle(timeStep);
 
-		object->CheckAndClearBulletForces();
+			object->CheckAndClearBulletForces();
+
+			object->SavePrePSIVelocity();
+		}
+
+		batchStart = batchEnd;
 	}
 }
 
@@ -748,9 +1234,8 @@ void CPhysicsEnvironment::TickActionInterface::updateAction(
 		btCollisionWorld *collisionWorld, btScalar deltaTimeStep) {
 	CPhysicsEnvironment *environment = reinterpret_cast<CPhysicsEnvironment *>(
 			static_cast<btDynamicsWorld *>(collisionWorld)->getWorldUserInfo());
-	IPhysicsObject * const *objects = environment->m_NonStaticObjects.Base();
-	int objectCount = environment->m_NonStaticObjects.Count();
-	for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex) {
+	const CUtlVector<IPhysicsObject *> &objects = environment->m_ActiveNonStaticObjects;
+	for (int objectIndex = 0; objectIndex < objects.Count(); ++objectIndex) {
 		CPhysicsObject *object = static_cast<CPhysicsObject *>(objects[objectIndex]);
 		object->SimulateMotionControllers(IPhysicsMotionController::LOW_PRIORITY, deltaTimeStep);
 	}
@@ -758,9 +1243,24 @@ void CPhysicsEnvironment::TickActionInterface::updateAction(
 
 void CPhysicsEnvironment::TickCallback(btDynamicsWorld *world, btScalar timeStep) {
 	CPhysicsEnvironment *environment = reinterpret_cast<CPhysicsEnvironment *>(world->getWorldUserInfo());
-	environment->CheckTriggerTouches();
-	environment->UpdateActiveObjects();
-	environment->UpdateNonStaticObjectsAfterPSI();
+	CCycleCount *phaseTimes = environment->m_PhaseTimes;
+	{
+		CTimeAdder timeAdder(&phaseTimes[PHASE_COLLISION_EVENTS]);
+		if (environment->m_StatsRequested) {
+			environment->UpdateSpeedGainStats();
+		}
+		environment->CollectCollisionEvents();
+		environment->FreezeObjectsOverCollisionLimit();
+	}
+	{
+		CTimeAdder timeAdder(&phaseTimes[PHASE_TRIGGERS]);
+		environment->CheckTriggerTouches();
+	}
+	{
+		CTimeAdder timeAdder(&phaseTimes[PHASE_ACTIVATION]);
+		environment->UpdateActiveObjects();
+	}
+	// Transforms of active objects are copied to the inter-PSI state by their motion states.
 	environment->m_InSimulation = false;
 }
 
@@ -771,7 +1271,8 @@ void CPhysicsEnvironment::TickCallback(btDynamicsWorld *world, btScalar timeStep
 void CPhysicsEnvironment::SetCollisionSolver(IPhysicsCollisionSolver *pSolver) {
 	m_CollisionSolver = pSolver;
 	// Assuming this is only called when setting up, so not rechecking collision filter.
-	// IVP VPhysics assumes this too.
+	// IVP VPhysics assumes this too. The verdicts of the previous solver are dropped though.
+	RemoveAllShouldNotCollidePairs();
 }
 
 bool CPhysicsEnvironment::NeedCollision(IPhysicsObject *object0, IPhysicsObject *object1) {
@@ -779,6 +1280,8 @@ bool CPhysicsEnvironment::NeedCollision(IPhysicsObject *object0, IPhysicsObject
 		return false;
 	}
 
+	// Pairs of static objects and objects with collisions disabled are normally rejected by the broadphase
+	// proxy groups and masks, but this is also used directly.
 	if (object0->IsStatic() && object1->IsStatic()) {
 		return false;
 	}
@@ -801,7 +1304,7 @@ bool CPhysicsEnvironment::NeedCollision(IPhysicsObject *object0, IPhysicsObject
 		if ((callbackFlags1 & CALLBACK_ENABLING_COLLISION) && (callbackFlags0 & CALLBACK_MARKED_FOR_DELETE)) {
 			return false;
 		}
-		if (!m_CollisionSolver->ShouldCollide(object0, object1, object0->GetGameData(), object1->GetGameData())) {
+		if (!ShouldCollide(object0, object1)) {
 			return false;
 		}
 	}
@@ -809,8 +1312,50 @@ bool CPhysicsEnvironment::NeedCollision(IPhysicsObject *object0, IPhysicsObject
 	return true;
 }
 
+bool CPhysicsEnvironment::ShouldCollide(IPhysicsObject *object0, IPhysicsObject *object1) {
+	if (object0 > object1) {
+		std::swap(object0, object1);
+	}
+	if (m_ShouldNotCollidePairs.FindPair(object0, object1) >= 0) {
+		return false;
+	}
+	// The verdict must not depend on the order of the objects.
+	if (m_CollisionSolver->ShouldCollide(object0, object1, object0->GetGameData(), object1->GetGameData())) {
+		return true;
+	}
+	// Verdicts are only dropped when objects are removed or rechecked, so bound the cache in long sessions.
+	// Dropping all of them is fine, they are requested again when needed.
+	if (m_ShouldNotCollidePairs.GetPairCount() >= VPHYSICS_SHOULD_NOT_COLLIDE_MAX_PAIRS) {
+		RemoveAllShouldNotCollidePairs();
+	}
+	m_ShouldNotCollidePairs.AddPair(object0, object1);
+	return false;
+}
+
+void CPhysicsEnvironment::RemoveShouldNotCollidePairsForObject(IPhysicsObject *object) {
+	int pairIndex = m_ShouldNotCollidePairs.GetFirstPairForObject(object);
+	while (pairIndex >= 0) {
+		int nextPairIndex = m_ShouldNotCollidePairs.GetNextPairForObject(pairIndex, object);
+		m_ShouldNotCollidePairs.RemovePair(pairIndex);
+		pairIndex = nextPairIndex;
+	}
+}
+
+void CPhysicsEnvironment::RemoveAllShouldNotCollidePairs() {
+	int pairCount = m_ShouldNotCollidePairs.GetPairArraySize();
+	for (int pairIndex = 0; pairIndex < pairCount; ++pairIndex) {
+		if (m_ShouldNotCollidePairs.IsPairUsed(pairIndex)) {
+			m_ShouldNotCollidePairs.RemovePair(pairIndex);
+		}
+	}
+}
+
 bool CPhysicsEnvironment::OverlapFilterCallback::needBroadphaseCollision(
 		btBroadphaseProxy *proxy0, btBroadphaseProxy *proxy1) const {
+	if (!(proxy0->m_collisionFilterGroup & proxy1->m_collisionFilterMask) ||
+			!(proxy1->m_collisionFilterGroup & proxy0->m_collisionFilterMask)) {
+		return false;
+	}
 	const btCollisionObject *collisionObject0 = reinterpret_cast<const btCollisionObject *>(proxy0->m_clientObject);
 	const btCollisionObject *collisionObject1 = reinterpret_cast<const btCollisionObject *>(proxy1->m_clientObject);
 	if (collisionObject0 == nullptr || collisionObject1 == nullptr) {
@@ -827,50 +1372,48 @@ void CPhysicsEnvironment::SetCollisionEventHandler(IPhysicsCollisionEvent *pColl
 }
 
 void CPhysicsEnvironment::RecheckObjectCollisionFilter(btCollisionObject *object) {
-	struct RecheckObjectCollisionFilterCallback : public btOverlapCallback {
-		btCollisionObject *m_Object;
-		btOverlapFilterCallback *m_Filter;
-		RecheckObjectCollisionFilterCallback(btCollisionObject *object, btOverlapFilterCallback *filter) :
-				m_Object(object), m_Filter(filter) {}
-		virtual bool processOverlap(btBroadphasePair &pair) {
-			btCollisionObject *otherObject;
-			if (reinterpret_cast<btCollisionObject *>(pair.m_pProxy0->m_clientObject) == m_Object) {
-				otherObject = reinterpret_cast<btCollisionObject *>(pair.m_pProxy1->m_clientObject);
-			} else if (reinterpret_cast<btCollisionObject *>(pair.m_pProxy1->m_clientObject) == m_Object) {
-				otherObject = reinterpret_cast<btCollisionObject *>(pair.m_pProxy0->m_clientObject);
-			} else {
-				return false;
-			}
-			if (!m_Filter->needBroadphaseCollision(pair.m_pProxy0, pair.m_pProxy1)) {
-				if (otherObject != nullptr) {
-					IPhysicsObject *otherPhysicsObject = reinterpret_cast<IPhysicsObject *>(
-							otherObject->getUserPointer());
-					if (otherPhysicsObject != nullptr && !otherPhysicsObject->IsTrigger()) {
-						otherPhysicsObject->Wake();
-					}
-				}
-				return true;
+	IPhysicsObject *physicsObject = reinterpret_cast<IPhysicsObject *>(object->getUserPointer());
+	RemoveShouldNotCollidePairsForObject(physicsObject);
+	btBroadphaseProxy *proxy = object->getBroadphaseHandle();
+	if (proxy == nullptr) {
+		return;
+	}
+	btOverlappingPairCache *pairCache = m_Broadphase->getOverlappingPairCache();
+	int pairIndex = m_OverlappingPairs.GetFirstPairForObject(physicsObject);
+	while (pairIndex >= 0) {
+		// The pair may be removed from the list by the pair cache.
+		int nextPairIndex = m_OverlappingPairs.GetNextPairForObject(pairIndex, physicsObject);
+		const CPhysicsPairHash<OverlappingPairData_t>::Pair &pair = m_OverlappingPairs.GetPair(pairIndex);
+		IPhysicsObject *otherObject = pair.m_Objects[(int) (pair.m_Objects[0] == physicsObject)];
+		btBroadphaseProxy *otherProxy = static_cast<CPhysicsObject *>(otherObject)->GetCollisionObject()->getBroadphaseHandle();
+		if (!m_OverlapFilterCallback.needBroadphaseCollision(proxy, otherProxy)) {
+			pairCache->removeOverlappingPair(proxy, otherProxy, m_Dispatcher);
+			if (!otherObject->IsTrigger()) {
+				otherObject->Wake();
 			}
-			return false;
 		}
-	};
-	RecheckObjectCollisionFilterCallback recheckCallback(object, &m_OverlapFilterCallback);
-	m_Broadphase->getOverlappingPairCache()->processAllOverlappingPairs(&recheckCallback, m_Dispatcher);
+		pairIndex = nextPairIndex;
+	}
 	// Narrowphase contact manifolds are cleared by overlapping pair destruction.
 	// No need to add any pairs here, wait until the next PSI (this is usually called during game ticks).
 }
 
 void CPhysicsEnvironment::RemoveObjectCollisionPairs(btCollisionObject *object) {
-	struct RemoveObjectCollisionPairsCallback : public btOverlapCallback {
-		btCollisionObject *m_Object;
-		RemoveObjectCollisionPairsCallback(btCollisionObject *object) : m_Object(object) {}
-		virtual bool processOverlap(btBroadphasePair &pair) {
-			return (reinterpret_cast<btCollisionObject *>(pair.m_pProxy0->m_clientObject) == m_Object ||
-					reinterpret_cast<btCollisionObject *>(pair.m_pProxy1->m_clientObject) == m_Object);
-		}
-	};
-	RemoveObjectCollisionPairsCallback removeCallback(object);
-	m_Broadphase->getOverlappingPairCache()->processAllOverlappingPairs(&removeCallback, m_Dispatcher);
+	IPhysicsObject *physicsObject = reinterpret_cast<IPhysicsObject *>(object->getUserPointer());
+	btBroadphaseProxy *proxy = object->getBroadphaseHandle();
+	if (proxy == nullptr) {
+		return;
+	}
+	btOverlappingPairCache *pairCache = m_Broadphase->getOverlappingPairCache();
+	int pairIndex = m_OverlappingPairs.GetFirstPairForObject(physicsObject);
+	while (pairIndex >= 0) {
+		int nextPairIndex = m_OverlappingPairs.GetNextPairForObject(pairIndex, physicsObject);
+		const CPhysicsPairHash<OverlappingPairData_t>::Pair &pair = m_OverlappingPairs.GetPair(pairIndex);
+		IPhysicsObject *otherObject = pair.m_Objects[(int) (pair.m_Objects[0] == physicsObject)];
+		pairCache->removeOverlappingPair(proxy,
+				static_cast<CPhysicsObject *>(otherObject)->GetCollisionObject()->getBroadphaseHandle(), m_Dispatcher);
+		pairIndex = nextPairIndex;
+	}
 	// Narrowphase contact manifolds are cleared by overlapping pair destruction.
 }
 
@@ -896,112 +1439,981 @@ void CPhysicsEnvironment::DestroyFrictionSnapshot(IPhysicsFrictionSnapshot *snap
 	UpdateHighestActiveFrictionSnapshot();
 }
 
+bool CPhysicsEnvironment::GetTriggerAndObject(
+		btBroadphaseProxy *proxy0, btBroadphaseProxy *proxy1,
+		IPhysicsObject *&trigger, IPhysicsObject *&object) {
+	IPhysicsObject *object0 = GetProxyObject(proxy0), *object1 = GetProxyObject(proxy1);
+	if (object0 == nullptr || object1 == nullptr) {
+		return false;
+	}
+	if (object0->IsTrigger()) {
+		if (object1->IsTrigger()) {
+			return false;
+		}
+		trigger = object0;
+		object = object1;
+	} else if (object1->IsTrigger()) {
+		trigger = object1;
+		object = object0;
+	} else {
+		return false;
+	}
+	return !object->IsStatic();
+}
+
+void CPhysicsEnvironment::AddTriggerPair(btBroadphaseProxy *proxy0, btBroadphaseProxy *proxy1) {
+	IPhysicsObject *trigger, *object;
+	if (!GetTriggerAndObject(proxy0, proxy1, trigger, object)) {
+		return;
+	}
+	int pairIndex = m_TriggerPairs.FindPair(trigger, object);
+	if (pairIndex < 0) {
+		pairIndex = m_TriggerPairs.AddPair(trigger, object);
+		m_TriggerPairs.GetPair(pairIndex).m_Data.m_Touching = false;
+	}
+	TriggerPairData_t &data = m_TriggerPairs.GetPair(pairIndex).m_Data;
+	data.m_Overlapping = true;
+	// Objects teleported into triggers may be asleep.
+	data.m_Tested = false;
+}
+
+IPhysicsObject *CPhysicsEnvironment::GetProxyObject(const btBroadphaseProxy *proxy) {
+	const btCollisionObject *collisionObject = reinterpret_cast<const btCollisionObject *>(proxy->m_clientObject);
+	if (collisionObject == nullptr) {
+		return nullptr;
+	}
+	return reinterpret_cast<IPhysicsObject *>(collisionObject->getUserPointer());
+}
+
+btBroadphasePair *CPhysicsEnvironment::BroadphasePairCallback::addOverlappingPair(
+		btBroadphaseProxy *proxy0, btBroadphaseProxy *proxy1) {
+	++m_Environment->m_Stats.collisionPairsCreated;
+	IPhysicsObject *object0 = GetProxyObject(proxy0), *object1 = GetProxyObject(proxy1);
+	if (object0 != nullptr && object1 != nullptr) {
+		if (object0 > object1) {
+			std::swap(object0, object1);
+		}
+		CPhysicsPairHash<OverlappingPairData_t> &pairs = m_Environment->m_OverlappingPairs;
+		if (pairs.FindPair(object0, object1) < 0) {
+			pairs.AddPair(object0, object1);
+		}
+	}
+	m_Environment->AddTriggerPair(proxy0, proxy1);
+	return nullptr;
+}
+
+void *CPhysicsEnvironment::BroadphasePairCallback::removeOverlappingPair(
+		btBroadphaseProxy *proxy0, btBroadphaseProxy *proxy1, btDispatcher *dispatcher) {
+	++m_Environment->m_Stats.collisionPairsDestroyed;
+	IPhysicsObject *object0 = GetProxyObject(proxy0), *object1 = GetProxyObject(proxy1);
+	if (object0 != nullptr && object1 != nullptr) {
+		if (object0 > object1) {
+			std::swap(object0, object1);
+		}
+		CPhysicsPairHash<OverlappingPairData_t> &overlappingPairs = m_Environment->m_OverlappingPairs;
+		int overlappingPairIndex = overlappingPairs.FindPair(object0, object1);
+		if (overlappingPairIndex >= 0) {
+			overlappingPairs.RemovePair(overlappingPairIndex);
+		}
+	}
+	IPhysicsObject *trigger, *object;
+	if (GetTriggerAndObject(proxy0, proxy1, trigger, object)) {
+		CPhysicsPairHash<TriggerPairData_t> &pairs = m_Environment->m_TriggerPairs;
+		int pairIndex = pairs.FindPair(trigger, object);
+		if (pairIndex >= 0) {
+			pairs.GetPair(pairIndex).m_Data.m_Overlapping = false;
+		}
+	}
+	return nullptr;
+}
+
+void CPhysicsEnvironment::BroadphasePairCallback::removeOverlappingPairsContainingProxy(
+		btBroadphaseProxy *proxy0, btDispatcher *dispatcher) {
+	// Not called for internal ghost pair callbacks - the pair cache removes pairs one by one - but handled anyway.
+	IPhysicsObject *object = GetProxyObject(proxy0);
+	if (object == nullptr) {
+		return;
+	}
+	CPhysicsPairHash<OverlappingPairData_t> &overlappingPairs = m_Environment->m_OverlappingPairs;
+	int overlappingPairIndex = overlappingPairs.GetFirstPairForObject(object);
+	while (overlappingPairIndex >= 0) {
+		int nextOverlappingPairIndex = overlappingPairs.GetNextPairForObject(overlappingPairIndex, object);
+		overlappingPairs.RemovePair(overlappingPairIndex);
+		overlappingPairIndex = nextOverlappingPairIndex;
+	}
+	CPhysicsPairHash<TriggerPairData_t> &pairs = m_Environment->m_TriggerPairs;
+	for (int pairIndex = pairs.GetFirstPairForObject(object); pairIndex >= 0;
+			pairIndex = pairs.GetNextPairForObject(pairIndex, object)) {
+		pairs.GetPair(pairIndex).m_Data.m_Overlapping = false;
+	}
+}
+
+void CPhysicsEnvironment::RemoveTriggerPair(int pairIndex) {
+	CPhysicsPairHash<TriggerPairData_t>::Pair &pair = m_TriggerPairs.GetPair(pairIndex);
+	if (pair.m_Data.m_Touching) {
+		static_cast<CPhysicsObject *>(pair.m_Objects[1])->RemoveTriggerTouchReference();
+	}
+	m_TriggerPairs.RemovePair(pairIndex);
+}
+
+void CPhysicsEnvironment::RemoveTriggerPairsForObject(IPhysicsObject *object) {
+	int pairIndex = m_TriggerPairs.GetFirstPairForObject(object);
+	while (pairIndex >= 0) {
+		int nextPairIndex = m_TriggerPairs.GetNextPairForObject(pairIndex, object);
+		RemoveTriggerPair(pairIndex);
+		pairIndex = nextPairIndex;
+	}
+}
+
+// Whether the shapes intersect, for triggers which don't have contact manifolds.
+struct CPhysicsTriggerTouchTestCallback : public btCollisionWorld::ContactResultCallback {
+	bool m_Touching;
+
+	CPhysicsTriggerTouchTestCallback() : m_Touching(false) {}
+
+	virtual btScalar addSingleResult(btManifoldPoint &cp,
+			const btCollisionObjectWrapper *colObj0Wrap, int partId0, int index0,
+			const btCollisionObjectWrapper *colObj1Wrap, int partId1, int index1) {
+		if (cp.getDistance() <= 0.0f) {
+			m_Touching = true;
+		}
+		return 0.0f;
+	}
+};
+
 void CPhysicsEnvironment::CheckTriggerTouches() {
-	int manifoldCount = m_Dispatcher->getNumManifolds();
-	for (int manifoldIndex = 0; manifoldIndex < manifoldCount; ++manifoldIndex) {
-		const btPersistentManifold *manifold = m_Dispatcher->getManifoldByIndexInternal(manifoldIndex);
-		int contactCount = manifold->getNumContacts();
-		if (contactCount == 0) {
+	// Only pairs that overlap in the broadphase are checked, first by the bounding boxes, then by the shapes,
+	// so rotated and sloped triggers are entered where their surface is.
+	// Pairs where neither side has moved since the last test can't start or stop touching.
+	int pairCount = m_TriggerPairs.GetPairArraySize();
+	for (int pairIndex = 0; pairIndex < pairCount; ++pairIndex) {
+		if (!m_TriggerPairs.IsPairUsed(pairIndex)) {
 			continue;
 		}
+		// Not using the reference after the events - the game may create or destroy objects in them.
+		CPhysicsPairHash<TriggerPairData_t>::Pair &pair = m_TriggerPairs.GetPair(pairIndex);
+		IPhysicsObject *trigger = pair.m_Objects[0], *object = pair.m_Objects[1];
+
+		bool touching = false;
+		if (pair.m_Data.m_Overlapping) {
+			btCollisionObject *triggerBody = static_cast<CPhysicsObject *>(trigger)->GetCollisionObject();
+			btCollisionObject *objectBody = static_cast<CPhysicsObject *>(object)->GetCollisionObject();
+			if (pair.m_Data.m_Tested && !triggerBody->isActive() && !objectBody->isActive()) {
+				continue;
+			}
+			pair.m_Data.m_Tested = true;
+			const btBroadphaseProxy *triggerProxy = triggerBody->getBroadphaseHandle();
+			const btBroadphaseProxy *objectProxy = objectBody->getBroadphaseHandle();
+			touching = TestAabbAgainstAabb2(triggerProxy->m_aabbMin, triggerProxy->m_aabbMax,
+					objectProxy->m_aabbMin, objectProxy->m_aabbMax);
+			if (touching) {
+				CPhysicsTriggerTouchTestCallback touchTestResult;
+				m_DynamicsWorld->contactPairTest(triggerBody, objectBody, touchTestResult);
+				touching = touchTestResult.m_Touching;
+			}
+		}
 
-		IPhysicsObject *object0 = reinterpret_cast<IPhysicsObject *>(manifold->getBody0()->getUserPointer());
-		IPhysicsObject *object1 = reinterpret_cast<IPhysicsObject *>(manifold->getBody1()->getUserPointer());
-		if (object0 == nullptr || object1 == nullptr) {
-			continue;
+		if (touching != pair.m_Data.m_Touching) {
+			pair.m_Data.m_Touching = touching;
+			if (touching) {
+				static_cast<CPhysicsObject *>(object)->AddTriggerTouchReference();
+			} else {
+				static_cast<CPhysicsObject *>(object)->RemoveTriggerTouchReference();
+			}
+			if (m_CollisionEvents != nullptr) {
+				if (touching) {
+					m_CollisionEvents->ObjectEnterTrigger(trigger, object);
+				} else {
+					m_CollisionEvents->ObjectLeaveTrigger(trigger, object);
+				}
+			}
 		}
-		IPhysicsObject *trigger, *object;
-		if (object0->IsTrigger()) {
-			if (object1->IsTrigger()) {
+
+		// The pair may have been removed with the object in the event.
+		if (m_TriggerPairs.IsPairUsed(pairIndex) && !m_TriggerPairs.GetPair(pairIndex).m_Data.m_Overlapping) {
+			m_TriggerPairs.RemovePair(pairIndex);
+		}
+	}
+}
+
+void CPhysicsEnvironment::NotifyTriggerStateChanged(IPhysicsObject *object) {
+	// Not triggering leave events since the object either wasn't a trigger or isn't anymore.
+	RemoveTriggerPairsForObject(object);
+
+	// The broadphase won't report pairs that already exist, so add them for the new role of the object.
+	btBroadphaseProxy *proxy = static_cast<CPhysicsObject *>(object)->GetCollisionObject()->getBroadphaseHandle();
+	if (proxy == nullptr) {
+		return;
+	}
+	for (int pairIndex = m_OverlappingPairs.GetFirstPairForObject(object); pairIndex >= 0;
+			pairIndex = m_OverlappingPairs.GetNextPairForObject(pairIndex, object)) {
+		const CPhysicsPairHash<OverlappingPairData_t>::Pair &pair = m_OverlappingPairs.GetPair(pairIndex);
+		IPhysicsObject *otherObject = pair.m_Objects[(int) (pair.m_Objects[0] == object)];
+		AddTriggerPair(proxy, static_cast<CPhysicsObject *>(otherObject)->GetCollisionObject()->getBroadphaseHandle());
+	}
+}
+
+/*******************
+ * Collision events
+ *******************/
+
+void CPhysicsEnvironment::CollisionData::GetSurfaceNormal(Vector &out) {
+	ConvertDirectionToHL(m_Event.m_SurfaceNormal, out);
+}
+
+void CPhysicsEnvironment::CollisionData::GetContactPoint(Vector &out) {
+	ConvertPositionToHL(m_Event.m_ContactPoint, out);
+}
+
+void CPhysicsEnvironment::CollisionData::GetContactSpeed(Vector &out) {
+	ConvertPositionToHL(m_Event.m_ContactSpeed, out);
+}
+
+CPhysicsEnvironment::CollisionEvent_t &CPhysicsEnvironment::AddCollisionEvent(
+		CollisionEvent_t::Type_t type, IPhysicsObject *object0, IPhysicsObject *object1) {
+	CollisionEvent_t &event = m_CollisionEventBuffer.expandNonInitializing();
+	event.m_Type = type;
+	event.m_Objects[0] = object0;
+	event.m_Objects[1] = object1;
+	if (object0 != nullptr) {
+		event.m_SurfaceProps[0] = object0->GetMaterialIndex();
+		event.m_SurfaceProps[1] = object1->GetMaterialIndex();
+	}
+	event.m_ContactPoint.setZero();
+	event.m_SurfaceNormal.setZero();
+	event.m_ContactSpeed.setZero();
+	return event;
+}
+
+void CPhysicsEnvironment::UpdateSpeedGainStats() {
+	btScalar maxSpeedGain = 0.0f;
+	int objectCount = m_ActiveNonStaticObjects.Count();
+	for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex) {
+		const CPhysicsObject *object = static_cast<const CPhysicsObject *>(m_ActiveNonStaticObjects[objectIndex]);
+		btVector3 linearVelocity, angularVelocity;
+		object->GetPrePSIVelocity(linearVelocity, angularVelocity);
+		maxSpeedGain = btMax(maxSpeedGain,
+				object->GetRigidBody()->getLinearVelocity().length() - linearVelocity.length());
+	}
+	m_Stats.maxSpeedGain = MAX(m_Stats.maxSpeedGain, (float) BULLET2HL(maxSpeedGain));
+}
+
+// Whether the object wants events of a kind with the other object, according to its callback flags.
+static bool ObjectWantsCollisionEvents(const IPhysicsObject *object, const IPhysicsObject *otherObject,
+		unsigned int flag, unsigned int staticFlag) {
+	unsigned int callbackFlags = object->GetCallbackFlags();
+	if (!(callbackFlags & flag) || (callbackFlags & CALLBACK_MARKED_FOR_DELETE)) {
+		return false;
+	}
+	return object->IsStatic() || !otherObject->IsStatic() || (callbackFlags & staticFlag);
+}
+
+int CPhysicsEnvironment::GetContactAggregate(IPhysicsObject *object0, IPhysicsObject *object1,
+		const btManifoldPoint &firstPoint, btScalar normalSign, btScalar time) {
+	int pairIndex = m_ContactPairs.FindPair(object0, object1);
+	if (pairIndex < 0) {
+		pairIndex = m_ContactPairs.AddPair(object0, object1);
+		ContactPairData_t &newPairData = m_ContactPairs.GetPair(pairIndex).m_Data;
+		newPairData.m_LastImpactTime = -BT_LARGE_FLOAT;
+		newPairData.m_AggregateIndex = -1;
+		newPairData.m_Touching = false;
+		newPairData.m_TouchReported = false;
+	}
+	ContactPairData_t &pairData = m_ContactPairs.GetPair(pairIndex).m_Data;
+	pairData.m_LastContactTime = time;
+	if (pairData.m_AggregateIndex < 0) {
+		pairData.m_AggregateIndex = m_ContactAggregates.size();
+		ContactAggregate_t &newAggregate = m_ContactAggregates.expandNonInitializing();
+		newAggregate.m_PairIndex = pairIndex;
+		newAggregate.m_ImpactImpulse = 0.0f;
+		newAggregate.m_Penetrating = false;
+		newAggregate.m_FrictionEnergy = 0.0f;
+		newAggregate.m_MaxFrictionPointEnergy = -1.0f;
+		// Touch events are reported at a contact point.
+		newAggregate.m_ImpactPoint = firstPoint.getPositionWorldOnB();
+		newAggregate.m_ImpactNormal = firstPoint.m_normalWorldOnB * normalSign;
+	}
+	return pairData.m_AggregateIndex;
+}
+
+void CPhysicsEnvironment::CollectCollisionEvents() {
+	btScalar time = m_LastPSITime + m_SimulationTimeStep;
+	bool reportEvents = (m_CollisionEvents != nullptr);
+	bool gatherStats = m_StatsRequested;
+
+	// Penetration is resolved by the solver pushing the objects apart with the speed proportional to the depth.
+	btScalar rescueSpeedPerDepth = m_DynamicsWorld->getSolverInfo().m_erp2 * m_SimulationInvTimeStep;
+	btScalar hardRescueDistance = -m_DynamicsWorld->getDispatchInfo().m_allowedCcdPenetration;
+	btScalar maxRescueSpeed = 0.0f;
+
+	// Read every updated manifold once, merging manifolds of the same pair (of compound shapes, for instance).
+	// Only manifolds of awake objects are updated, so they're taken from their lists rather than from the world,
+	// where most manifolds are usually between sleeping objects and the static world.
+	m_ContactAggregates.resizeNoInitialize(0);
+	// Objects woken up by Bullet in this PSI may be added while iterating.
+	for (int objectIndex = 0; objectIndex < m_ActiveNonStaticObjects.Count(); ++objectIndex) {
+		CPhysicsObject *activeObject = static_cast<CPhysicsObject *>(m_ActiveNonStaticObjects[objectIndex]);
+		const btRigidBody *activeBody = activeObject->GetRigidBody();
+		if (!activeBody->isActive()) {
+			continue; // Fell asleep in this PSI, pairs with awake objects are read from their side.
+		}
+		const CUtlVector<btPersistentManifold *> &manifolds = activeObject->GetContactManifolds();
+		int manifoldCount = manifolds.Count();
+		for (int manifoldIndex = 0; manifoldIndex < manifoldCount; ++manifoldIndex) {
+			const btPersistentManifold *manifold = manifolds[manifoldIndex];
+			const btCollisionObject *body0 = manifold->getBody0(), *body1 = manifold->getBody1();
+			IPhysicsObject *object0 = reinterpret_cast<IPhysicsObject *>(body0->getUserPointer());
+			IPhysicsObject *object1 = reinterpret_cast<IPhysicsObject *>(body1->getUserPointer());
+			if (object0 == nullptr || object1 == nullptr) {
 				continue;
 			}
-			trigger = object0;
-			object = object1;
-		} else if (object1->IsTrigger()) {
-			if (object0->IsTrigger()) {
+			CPhysicsObject *otherObject = static_cast<CPhysicsObject *>(body0 != activeBody ? object0 : object1);
+			if (!otherObject->IsStatic() && !otherObject->IsAsleep()) {
+				// Pairs of awake objects are read from the side of the first one. Objects woken up by Bullet
+				// in this PSI would only be added when their motion states are synchronized, after this.
+				NotifyObjectActive(otherObject);
+				if (body0 != activeBody) {
+					continue;
+				}
+			}
+			int contactCount = manifold->getNumContacts();
+			if (gatherStats) {
+				// Manifolds exist for pairs the narrowphase has checked, even if they aren't touching.
+				if (object0->IsStatic() || object1->IsStatic()) {
+					++m_Stats.potentialCollisionsObjectVsWorld;
+				} else {
+					++m_Stats.potentialCollisionsObjectVsObject;
+				}
+				m_Stats.impactCollisionChecks += contactCount;
+			}
+			if (contactCount == 0) {
 				continue;
 			}
-			trigger = object1;
-			object = object0;
-		} else {
-			continue;
+			// Bullet's normal points from B to A, the game expects it to point towards the second object.
+			btScalar normalSign = -1.0f;
+			if (object1 < object0) {
+				std::swap(object0, object1);
+				normalSign = 1.0f;
+			}
+
+			// Touches and friction are only gathered for pairs that may have events reported for them.
+			// Impacts and deep penetrations of other pairs are still aggregated for the collision limit.
+			bool wantsEvents = reportEvents &&
+					((object0->GetCallbackFlags() | object1->GetCallbackFlags()) &
+					(CALLBACK_GLOBAL_TOUCH | CALLBACK_GLOBAL_COLLISION | CALLBACK_GLOBAL_FRICTION));
+			bool gatherFriction = (wantsEvents || gatherStats);
+			const btManifoldPoint &firstPoint = manifold->getContactPoint(0);
+			int aggregateIndex = -1;
+			if (gatherFriction) {
+				aggregateIndex = GetContactAggregate(object0, object1, firstPoint, normalSign, time);
+			}
+
+			for (int contactIndex = 0; contactIndex < contactCount; ++contactIndex) {
+				const btManifoldPoint &point = manifold->getContactPoint(contactIndex);
+				const btVector3 &position = point.getPositionWorldOnB();
+				btVector3 normal = point.m_normalWorldOnB * normalSign;
+
+				// Points are refreshed once after being added, so new points have the lifetime of 1.
+				bool isNewPoint = (point.getLifeTime() <= 1);
+				if (isNewPoint) {
+					++m_PSICollisionCheckCount;
+				}
+				if (isNewPoint && point.getAppliedImpulse() > 0.0f) {
+					if (gatherStats) {
+						++m_Stats.impactCounter;
+					}
+					if (aggregateIndex < 0) {
+						aggregateIndex = GetContactAggregate(object0, object1, firstPoint, normalSign, time);
+					}
+					ContactAggregate_t &aggregate = m_ContactAggregates[aggregateIndex];
+					if (point.getAppliedImpulse() > aggregate.m_ImpactImpulse) {
+						aggregate.m_ImpactImpulse = point.getAppliedImpulse();
+						aggregate.m_ImpactPoint = position;
+						aggregate.m_ImpactNormal = normal;
+					}
+				}
+
+				btScalar distance = point.getDistance();
+				if (distance < hardRescueDistance) {
+					if (aggregateIndex < 0) {
+						aggregateIndex = GetContactAggregate(object0, object1, firstPoint, normalSign, time);
+					}
+					m_ContactAggregates[aggregateIndex].m_Penetrating = true;
+				}
+				if (gatherStats && distance < 0.0f) {
+					maxRescueSpeed = btMax(maxRescueSpeed, -distance * rescueSpeedPerDepth);
+					if (distance < hardRescueDistance) {
+						if (isNewPoint) {
+							++m_Stats.impactHardRescueCount;
+						} else {
+							++m_Stats.impactRescueAfterCount;
+						}
+					}
+				}
+
+				if (!gatherFriction) {
+					continue;
+				}
+				btScalar frictionImpulse = btSqrt(point.m_appliedImpulseLateral1 * point.m_appliedImpulseLateral1 +
+						point.m_appliedImpulseLateral2 * point.m_appliedImpulseLateral2);
+				if (frictionImpulse > 0.0f) {
+					ContactAggregate_t &aggregate = m_ContactAggregates[aggregateIndex];
+					btVector3 contactSpeed = static_cast<const CPhysicsObject *>(object1)->GetBulletVelocityAtPoint(position) -
+							static_cast<const CPhysicsObject *>(object0)->GetBulletVelocityAtPoint(position);
+					btVector3 slidingVelocity = contactSpeed - normal * normal.dot(contactSpeed);
+					btScalar pointEnergy = frictionImpulse * slidingVelocity.length();
+					aggregate.m_FrictionEnergy += pointEnergy;
+					if (pointEnergy > aggregate.m_MaxFrictionPointEnergy) {
+						aggregate.m_MaxFrictionPointEnergy = pointEnergy;
+						aggregate.m_FrictionPoint = position;
+						aggregate.m_FrictionNormal = normal;
+						aggregate.m_FrictionContactSpeed = contactSpeed;
+					}
+				}
+			}
 		}
-		if (object->IsStatic()) {
-			continue;
+	}
+
+	if (gatherStats) {
+		m_Stats.maxRescueSpeed = MAX(m_Stats.maxRescueSpeed, (float) BULLET2HL(maxRescueSpeed));
+	}
+
+	// Create one event of each kind for every pair.
+	btScalar minImpactEnergy = physics_bullet_impact_min_energy.GetFloat();
+	btScalar minFrictionEnergy = physics_bullet_friction_min_energy.GetFloat();
+	int aggregateCount = m_ContactAggregates.size();
+	for (int aggregateIndex = 0; aggregateIndex < aggregateCount; ++aggregateIndex) {
+		const ContactAggregate_t &aggregate = m_ContactAggregates[aggregateIndex];
+		CPhysicsPairHash<ContactPairData_t>::Pair &pair = m_ContactPairs.GetPair(aggregate.m_PairIndex);
+		ContactPairData_t &pairData = pair.m_Data;
+		pairData.m_AggregateIndex = -1;
+		IPhysicsObject *object0 = pair.m_Objects[0], *object1 = pair.m_Objects[1];
+		const CPhysicsObject *physicsObjects[2] = {
+			static_cast<const CPhysicsObject *>(object0),
+			static_cast<const CPhysicsObject *>(object1)
+		};
+
+		if (!pairData.m_Touching) {
+			pairData.m_Touching = true;
+			if (reportEvents &&
+					ObjectWantsCollisionEvents(object0, object1, CALLBACK_GLOBAL_TOUCH, CALLBACK_GLOBAL_TOUCH_STATIC) &&
+					ObjectWantsCollisionEvents(object1, object0, CALLBACK_GLOBAL_TOUCH, CALLBACK_GLOBAL_TOUCH_STATIC)) {
+				pairData.m_TouchReported = true;
+				CollisionEvent_t &event = AddCollisionEvent(CollisionEvent_t::TYPE_START_TOUCH, object0, object1);
+				event.m_ContactPoint = aggregate.m_ImpactPoint;
+				event.m_SurfaceNormal = aggregate.m_ImpactNormal;
+			}
 		}
 
-		TriggerTouch_t newTouch(trigger, object);
-		unsigned short foundIndex = m_TriggerTouches.Find(newTouch);
-		btScalar maxDistance = 0.0f;
-		if (foundIndex != m_TriggerTouches.InvalidIndex()) {
-			if (m_TriggerTouches[foundIndex].m_TouchingThisTick) {
-				continue;
+		if (aggregate.m_ImpactImpulse > 0.0f) {
+			if (gatherStats) {
+				if (object0->IsStatic() || object1->IsStatic()) {
+					++m_Stats.impactStaticCount;
+				}
+				// Kinetic energy lost in a perfectly inelastic impact.
+				m_Stats.totalEnergyDestroyed += 0.5 * aggregate.m_ImpactImpulse * aggregate.m_ImpactImpulse *
+						(physicsObjects[0]->GetBulletInvMass() + physicsObjects[1]->GetBulletInvMass());
+			}
+			if (reportEvents &&
+					ObjectWantsCollisionEvents(object0, object1, CALLBACK_GLOBAL_COLLISION, CALLBACK_GLOBAL_COLLIDE_STATIC) &&
+					ObjectWantsCollisionEvents(object1, object0, CALLBACK_GLOBAL_COLLISION, CALLBACK_GLOBAL_COLLIDE_STATIC)) {
+				// Energy per kilogram received by an object is (impulse / mass)^2 / 2.
+				btScalar maxVelocityChange = aggregate.m_ImpactImpulse *
+						btMax(physicsObjects[0]->GetBulletInvMass(), physicsObjects[1]->GetBulletInvMass());
+				if (0.5f * maxVelocityChange * maxVelocityChange >= minImpactEnergy) {
+					CollisionEvent_t &event = AddCollisionEvent(CollisionEvent_t::TYPE_COLLISION, object0, object1);
+					event.m_IsShadowCollision =
+							((object0->GetCallbackFlags() | object1->GetCallbackFlags()) & CALLBACK_SHADOW_COLLISION) != 0;
+					event.m_DeltaCollisionTime = (float) (time - pairData.m_LastImpactTime);
+					pairData.m_LastImpactTime = time;
+					event.m_ContactPoint = aggregate.m_ImpactPoint;
+					event.m_SurfaceNormal = aggregate.m_ImpactNormal;
+					btVector3 preContactVelocities[2];
+					for (int objectIndex = 0; objectIndex < 2; ++objectIndex) {
+						const CPhysicsObject *physicsObject = physicsObjects[objectIndex];
+						physicsObject->GetPrePSIVelocity(
+								event.m_PreLinearVelocities[objectIndex], event.m_PreAngularVelocities[objectIndex]);
+						event.m_PostLinearVelocities[objectIndex] = physicsObject->GetBulletLinearVelocity();
+						event.m_PostAngularVelocities[objectIndex] = physicsObject->GetBulletAngularVelocity();
+						btVector3 relativePosition = aggregate.m_ImpactPoint -
+								physicsObject->GetCollisionObject()->getWorldTransform().getOrigin();
+						preContactVelocities[objectIndex] = event.m_PreLinearVelocities[objectIndex] +
+								event.m_PreAngularVelocities[objectIndex].cross(relativePosition);
+					}
+					event.m_ContactSpeed = preContactVelocities[1] - preContactVelocities[0];
+					event.m_CollisionSpeed = BULLET2HL(btMax(-aggregate.m_ImpactNormal.dot(event.m_ContactSpeed), btScalar(0.0f)));
+				}
 			}
-			maxDistance = 0.1f;
 		}
 
-		for (int contactIndex = 0; contactIndex < contactCount; ++contactIndex) {
-			if (manifold->getContactPoint(contactIndex).getDistance() < maxDistance) {
-				if (foundIndex != m_TriggerTouches.InvalidIndex()) {
-					m_TriggerTouches[foundIndex].m_TouchingThisTick = true;
+		if (aggregate.m_FrictionEnergy > 0.0f) {
+			if (gatherStats) {
+				m_Stats.totalEnergyDestroyed += aggregate.m_FrictionEnergy;
+			}
+			for (int objectIndex = 0; objectIndex < 2; ++objectIndex) {
+				IPhysicsObject *object = pair.m_Objects[objectIndex], *otherObject = pair.m_Objects[objectIndex ^ 1];
+				if (!reportEvents || object->IsStatic() ||
+						aggregate.m_FrictionEnergy * physicsObjects[objectIndex]->GetBulletInvMass() < minFrictionEnergy ||
+						!ObjectWantsCollisionEvents(object, otherObject, CALLBACK_GLOBAL_FRICTION, CALLBACK_GLOBAL_FRICTION)) {
+					continue;
+				}
+				++m_Stats.frictionEventsProcessed;
+				CollisionEvent_t &event = AddCollisionEvent(CollisionEvent_t::TYPE_FRICTION, object, otherObject);
+				event.m_FrictionEnergy = (float) aggregate.m_FrictionEnergy;
+				event.m_ContactPoint = aggregate.m_FrictionPoint;
+				if (objectIndex == 0) {
+					event.m_SurfaceNormal = aggregate.m_FrictionNormal;
+					event.m_ContactSpeed = aggregate.m_FrictionContactSpeed;
 				} else {
-					m_TriggerTouches.Insert(newTouch);
-					static_cast<CPhysicsObject *>(object)->AddTriggerTouchReference();
-					if (m_CollisionEvents != nullptr) {
-						m_CollisionEvents->ObjectEnterTrigger(trigger, object);
-					}
+					event.m_SurfaceNormal = -aggregate.m_FrictionNormal;
+					event.m_ContactSpeed = -aggregate.m_FrictionContactSpeed;
 				}
-				break;
 			}
 		}
 	}
 
-	unsigned short index = m_TriggerTouches.FirstInorder();
-	while (m_TriggerTouches.IsValidIndex(index)) {
-		unsigned short next = m_TriggerTouches.NextInorder(index);
-		TriggerTouch_t &touch = m_TriggerTouches[index];
-		if (!touch.m_TouchingThisTick) {
-			static_cast<CPhysicsObject *>(touch.m_Object)->RemoveTriggerTouchReference();
-			if (m_CollisionEvents != nullptr) {
-				m_CollisionEvents->ObjectLeaveTrigger(touch.m_Trigger, touch.m_Object);
+	// End touches of pairs not in contact anymore, and forget the pairs not in contact for some time.
+	int pairCount = m_ContactPairs.GetPairArraySize();
+	for (int pairIndex = 0; pairIndex < pairCount; ++pairIndex) {
+		if (!m_ContactPairs.IsPairUsed(pairIndex)) {
+			continue;
+		}
+		CPhysicsPairHash<ContactPairData_t>::Pair &pair = m_ContactPairs.GetPair(pairIndex);
+		ContactPairData_t &pairData = pair.m_Data;
+		if (pairData.m_LastContactTime >= time) {
+			continue;
+		}
+		if (pairData.m_Touching) {
+			if (pair.m_Objects[0]->IsAsleep() && pair.m_Objects[1]->IsAsleep()) {
+				continue;
+			}
+			pairData.m_Touching = false;
+			if (pairData.m_TouchReported) {
+				pairData.m_TouchReported = false;
+				AddCollisionEvent(CollisionEvent_t::TYPE_END_TOUCH, pair.m_Objects[0], pair.m_Objects[1]);
 			}
-			m_TriggerTouches.RemoveAt(index);
-		} else {
-			touch.m_TouchingThisTick = false;
 		}
-		index = next;
+		// Keeping the time of the last impact while the objects may still be bouncing off each other.
+		if (time - btMax(pairData.m_LastContactTime, pairData.m_LastImpactTime) > 1.0f) {
+			m_ContactPairs.RemovePair(pairIndex);
+		}
+	}
+
+	if (reportEvents) {
+		AddCollisionEvent(CollisionEvent_t::TYPE_POST_SIMULATION_FRAME, nullptr, nullptr);
 	}
 }
 
-void CPhysicsEnvironment::NotifyTriggerRemoved(IPhysicsObject *trigger) {
-	unsigned short index = m_TriggerTouches.FirstInorder();
-	while (m_TriggerTouches.IsValidIndex(index)) {
-		unsigned short next = m_TriggerTouches.NextInorder(index);
-		TriggerTouch_t &touch = m_TriggerTouches[index];
-		if (touch.m_Trigger > trigger) {
+void CPhysicsEnvironment::FreezeObjectsOverCollisionLimit() {
+	// Like in IVP, objects colliding too much in one PSI, usually stuck in a pile or inside other objects,
+	// are frozen rather than being jittered there forever at the cost of the whole frame.
+	int aggregateCount = m_ContactAggregates.size();
+	int aggregateIndex;
+	for (aggregateIndex = 0; aggregateIndex < aggregateCount; ++aggregateIndex) {
+		const ContactAggregate_t &aggregate = m_ContactAggregates[aggregateIndex];
+		if (aggregate.m_ImpactImpulse <= 0.0f && !aggregate.m_Penetrating) {
+			continue;
+		}
+		const CPhysicsPairHash<ContactPairData_t>::Pair &pair = m_ContactPairs.GetPair(aggregate.m_PairIndex);
+		for (int objectIndex = 0; objectIndex < 2; ++objectIndex) {
+			CPhysicsObject *object = static_cast<CPhysicsObject *>(pair.m_Objects[objectIndex]);
+			if (!object->IsStatic()) {
+				object->IncrementPSICollisionCount();
+			}
+		}
+	}
+
+	int maxCollisions = m_PerformanceSettings.maxCollisionsPerObjectPerTimestep;
+	// Asking the game for more checks after the narrowphase, so this works with the worker threads too.
+	int checkCount = m_PSICollisionCheckCount;
+	int checkLimit = m_PerformanceSettings.maxCollisionChecksPerTimestep;
+	if (checkCount > checkLimit && m_CollisionSolver != nullptr) {
+		int additionalChecks = m_CollisionSolver->AdditionalCollisionChecksThisTick(checkCount);
+		if (additionalChecks > 0) {
+			checkLimit += additionalChecks;
+		}
+	}
+	if (checkCount > checkLimit) {
+		// Over the budget - lower the per-object limit proportionally, so the objects in the most collisions,
+		// which are what makes the narrowphase expensive, are frozen first, regardless of the pair order.
+		int scaledMaxCollisions = (int) ((int64) maxCollisions * checkLimit / checkCount);
+		maxCollisions = btMax(scaledMaxCollisions, btMin(maxCollisions, 1));
+	}
+	for (aggregateIndex = 0; aggregateIndex < aggregateCount; ++aggregateIndex) {
+		const ContactAggregate_t &aggregate = m_ContactAggregates[aggregateIndex];
+		if (aggregate.m_ImpactImpulse <= 0.0f && !aggregate.m_Penetrating) {
+			continue;
+		}
+		const CPhysicsPairHash<ContactPairData_t>::Pair &pair = m_ContactPairs.GetPair(aggregate.m_PairIndex);
+		for (int objectIndex = 0; objectIndex < 2; ++objectIndex) {
+			CPhysicsObject *object = static_cast<CPhysicsObject *>(pair.m_Objects[objectIndex]);
+			if (object->IsStatic()) {
+				continue;
+			}
+			// Zero if already handled in another pair.
+			int collisionCount = object->GetPSICollisionCount();
+			if (collisionCount == 0) {
+				continue;
+			}
+			object->ResetPSICollisionCount();
+			if (collisionCount > maxCollisions && !object->IsAsleep() &&
+					(m_CollisionSolver == nullptr || m_CollisionSolver->ShouldFreezeObject(object))) {
+				// Stays asleep until woken up by the game, the sleep event is sent when the active objects are updated.
+				object->Sleep();
+			}
+		}
+	}
+}
+
+void CPhysicsEnvironment::RemoveContactPairsForObject(IPhysicsObject *object) {
+	// Not reporting the end of touches with the object being removed, like IVP.
+	int pairIndex = m_ContactPairs.GetFirstPairForObject(object);
+	while (pairIndex >= 0) {
+		int nextPairIndex = m_ContactPairs.GetNextPairForObject(pairIndex, object);
+		m_ContactPairs.RemovePair(pairIndex);
+		pairIndex = nextPairIndex;
+	}
+}
+
+void CPhysicsEnvironment::DeliverCollisionEvents() {
+	IPhysicsCollisionEvent *handler = m_CollisionEvents;
+	if (handler == nullptr) {
+		m_CollisionEventBuffer.resizeNoInitialize(0);
+		DeleteObjectsReferencedByEvents();
+		return;
+	}
+
+	// Objects destroyed by the game in the callbacks are only queued for removal, so events stay valid.
+	m_DeliveringCollisionEvents = true;
+	int eventCount = m_CollisionEventBuffer.size();
+	for (int eventIndex = 0; eventIndex < eventCount; ++eventIndex) {
+		const CollisionEvent_t &event = m_CollisionEventBuffer[eventIndex];
+		CollisionData data(event);
+		CPhysicsObject *object0 = static_cast<CPhysicsObject *>(event.m_Objects[0]);
+		CPhysicsObject *object1 = static_cast<CPhysicsObject *>(event.m_Objects[1]);
+		if (object0 != nullptr && ((object0->GetCallbackFlags() | object1->GetCallbackFlags()) &
+				CALLBACK_MARKED_FOR_DELETE)) {
+			continue;
+		}
+		switch (event.m_Type) {
+		case CollisionEvent_t::TYPE_COLLISION: {
+			vcollisionevent_t collisionEvent;
+			collisionEvent.pObjects[0] = object0;
+			collisionEvent.pObjects[1] = object1;
+			collisionEvent.surfaceProps[0] = event.m_SurfaceProps[0];
+			collisionEvent.surfaceProps[1] = event.m_SurfaceProps[1];
+			collisionEvent.isCollision = true;
+			collisionEvent.isShadowCollision = event.m_IsShadowCollision;
+			collisionEvent.deltaCollisionTime = event.m_DeltaCollisionTime;
+			collisionEvent.collisionSpeed = 0.0f;
+			collisionEvent.pInternalData = &data;
+			object0->SetEventVelocity(&event.m_PreLinearVelocities[0], &event.m_PreAngularVelocities[0]);
+			object1->SetEventVelocity(&event.m_PreLinearVelocities[1], &event.m_PreAngularVelocities[1]);
+			handler->PreCollision(&collisionEvent);
+			collisionEvent.collisionSpeed = event.m_CollisionSpeed;
+			object0->SetEventVelocity(&event.m_PostLinearVelocities[0], &event.m_PostAngularVelocities[0]);
+			object1->SetEventVelocity(&event.m_PostLinearVelocities[1], &event.m_PostAngularVelocities[1]);
+			handler->PostCollision(&collisionEvent);
+			object0->SetEventVelocity(nullptr, nullptr);
+			object1->SetEventVelocity(nullptr, nullptr);
 			break;
 		}
-		if (touch.m_Trigger == trigger) {
-			static_cast<CPhysicsObject *>(touch.m_Object)->RemoveTriggerTouchReference();
-			// Not triggering the event since the trigger is removing.
-			m_TriggerTouches.RemoveAt(index);
+		case CollisionEvent_t::TYPE_FRICTION:
+			handler->Friction(object0, event.m_FrictionEnergy, event.m_SurfaceProps[0], event.m_SurfaceProps[1], &data);
+			break;
+		case CollisionEvent_t::TYPE_START_TOUCH:
+			handler->StartTouch(object0, object1, &data);
+			break;
+		case CollisionEvent_t::TYPE_END_TOUCH:
+			handler->EndTouch(object0, object1, &data);
+			break;
+		case CollisionEvent_t::TYPE_POST_SIMULATION_FRAME:
+			handler->PostSimulationFrame();
+			break;
+		default:
+			break;
 		}
-		index = next;
 	}
+	m_CollisionEventBuffer.resizeNoInitialize(0);
+	m_DeliveringCollisionEvents = false;
+	DeleteObjectsReferencedByEvents();
+}
+
+void CPhysicsEnvironment::DeleteObjectsReferencedByEvents() {
+	int objectCount = m_ReleasedObjectsReferencedByEvents.Count();
+	for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex) {
+		m_ReleasedObjectsReferencedByEvents[objectIndex]->DeleteAfterRelease();
+	}
+	m_ReleasedObjectsReferencedByEvents.RemoveAll();
 }
 
-/******************
- * Traces (unused)
- ******************/
+/*********
+ * Traces
+ *********/
+
+// Objects world traces can hit, checked for broadphase proxies before the narrowphase.
+class CPhysicsWorldTraceFilter {
+public:
+	CPhysicsWorldTraceFilter(unsigned int contentsMask, IPhysicsTraceFilter *traceFilter) :
+			m_ContentsMask(contentsMask), m_TraceFilter(traceFilter),
+			m_TraceType(traceFilter != nullptr ? traceFilter->GetTraceType() : VPHYSICS_TRACE_EVERYTHING) {}
+
+	bool ShouldHit(const btBroadphaseProxy *proxy) const {
+		const btCollisionObject *collisionObject = static_cast<const btCollisionObject *>(proxy->m_clientObject);
+		IPhysicsObject *object = reinterpret_cast<IPhysicsObject *>(collisionObject->getUserPointer());
+		if (object == nullptr || !object->IsCollisionEnabled() || !(object->GetContents() & m_ContentsMask)) {
+			return false;
+		}
+		switch (m_TraceType) {
+		case VPHYSICS_TRACE_STATIC_ONLY:
+			if (object->IsMoveable() || object->IsTrigger()) {
+				return false;
+			}
+			break;
+		case VPHYSICS_TRACE_MOVING_ONLY:
+			if (!object->IsMoveable() || object->IsTrigger()) {
+				return false;
+			}
+			break;
+		case VPHYSICS_TRACE_TRIGGERS_ONLY:
+			if (!object->IsTrigger()) {
+				return false;
+			}
+			break;
+		case VPHYSICS_TRACE_STATIC_AND_MOVING:
+			if (object->IsTrigger()) {
+				return false;
+			}
+			break;
+		default:
+			break;
+		}
+		return m_TraceFilter == nullptr || m_TraceFilter->ShouldHitObject(object, m_ContentsMask);
+	}
+
+private:
+	unsigned int m_ContentsMask;
+	IPhysicsTraceFilter *m_TraceFilter;
+	PhysicsTraceType_t m_TraceType;
+};
+
+struct CPhysicsWorldRayTestCallback : public btCollisionWorld::ClosestRayResultCallback {
+	const CPhysicsWorldTraceFilter &m_Filter;
+	CPhysicsWorldRayTestCallback(const btVector3 &from, const btVector3 &to, const CPhysicsWorldTraceFilter &filter) :
+			ClosestRayResultCallback(from, to), m_Filter(filter) {}
+	virtual bool needsCollision(btBroadphaseProxy *proxy0) const {
+		return m_Filter.ShouldHit(proxy0);
+	}
+};
+
+struct CPhysicsWorldConvexTestCallback : public btCollisionWorld::ClosestConvexResultCallback {
+	const CPhysicsWorldTraceFilter &m_Filter;
+	CPhysicsWorldConvexTestCallback(const btVector3 &from, const btVector3 &to,
+			const CPhysicsWorldTraceFilter &filter) :
+			ClosestConvexResultCallback(from, to), m_Filter(filter) {}
+	virtual bool needsCollision(btBroadphaseProxy *proxy0) const {
+		return m_Filter.ShouldHit(proxy0);
+	}
+};
+
+// For startsolid, as ray and convex tests don't report starting in a solid.
+struct CPhysicsWorldContactTestCallback : public btCollisionWorld::ContactResultCallback {
+	const CPhysicsWorldTraceFilter &m_Filter;
+	const btCollisionObject *m_TestObject;
+	const btCollisionObject *m_HitObject;
+	btScalar m_DeepestHitDistance;
+	btVector3 m_DeepestHitNormal;
+	btVector3 m_DeepestHitPoint;
+
+	CPhysicsWorldContactTestCallback(const btCollisionObject *testObject, const CPhysicsWorldTraceFilter &filter) :
+			m_Filter(filter), m_TestObject(testObject), m_HitObject(nullptr),
+			m_DeepestHitDistance(-2.0f * VPHYSICS_CONVEX_DISTANCE_MARGIN) {}
+
+	virtual bool needsCollision(btBroadphaseProxy *proxy0) const {
+		return m_Filter.ShouldHit(proxy0);
+	}
+
+	virtual btScalar addSingleResult(btManifoldPoint &cp,
+			const btCollisionObjectWrapper *colObj0Wrap, int partId0, int index0,
+			const btCollisionObjectWrapper *colObj1Wrap, int partId1, int index1) {
+		// Testing penetration, not touches.
+		btScalar distance = cp.getDistance();
+		if (distance >= m_DeepestHitDistance) {
+			return 0.0f;
+		}
+		m_DeepestHitDistance = distance;
+		if (colObj0Wrap->getCollisionObject() != m_TestObject) {
+			m_HitObject = colObj0Wrap->getCollisionObject();
+			m_DeepestHitNormal = -cp.m_normalWorldOnB;
+			m_DeepestHitPoint = cp.getPositionWorldOnA();
+		} else {
+			m_HitObject = colObj1Wrap->getCollisionObject();
+			m_DeepestHitNormal = cp.m_normalWorldOnB;
+			m_DeepestHitPoint = cp.getPositionWorldOnB();
+		}
+		return 0.0f;
+	}
+};
+
+void CPhysicsEnvironment::WriteTraceResult(const btCollisionObject *hitObject,
+		const btVector3 &hitNormal, const btVector3 &hitPoint, const btVector3 &delta,
+		const Vector &startPosition, const Vector &deltaHL, trace_t *pTrace) {
+	btVector3 normal = hitNormal;
+	if (hitObject == nullptr || normal.fuzzyZero()) {
+		btScalar deltaLength2 = delta.length2();
+		if (deltaLength2 > 1e-6f) {
+			normal = delta / -btSqrt(deltaLength2);
+		} else {
+			normal.setValue(-1.0f, 0.0f, 0.0f);
+		}
+	}
+	pTrace->startpos = startPosition;
+	VectorMA(startPosition, pTrace->fraction, deltaHL, pTrace->endpos);
+	ConvertDirectionToHL(normal, pTrace->plane.normal);
+	Vector hitPointHL;
+	ConvertPositionToHL(hitPoint, hitPointHL);
+	pTrace->plane.dist = DotProduct(hitPointHL, pTrace->plane.normal);
+	if (hitObject != nullptr) {
+		IPhysicsObject *object = reinterpret_cast<IPhysicsObject *>(hitObject->getUserPointer());
+		pTrace->contents = object->GetContents();
+		pTrace->surface.surfaceProps = (unsigned short) object->GetMaterialIndex();
+		// In Source, the game data of entity physics objects is the entity.
+		pTrace->m_pEnt = reinterpret_cast<CBaseEntity *>(object->GetGameData());
+	}
+}
 
 void CPhysicsEnvironment::TraceRay(const Ray_t &ray, unsigned int fMask, IPhysicsTraceFilter *pTraceFilter, trace_t *pTrace) {
-	// Not implemented in IVP VPhysics, can be implemented using rayTest.
+	// Not implemented in IVP VPhysics.
+	CPhysicsTraceContext::ClearTrace(pTrace);
+	AddPendingStaticObjects();
+	CPhysicsWorldTraceFilter filter(fMask, pTraceFilter);
+
+	btVector3 from, delta;
+	ConvertPositionToBullet(ray.m_Start, from);
+	ConvertPositionToBullet(ray.m_Delta, delta);
+	btVector3 to = from + delta;
+	bool isSwept = (delta.length2() > 1e-6f);
+
+	// Starting in a solid.
+	btBoxShape boxShape(btVector3(1.0f, 1.0f, 1.0f));
+	btSphereShape pointShape(VPHYSICS_CONVEX_DISTANCE_MARGIN);
+	if (!ray.m_IsRay) {
+		btVector3 halfExtents;
+		ConvertPositionToBullet(ray.m_Extents, halfExtents);
+		boxShape.setMargin(VPHYSICS_CONVEX_DISTANCE_MARGIN);
+		boxShape.setImplicitShapeDimensions(halfExtents.absolute());
+	}
+	btCollisionObject testObject;
+	testObject.setCollisionShape(ray.m_IsRay ? static_cast<btCollisionShape *>(&pointShape) : &boxShape);
+	testObject.setWorldTransform(btTransform(btMatrix3x3::getIdentity(), from));
+	CPhysicsWorldContactTestCallback contactTestResult(&testObject, filter);
+	m_DynamicsWorld->contactTest(&testObject, contactTestResult);
+
+	const btCollisionObject *hitObject = nullptr;
+	btVector3 hitNormal(0.0f, 0.0f, 0.0f), hitPoint = to;
+	if (contactTestResult.m_HitObject != nullptr) {
+		pTrace->fraction = 0.0f;
+		pTrace->startsolid = pTrace->allsolid = true;
+		hitObject = contactTestResult.m_HitObject;
+		if (ray.m_IsRay) {
+			hitPoint = from;
+		} else {
+			hitNormal = contactTestResult.m_DeepestHitNormal;
+			hitPoint = contactTestResult.m_DeepestHitPoint;
+		}
+	} else if (isSwept) {
+		if (ray.m_IsRay) {
+			CPhysicsWorldRayTestCallback rayTestResult(from, to, filter);
+			m_DynamicsWorld->rayTest(from, to, rayTestResult);
+			if (rayTestResult.m_collisionObject != nullptr) {
+				pTrace->fraction = rayTestResult.m_closestHitFraction;
+				hitObject = rayTestResult.m_collisionObject;
+				hitNormal = rayTestResult.m_hitNormalWorld;
+				hitPoint = rayTestResult.m_hitPointWorld;
+			}
+		} else {
+			CPhysicsWorldConvexTestCallback convexTestResult(from, to, filter);
+			m_DynamicsWorld->convexSweepTest(&boxShape, btTransform(btMatrix3x3::getIdentity(), from),
+					btTransform(btMatrix3x3::getIdentity(), to), convexTestResult,
+					2.0f * VPHYSICS_CONVEX_DISTANCE_MARGIN);
+			if (convexTestResult.m_hitCollisionObject != nullptr) {
+				pTrace->fraction = convexTestResult.m_closestHitFraction;
+				hitObject = convexTestResult.m_hitCollisionObject;
+				hitNormal = convexTestResult.m_hitNormalWorld;
+				hitPoint = convexTestResult.m_hitPointWorld;
+			}
+		}
+	}
+
+	WriteTraceResult(hitObject, hitNormal, hitPoint, delta,
+			ray.m_Start + ray.m_StartOffset, ray.m_Delta, pTrace);
 }
 
 void CPhysicsEnvironment::SweepCollideable(const CPhysCollide *pCollide, const Vector &vecAbsStart, const Vector &vecAbsEnd,
 		const QAngle &vecAngles, unsigned int fMask, IPhysicsTraceFilter *pTraceFilter, trace_t *pTrace) {
 	// Not implemented in IVP VPhysics.
-	// For compound objects, possibly the closest hit of every child can be returned.
+	CPhysicsTraceContext::ClearTrace(pTrace);
+	AddPendingStaticObjects();
+	btCollisionShape *shape = const_cast<btCollisionShape *>(pCollide->GetShape());
+	Assert(shape->isCompound() || shape->isConvex());
+	if (!shape->isCompound() && !shape->isConvex()) {
+		return;
+	}
+	CPhysicsWorldTraceFilter filter(fMask, pTraceFilter);
+
+	btTransform fromTransform;
+	ConvertRotationToBullet(vecAngles, fromTransform.getBasis());
+	ConvertPositionToBullet(vecAbsStart, fromTransform.getOrigin());
+	fromTransform.getOrigin() += fromTransform.getBasis() * pCollide->GetMassCenter();
+	btVector3 delta;
+	ConvertPositionToBullet(vecAbsEnd - vecAbsStart, delta);
+	bool isSwept = (delta.length2() > 1e-6f);
+
+	btCollisionObject testObject;
+	testObject.setCollisionShape(shape);
+	testObject.setWorldTransform(fromTransform);
+	CPhysicsWorldContactTestCallback contactTestResult(&testObject, filter);
+	m_DynamicsWorld->contactTest(&testObject, contactTestResult);
+
+	const btCollisionObject *hitObject = nullptr;
+	btVector3 hitNormal(0.0f, 0.0f, 0.0f), hitPoint = fromTransform.getOrigin() + delta;
+	if (contactTestResult.m_HitObject != nullptr) {
+		pTrace->fraction = 0.0f;
+		pTrace->startsolid = pTrace->allsolid = true;
+		hitObject = contactTestResult.m_HitObject;
+		hitNormal = contactTestResult.m_DeepestHitNormal;
+		hitPoint = contactTestResult.m_DeepestHitPoint;
+	} else if (isSwept) {
+		// Compound children are swept separately, each within the distance not blocked for the previous ones.
+		btVector3 childDelta = delta;
+		const btCompoundShape *compoundShape =
+				shape->isCompound() ? static_cast<const btCompoundShape *>(shape) : nullptr;
+		int childCount = (compoundShape != nullptr ? compoundShape->getNumChildShapes() : 1);
+		for (int childIndex = 0; childIndex < childCount; ++childIndex) {
+			btTransform childFromTransform = fromTransform;
+			const btConvexShape *childShape;
+			if (compoundShape != nullptr) {
+				childFromTransform *= compoundShape->getChildTransform(childIndex);
+				childShape = static_cast<const btConvexShape *>(compoundShape->getChildShape(childIndex));
+			} else {
+				childShape = static_cast<const btConvexShape *>(shape);
+			}
+			btTransform childToTransform(childFromTransform.getBasis(), childFromTransform.getOrigin() + childDelta);
+			CPhysicsWorldConvexTestCallback convexTestResult(
+					childFromTransform.getOrigin(), childToTransform.getOrigin(), filter);
+			m_DynamicsWorld->convexSweepTest(childShape, childFromTransform, childToTransform,
+					convexTestResult, 2.0f * VPHYSICS_CONVEX_DISTANCE_MARGIN);
+			if (convexTestResult.m_hitCollisionObject != nullptr) {
+				pTrace->fraction *= convexTestResult.m_closestHitFraction;
+				childDelta *= convexTestResult.m_closestHitFraction;
+				hitObject = convexTestResult.m_hitCollisionObject;
+				hitNormal = convexTestResult.m_hitNormalWorld;
+				hitPoint = convexTestResult.m_hitPointWorld;
+			}
+		}
+	}
+
+	WriteTraceResult(hitObject, hitNormal, hitPoint, delta, vecAbsStart, vecAbsEnd - vecAbsStart, pTrace);
 }
 
 /**************
@@ -1013,11 +2425,74 @@ void CPhysicsEnvironment::GetPerformanceSettings(physics_performanceparams_t *pO
 }
 
 void CPhysicsEnvironment::SetPerformanceSettings(const physics_performanceparams_t *pSettings) {
+	btScalar oldLookAheadTime = GetContinuousCollisionLookAheadTime();
 	m_PerformanceSettings = *pSettings;
+	if (GetContinuousCollisionLookAheadTime() != oldLookAheadTime) {
+		int objectCount = m_NonStaticObjects.Count();
+		for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex) {
+			static_cast<CPhysicsObject *>(m_NonStaticObjects[objectIndex])->UpdateContinuousCollision();
+		}
+	}
+}
+
+void CPhysicsEnvironment::ReadStats(physics_stats_t *pOutput) {
+	if (pOutput == nullptr) {
+		return;
+	}
+	// Gathered from the first request, not to slow down the simulation when nothing reads them.
+	m_StatsRequested = true;
+	*pOutput = m_Stats;
+	pOutput->collisionPairsTotal = m_Broadphase->getOverlappingPairCache()->getNumOverlappingPairs();
+}
+
+void CPhysicsEnvironment::ClearStats() {
+	memset(&m_Stats, 0, sizeof(m_Stats));
+	m_StatsPSICount = 0;
+	for (int phaseIndex = 0; phaseIndex < PHASE_COUNT; ++phaseIndex) {
+		m_PhaseTimes[phaseIndex].Init();
+	}
 }
 
-/* DUMMY */ void CPhysicsEnvironment::ReadStats(physics_stats_t *pOutput) {
-	if (pOutput != nullptr) {
-		memset(pOutput, 0, sizeof(*pOutput));
+void CPhysicsEnvironment::PrintStats() {
+	static const char * const broadphaseNames[BROADPHASE_COUNT] = {
+		"dynamic AABB trees",
+		"sweep and prune"
+	};
+	static const char * const phaseNames[PHASE_COUNT] = {
+		"Pre-tick callbacks",
+		"Broadphase",
+		"Narrowphase",
+		"Solver",
+		"Integration",
+		"Contacts",
+		"Triggers",
+		"Activation",
+		"Interpolation",
+		"Event delivery"
+	};
+
+	if (!m_StatsRequested) {
+		Msg("Collision statistics are gathered starting from now\n");
+	}
+	physics_stats_t stats;
+	ReadStats(&stats);
+	Msg("%d PSIs, %d objects (%d awake), %d constraints\n", m_StatsPSICount,
+			m_Objects.Count(), m_ActiveNonStaticObjects.Count(), m_ConstraintObjects.Count());
+	Msg("Broadphase (%s) pairs: %d, %d created, %d destroyed\n", broadphaseNames[m_BroadphaseType],
+			stats.collisionPairsTotal, stats.collisionPairsCreated, stats.collisionPairsDestroyed);
+	if (m_BroadphaseType == BROADPHASE_AXIS_SWEEP) {
+		Msg("Sweep and prune handles: %d of %d used\n",
+				m_DynamicsWorld->getNumCollisionObjects(), m_AxisSweepMaxProxies);
+	}
+	Msg("Manifolds: %d object vs object, %d object vs world, %d contact points\n",
+			stats.potentialCollisionsObjectVsObject, stats.potentialCollisionsObjectVsWorld, stats.impactCollisionChecks);
+	Msg("Impacts: %d new points, %d pairs with static objects\n", stats.impactCounter, stats.impactStaticCount);
+	Msg("Penetrations: %d new, %d persistent, max rescue speed %.1f, max speed gain %.1f\n",
+			stats.impactHardRescueCount, stats.impactRescueAfterCount, stats.maxRescueSpeed, stats.maxSpeedGain);
+	Msg("Friction events: %d, energy destroyed: %.1f J\n", stats.frictionEventsProcessed, stats.totalEnergyDestroyed);
+	double psiScale = 1.0 / MAX(m_StatsPSICount, 1);
+	for (int phaseIndex = 0; phaseIndex < PHASE_COUNT; ++phaseIndex) {
+		double phaseTime = m_PhaseTimes[phaseIndex].GetMillisecondsF();
+		Msg("%-20s %10.3f ms, %.4f ms per PSI\n", phaseNames[phaseIndex], phaseTime, phaseTime * psiScale);
 	}
 }
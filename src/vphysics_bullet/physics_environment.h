@@ -5,12 +5,20 @@
 #define PHYSICS_ENVIRONMENT_H
 
 #include "physics_internal.h"
+#include "physics_convexalgorithm.h"
+#include "physics_pairhash.h"
+#include "physics_velocitybatch.h"
 #include "vphysics/friction.h"
 #include "vphysics/performance.h"
+#include "vphysics/stats.h"
 #include "vphysics/vehicles.h"
-#include "tier1/utlrbtree.h"
+#include "tier0/fasttimer.h"
 #include "tier1/utlvector.h"
 
+class CPhysicsObject;
+
+#define VPHYSICS_SHOULD_NOT_COLLIDE_MAX_PAIRS 16384
+
 class CPhysicsEnvironment : public IPhysicsEnvironment {
 public:
 	CPhysicsEnvironment();
@@ -119,8 +127,8 @@ public:
 	virtual void GetPerformanceSettings(physics_performanceparams_t *pOutput) const;
 	virtual void SetPerformanceSettings(const physics_performanceparams_t *pSettings);
 
-	/* DUMMY */ virtual void ReadStats(physics_stats_t *pOutput);
-	/* DUMMY */ virtual void ClearStats() {}
+	virtual void ReadStats(physics_stats_t *pOutput);
+	virtual void ClearStats();
 
 	/* DUMMY */ virtual unsigned int GetObjectSerializeSize(IPhysicsObject *pObject) const { return 0; }
 	/* DUMMY */ virtual void SerializeObjectToBuffer(IPhysicsObject *pObject, unsigned char *pBuffer, unsigned int bufferSize) {}
@@ -143,6 +151,11 @@ public:
 
 	void NotifyObjectRemoving(IPhysicsObject *object);
 
+	// Adds the object to the awake object array if it's not there yet.
+	void NotifyObjectActive(CPhysicsObject *object);
+	// The world only updates the AABBs of active objects, static and sleeping ones are updated when moved.
+	void UpdateInactiveObjectAabb(CPhysicsObject *object);
+
 	void NotifyPlayerControllerAttached(IPhysicsPlayerController *controller);
 	void NotifyPlayerControllerDetached(IPhysicsPlayerController *controller);
 
@@ -157,7 +170,8 @@ public:
 	IPhysicsFrictionSnapshot *CreateFrictionSnapshot(IPhysicsObject *object);
 	void DestroyFrictionSnapshot(IPhysicsFrictionSnapshot *snapshot);
 
-	void NotifyTriggerRemoved(IPhysicsObject *trigger);
+	// Called when an object becomes a trigger or stops being one - its touches are rebuilt from existing pairs.
+	void NotifyTriggerStateChanged(IPhysicsObject *object);
 
 	IPhysicsConstraint *CreateSuspensionConstraint(
 			IPhysicsObject *objectReference, IPhysicsObject *objectAttached,
@@ -170,16 +184,67 @@ public:
 	FORCEINLINE btScalar GetMaxAngularSpeed() const {
 		return DEG2RAD(m_PerformanceSettings.maxAngularVelocity);
 	}
+	// IVP predicted collisions of objects against the world and against each other separately within the look-ahead
+	// times, while Bullet sweeps fast objects against both at once, so the longer one is used. Zero if disabled.
+	FORCEINLINE btScalar GetContinuousCollisionLookAheadTime() const {
+		return btMax(btMax(m_PerformanceSettings.lookAheadTimeObjectsVsWorld,
+				m_PerformanceSettings.lookAheadTimeObjectsVsObject), 0.0f);
+	}
 
 	// Destruction permitting calling back through virtual functions.
 	void Release();
 
+	// Broadphases selectable when an environment is created.
+	enum Broadphase_t {
+		BROADPHASE_DBVT, // Dynamic AABB trees, separate for moving and static objects.
+		BROADPHASE_AXIS_SWEEP, // Sweep and prune quantized to the world bounds.
+
+		BROADPHASE_COUNT
+	};
+
+	// Stages of the simulation timed since the last ClearStats.
+	enum Phase_t {
+		PHASE_PRE_TICK,
+		PHASE_BROADPHASE,
+		PHASE_NARROWPHASE,
+		PHASE_SOLVER,
+		PHASE_INTEGRATION,
+		PHASE_COLLISION_EVENTS,
+		PHASE_TRIGGERS,
+		PHASE_ACTIVATION,
+		PHASE_INTERPOLATION,
+		PHASE_EVENT_DELIVERY,
+
+		PHASE_COUNT
+	};
+	FORCEINLINE CCycleCount *GetPhaseTime(Phase_t phase) { return &m_PhaseTimes[phase]; }
+	void PrintStats();
+
 private:
 	btDefaultCollisionConfiguration *m_CollisionConfiguration;
 	btCollisionDispatcher *m_Dispatcher;
-	btDbvtBroadphase *m_Broadphase;
-	btSequentialImpulseConstraintSolver *m_Solver;
-	btDiscreteDynamicsWorld *m_DynamicsWorld;
+	CPhysicsConvexConvexAlgorithm::CreateFunc m_ConvexConvexCreateFunc;
+	btBroadphaseInterface *m_Broadphase;
+	Broadphase_t m_BroadphaseType;
+	// Sweep and prune has a fixed number of handles, objects beyond it are kept out of the world.
+	int m_AxisSweepMaxProxies;
+	bool m_AxisSweepFullReported;
+	// Sweep and prune quantizes coordinates within its bounds, which are the maximum map extents until the static
+	// objects of the map are added, and then are fitted around them, with the existing proxies moved over.
+	bool m_AxisSweepFitted;
+	void FitAxisSweepToPendingStaticObjects();
+	FORCEINLINE btDbvtBroadphase *GetDbvtBroadphase() const {
+		return (m_BroadphaseType == BROADPHASE_DBVT ? static_cast<btDbvtBroadphase *>(m_Broadphase) : nullptr);
+	}
+	// Puts the proxy of a static object into the tree of static objects without waiting for it to stay still.
+	void MoveToFixedSet(btBroadphaseProxy *proxy);
+	btConstraintSolver *m_Solver;
+	btDiscreteDynamicsWorld *m_DynamicsWorld; // CPhysicsDynamicsWorld.
+	// Whether the Mt variants of the dispatcher, the solver and the world are used.
+	bool m_Multithreaded;
+	void DeleteWorld();
+	// Quick delete teardown - destroys the world as a whole, then frees the constraints and the objects.
+	void ReleaseWorldQuick();
 
 	class DebugDrawer : public btIDebugDraw {
 	public:
@@ -203,12 +268,21 @@ private:
 	float m_AirDensity;
 
 	void AddObject(IPhysicsObject *object);
+	void AddCollisionObjectToWorld(CPhysicsObject *object);
+	void RemoveFromObjectList(CPhysicsObject *object);
+	void RemoveFromNonStaticObjectList(CPhysicsObject *object);
+	void RemoveActiveObject(CPhysicsObject *object);
 	void UpdateActiveObjects();
-	void UpdateNonStaticObjectsAfterPSI();
 	void WakeContactingObjects(IPhysicsObject *object);
 	CUtlVector<IPhysicsObject *> m_Objects; // Doesn't include objects in the deletion queue!
 	CUtlVector<IPhysicsObject *> m_NonStaticObjects;
+	// Objects that may be awake - updated incrementally, so per-PSI work scales with awake objects only.
+	// Objects woken up are added immediately, objects that have fallen asleep are removed after PSIs.
 	CUtlVector<IPhysicsObject *> m_ActiveNonStaticObjects;
+	// Static objects created outside the simulation, such as the map on load, not in the world yet.
+	// Added together before anything needs them, building the static broadphase tree once.
+	CUtlVector<CPhysicsObject *> m_PendingStaticObjects;
+	void AddPendingStaticObjects();
 	IPhysicsObjectEvent *m_ObjectEvents;
 	bool m_QueueDeleteObject;
 	CUtlVector<IPhysicsObject *> m_DeadObjects;
@@ -227,6 +301,20 @@ private:
 	TickActionInterface m_TickAction;
 
 	IPhysicsCollisionSolver *m_CollisionSolver;
+	// Pairs the game's ShouldCollide rejected, kept until the collision rules of either object are rechecked,
+	// since rejected pairs are tested again every time bounding boxes start overlapping.
+	// Accepted pairs aren't cached - they stay in the broadphase until the boxes separate anyway,
+	// and the game may disable collisions between the objects later.
+	struct ShouldNotCollidePairData_t {};
+	CPhysicsPairHash<ShouldNotCollidePairData_t> m_ShouldNotCollidePairs; // The object with the lower address is the first.
+	bool ShouldCollide(IPhysicsObject *object0, IPhysicsObject *object1);
+	void RemoveShouldNotCollidePairsForObject(IPhysicsObject *object);
+	void RemoveAllShouldNotCollidePairs();
+	// New contact points within the current PSI, compared to maxCollisionChecksPerTimestep after the narrowphase.
+	// IVP counts the impact checks of approaching objects, which new contacts correspond to most closely -
+	// every overlapping pair is dispatched every PSI in Bullet, so counting dispatches would freeze piles early.
+	int m_PSICollisionCheckCount;
+	// Static object pairs and objects with collisions disabled are rejected by the proxy groups and masks first.
 	struct OverlapFilterCallback : public btOverlapFilterCallback {
 		OverlapFilterCallback(CPhysicsEnvironment *environment) : m_Environment(environment) {}
 		virtual bool needBroadphaseCollision(btBroadphaseProxy *proxy0, btBroadphaseProxy *proxy1) const;
@@ -237,6 +325,81 @@ private:
 
 	IPhysicsCollisionEvent *m_CollisionEvents;
 
+	// Collision events are gathered from the manifolds after every PSI, aggregated per object pair,
+	// and delivered to the game after the simulation, so the game can't modify the world during it.
+	struct CollisionEvent_t {
+		enum Type_t {
+			TYPE_COLLISION,
+			TYPE_FRICTION, // The first object is the one that scraped.
+			TYPE_START_TOUCH,
+			TYPE_END_TOUCH,
+			TYPE_POST_SIMULATION_FRAME
+		};
+		Type_t m_Type;
+		IPhysicsObject *m_Objects[2];
+		int m_SurfaceProps[2];
+		bool m_IsShadowCollision;
+		float m_DeltaCollisionTime;
+		float m_CollisionSpeed;
+		float m_FrictionEnergy;
+		btVector3 m_ContactPoint;
+		btVector3 m_SurfaceNormal; // Towards the second object.
+		btVector3 m_ContactSpeed; // Of the second object relative to the first.
+		// World velocities of the objects before and after the impact, reported by GetVelocity in the callbacks.
+		btVector3 m_PreLinearVelocities[2], m_PreAngularVelocities[2];
+		btVector3 m_PostLinearVelocities[2], m_PostAngularVelocities[2];
+	};
+	class CollisionData : public IPhysicsCollisionData {
+	public:
+		CollisionData(const CollisionEvent_t &event) : m_Event(event) {}
+		virtual void GetSurfaceNormal(Vector &out);
+		virtual void GetContactPoint(Vector &out);
+		virtual void GetContactSpeed(Vector &out);
+	private:
+		const CollisionEvent_t &m_Event;
+	};
+	// Reused between simulations, so events are only allocated when a simulation produces more than ever before.
+	btAlignedObjectArray<CollisionEvent_t> m_CollisionEventBuffer;
+	bool m_DeliveringCollisionEvents;
+	CollisionEvent_t &AddCollisionEvent(CollisionEvent_t::Type_t type, IPhysicsObject *object0, IPhysicsObject *object1);
+	void DeliverCollisionEvents();
+	// Objects released between PSIs while events of the previous ones were buffered, freed after the delivery.
+	// Marked for deletion, so the events referencing them are skipped.
+	CUtlVector<CPhysicsObject *> m_ReleasedObjectsReferencedByEvents;
+	void DeleteObjectsReferencedByEvents();
+
+#ifndef BT_USE_DOUBLE_PRECISION
+	// Reused between ticks for the velocity stages of the pre-tick.
+	CPhysicsVelocityBatch m_VelocityBatch;
+#endif
+
+	// Persistent contact state of object pairs, for touch events and the time between impacts.
+	struct ContactPairData_t {
+		btScalar m_LastContactTime, m_LastImpactTime;
+		int m_AggregateIndex; // In m_ContactAggregates during the PSI, -1 otherwise.
+		bool m_Touching;
+		bool m_TouchReported;
+	};
+	CPhysicsPairHash<ContactPairData_t> m_ContactPairs; // The object with the lower address is the first.
+	// Strongest new contact and friction of each pair in contact within the current PSI.
+	struct ContactAggregate_t {
+		int m_PairIndex;
+		btScalar m_ImpactImpulse;
+		btVector3 m_ImpactPoint, m_ImpactNormal;
+		bool m_Penetrating; // Deeper than the hard rescue distance.
+		btScalar m_FrictionEnergy, m_MaxFrictionPointEnergy;
+		btVector3 m_FrictionPoint, m_FrictionNormal, m_FrictionContactSpeed;
+	};
+	btAlignedObjectArray<ContactAggregate_t> m_ContactAggregates;
+	// Returns the index of the aggregate of the pair in the current PSI, creating it if needed.
+	int GetContactAggregate(IPhysicsObject *object0, IPhysicsObject *object1,
+			const btManifoldPoint &firstPoint, btScalar normalSign, btScalar time);
+	// Also gathers contact statistics, so called after every PSI even without a collision event handler.
+	void CollectCollisionEvents();
+	void RemoveContactPairsForObject(IPhysicsObject *object);
+	// Uses the aggregates of the PSI, so called after CollectCollisionEvents.
+	void FreezeObjectsOverCollisionLimit();
+
 	CUtlVector<IPhysicsFrictionSnapshot *> m_FrictionSnapshots;
 	int m_HighestActiveFrictionSnapshot;
 	inline void UpdateHighestActiveFrictionSnapshot() {
@@ -248,27 +411,47 @@ private:
 		}
 	}
 
-	struct TriggerTouch_t {
-		IPhysicsObject *m_Trigger;
-		IPhysicsObject *m_Object;
-		// Temporary flag indicating there's still a touch between this pair.
-		// Touches with this flag being false after checking all contacts are removed.
-		bool m_TouchingThisTick;
-
-		TriggerTouch_t() {} // Required by CUtlRBTree.
-		TriggerTouch_t(IPhysicsObject *trigger, IPhysicsObject *object) :
-				m_Trigger(trigger), m_Object(object), m_TouchingThisTick(true) {}
+	// Trigger touches are tracked using broadphase pairs, without generating contact manifolds for triggers.
+	// Pairs are only marked as non-overlapping by the callback, events are sent after PSIs.
+	struct TriggerPairData_t {
+		// Whether the broadphase pair still exists - cleared when it's destroyed, the pair is removed later.
+		bool m_Overlapping;
+		// Whether the game was notified about the object entering the trigger.
+		bool m_Touching;
+		// Whether the shapes were tested since the broadphase pair was created, even if neither is moving.
+		bool m_Tested;
 	};
-	static bool TriggerTouchLessFunc(const TriggerTouch_t &lhs, const TriggerTouch_t &rhs) {
-		if (lhs.m_Trigger != rhs.m_Trigger) {
-			return (lhs.m_Trigger < rhs.m_Trigger);
-		}
-		return (lhs.m_Object < rhs.m_Object);
-	}
-	CUtlRBTree<TriggerTouch_t> m_TriggerTouches;
+	CPhysicsPairHash<TriggerPairData_t> m_TriggerPairs; // The trigger is the first object.
+	// Every broadphase pair of physics objects, so the pairs of one object can be found without going through
+	// the whole pair cache when its collision filter changes.
+	struct OverlappingPairData_t {};
+	CPhysicsPairHash<OverlappingPairData_t> m_OverlappingPairs; // The object with the lower address is the first.
+	static IPhysicsObject *GetProxyObject(const btBroadphaseProxy *proxy);
+	// Notified about every broadphase pair created and destroyed - counts them and tracks object and trigger pairs.
+	class BroadphasePairCallback : public btOverlappingPairCallback {
+	public:
+		BroadphasePairCallback(CPhysicsEnvironment *environment) : m_Environment(environment) {}
+		virtual btBroadphasePair *addOverlappingPair(btBroadphaseProxy *proxy0, btBroadphaseProxy *proxy1);
+		virtual void *removeOverlappingPair(btBroadphaseProxy *proxy0, btBroadphaseProxy *proxy1,
+				btDispatcher *dispatcher);
+		virtual void removeOverlappingPairsContainingProxy(btBroadphaseProxy *proxy0, btDispatcher *dispatcher);
+	private:
+		CPhysicsEnvironment *m_Environment;
+	};
+	BroadphasePairCallback m_BroadphasePairCallback;
+	// Returns false if the objects can't be a trigger and an object touching it.
+	static bool GetTriggerAndObject(btBroadphaseProxy *proxy0, btBroadphaseProxy *proxy1,
+			IPhysicsObject *&trigger, IPhysicsObject *&object);
+	// Adds the pair if it's a trigger pair, or marks it as overlapping again.
+	void AddTriggerPair(btBroadphaseProxy *proxy0, btBroadphaseProxy *proxy1);
+	// Removes the pair without sending events.
+	void RemoveTriggerPair(int pairIndex);
+	void RemoveTriggerPairsForObject(IPhysicsObject *object);
 	void CheckTriggerTouches();
 
 	void AddConstraint(IPhysicsConstraint *constraint);
+	// Removes the Bullet constraint from the world and the constraint from the lists of its objects.
+	void DetachConstraint(IPhysicsConstraint *constraint);
 	void DeleteConstraint(IPhysicsConstraint *constraint, bool removeFromList = true);
 	CUtlVector<IPhysicsConstraint *> m_ConstraintObjects; // Both valid and invalid.
 	CUtlVector<IPhysicsConstraint *> m_DeadConstraints;
@@ -276,6 +459,21 @@ private:
 	bool m_QuickDelete;
 
 	physics_performanceparams_t m_PerformanceSettings;
+
+	// Fills the common part of a world trace, with the fraction and startsolid already set.
+	static void WriteTraceResult(const btCollisionObject *hitObject,
+			const btVector3 &hitNormal, const btVector3 &hitPoint, const btVector3 &delta,
+			const Vector &startPosition, const Vector &deltaHL, trace_t *pTrace);
+
+	// Counters accumulated during PSIs. collisionPairsTotal is read from the pair cache.
+	// impactSysNum, impactSumSys and impactDelayedCount describe IVP's impact system, which has no equivalent
+	// in Bullet, and are always zero.
+	physics_stats_t m_Stats;
+	int m_StatsPSICount;
+	// Contact statistics and the speed gain are only gathered after ReadStats has been called.
+	bool m_StatsRequested;
+	CCycleCount m_PhaseTimes[PHASE_COUNT];
+	void UpdateSpeedGainStats();
 };
 
 #endif
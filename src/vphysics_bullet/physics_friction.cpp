@@ -2,7 +2,6 @@
 // Bullet integration by Triang3l, derivative work, in public domain if detached from Valve's work.
 
 #include "physics_friction.h"
-#include "physics_environment.h"
 #include "physics_object.h"
 
 CPhysicsFrictionSnapshot::CPhysicsFrictionSnapshot() {
@@ -18,8 +17,7 @@ void CPhysicsFrictionSnapshot::Reset(IPhysicsObject *object) {
 	if (object == nullptr) {
 		return;
 	}
-	m_Dispatcher = static_cast<CPhysicsEnvironment *>(static_cast<CPhysicsObject *>(
-			object)->GetEnvironment())->GetCollisionDispatcher();
+	m_Manifolds = &static_cast<CPhysicsObject *>(object)->GetContactManifolds();
 	m_ManifoldIndex = -1;
 	NextFrictionData();
 }
@@ -31,40 +29,34 @@ void CPhysicsFrictionSnapshot::NextFrictionData() {
 
 	// Try the next contact in the current manifold.
 	if (m_ManifoldIndex >= 0) { // Initially the index is -1.
-		if (++m_ContactIndex < m_Dispatcher->getManifoldByIndexInternal(m_ManifoldIndex)->getNumContacts()) {
+		if (++m_ContactIndex < m_Manifolds->Element(m_ManifoldIndex)->getNumContacts()) {
 			return;
 		}
 	}
 
 	// Try to find the next manifold.
-	const btCollisionObject *collisionObject = static_cast<CPhysicsObject *>(m_Object)->GetRigidBody();
-	int manifoldCount = m_Dispatcher->getNumManifolds();
+	const btCollisionObject *collisionObject = static_cast<CPhysicsObject *>(m_Object)->GetCollisionObject();
+	int manifoldCount = m_Manifolds->Count();
 	for (++m_ManifoldIndex; m_ManifoldIndex < manifoldCount; ++m_ManifoldIndex) {
-		const btPersistentManifold *manifold = m_Dispatcher->getManifoldByIndexInternal(m_ManifoldIndex);
+		const btPersistentManifold *manifold = m_Manifolds->Element(m_ManifoldIndex);
 		if (manifold->getNumContacts() == 0) {
 			continue;
 		}
-		if (manifold->getBody0() == collisionObject) {
-			m_ObjectIsB = false;
-		} else if (manifold->getBody1() == collisionObject) {
-			m_ObjectIsB = true;
-		} else {
-			continue;
-		}
+		m_ObjectIsB = (manifold->getBody0() != collisionObject);
 		m_ContactIndex = 0;
 		return;
 	}
 }
 
 bool CPhysicsFrictionSnapshot::IsValid() {
-	return m_ManifoldIndex < m_Dispatcher->getNumManifolds();
+	return m_ManifoldIndex < m_Manifolds->Count();
 }
 
 IPhysicsObject *CPhysicsFrictionSnapshot::GetObject(int index) {
 	if (index == 0) {
 		return m_Object;
 	}
-	const btPersistentManifold *manifold = m_Dispatcher->getManifoldByIndexInternal(m_ManifoldIndex);
+	const btPersistentManifold *manifold = m_Manifolds->Element(m_ManifoldIndex);
 	const btCollisionObject *collisionObject = (m_ObjectIsB ? manifold->getBody0() : manifold->getBody1());
 	return reinterpret_cast<IPhysicsObject *>(collisionObject->getUserPointer());
 }
@@ -6,6 +6,7 @@
 
 #include "physics_internal.h"
 #include "vphysics/friction.h"
+#include "tier1/utlvector.h"
 
 class CPhysicsFrictionSnapshot : public IPhysicsFrictionSnapshot {
 public:
@@ -34,13 +35,13 @@ public:
 
 private:
 	IPhysicsObject *m_Object;
-	btCollisionDispatcher *m_Dispatcher;
+	const CUtlVector<btPersistentManifold *> *m_Manifolds; // Of the object.
 	int m_ManifoldIndex;
 	bool m_ObjectIsB;
 	int m_ContactIndex;
 
 	inline btManifoldPoint &GetCurrentContact() const {
-		return m_Dispatcher->getManifoldByIndexInternal(m_ManifoldIndex)->getContactPoint(m_ContactIndex);
+		return m_Manifolds->Element(m_ManifoldIndex)->getContactPoint(m_ContactIndex);
 	}
 };
 
@@ -5,7 +5,9 @@
 #include "physics_collide.h"
 #include "physics_environment.h"
 #include "physics_objecthash.h"
+#include "physics_taskscheduler.h"
 #include "vphysics/collision_set.h"
+#include "tier1/convar.h"
 #include "tier1/tier1.h"
 #include "tier1/utlvector.h"
 #ifdef WIN32
@@ -76,6 +78,7 @@ bool CPhysicsCollisionSet::ShouldCollide(int index0, int index1) {
 
 class CPhysicsInterface : public CTier1AppSystem<IPhysics> {
 public:
+	virtual void Shutdown();
 	virtual void *QueryInterface(const char *pInterfaceName);
 
 	virtual IPhysicsEnvironment *CreateEnvironment();
@@ -96,6 +99,23 @@ static CPhysicsInterface s_MainDLLInterface;
 EXPOSE_SINGLE_INTERFACE_GLOBALVAR(CPhysicsInterface, IPhysics,
 		VPHYSICS_INTERFACE_VERSION, s_MainDLLInterface);
 
+CON_COMMAND(physics_bullet_stats, "Prints physics statistics and time spent in simulation stages since they were last cleared.") {
+	for (int environmentIndex = 0; ; ++environmentIndex) {
+		IPhysicsEnvironment *environment = s_MainDLLInterface.GetActiveEnvironmentByIndex(environmentIndex);
+		if (environment == nullptr) {
+			break;
+		}
+		Msg("Physics environment %d:\n", environmentIndex);
+		static_cast<CPhysicsEnvironment *>(environment)->PrintStats();
+	}
+}
+
+void CPhysicsInterface::Shutdown() {
+	g_pPhysCollision->ShutdownAsyncLoader();
+	VPhysicsShutdownTaskScheduler();
+	CTier1AppSystem<IPhysics>::Shutdown();
+}
+
 void *CPhysicsInterface::QueryInterface(const char *pInterfaceName) {
 	return Sys_GetFactoryThis()(pInterfaceName, nullptr);
 }
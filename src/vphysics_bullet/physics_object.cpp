@@ -9,47 +9,57 @@
 #include "physics_motioncontroller.h"
 #include "physics_shadow.h"
 #include "physics_vehicle.h"
+#include "physics_velocitybatch.h"
 #include "bspflags.h"
 #include "tier0/dbg.h"
 
+// Fractions of the smallest dimension of the object. Only objects moving by more than a part of their thickness
+// in one PSI are swept, so normally it's only done for fast small objects such as grenades and gibs.
+// The motion threshold is for the default look-ahead time against the world, and is inversely proportional to it.
+#define CCD_MOTION_THRESHOLD 0.5f
+#define CCD_MOTION_THRESHOLD_LOOK_AHEAD_TIME 1.0f
+#define CCD_MIN_MOTION_THRESHOLD 0.05f
+#define CCD_SWEPT_SPHERE_RADIUS 0.4f
+
+#ifdef WIN32
+#pragma warning(push)
+#pragma warning(disable : 4355) // 'this' : used in base member initializer list
+#endif
+
 CPhysicsObject::CPhysicsObject(IPhysicsEnvironment *environment,
 		const CPhysCollide *collide, int materialIndex,
 		const Vector &position, const QAngle &angles,
 		const objectparams_t *params, bool isStatic) :
 		m_Environment(environment),
+		m_MotionState(this),
 		m_CollideObjectNext(this), m_CollideObjectPrevious(this),
 		m_MassCenterOverride(0.0f, 0.0f, 0.0f),
 		m_Mass((!isStatic && !collide->GetShape()->isNonMoving()) ? params->mass : 0.0f),
 		m_HingeHLAxis(-1),
 		m_MotionEnabled(true),
 		m_ShadowTempGravityDisable(false),
-		m_LinearDamping(params->damping), m_AngularDamping(params->rotdamping),
 		m_MaterialIndex(materialIndex), m_RealMaterialIndex(-1),
 		m_ContentsMask(CONTENTS_SOLID),
+		m_Dynamic(nullptr),
 		m_Shadow(nullptr), m_Player(nullptr),
 		m_BodyOfVehicle(nullptr), m_WheelOfVehicle(nullptr),
 		m_CollisionEnabled(params->enableCollisions),
-		m_ConstraintObjectCount(0), m_ValidConstraintCount(0),
-		m_GameData(params->pGameData), m_GameFlags(0), m_GameIndex(0),
+		m_ValidConstraintCount(0),
+		m_GameData(params->pGameData), m_GameFlags(0), m_GameIndex(0), m_Name(nullptr),
 		m_Callbacks(CALLBACK_GLOBAL_COLLISION | CALLBACK_GLOBAL_FRICTION |
 				CALLBACK_FLUID_TOUCH | CALLBACK_GLOBAL_TOUCH |
 				CALLBACK_GLOBAL_COLLIDE_STATIC | CALLBACK_DO_FLUID_SIMULATION),
-		m_WasAsleep(true),
-		m_LinearVelocityChange(0.0f, 0.0f, 0.0f),
-		m_LocalAngularVelocityChange(0.0f, 0.0f, 0.0f),
+		m_WasAsleep(true), m_ObjectIndex(-1), m_NonStaticIndex(-1), m_ActiveIndex(-1),
 		m_TouchingTriggers(0),
-		m_InterPSILinearVelocity(0.0f, 0.0f, 0.0f),
-		m_InterPSIAngularVelocity(0.0f, 0.0f, 0.0f) {
-	if (params->pName != nullptr) {
-		V_strncpy(m_Name, params->pName, sizeof(m_Name));
-	} else {
-		m_Name[0] = '\0';
+		m_EventLinearVelocity(nullptr), m_EventAngularVelocity(nullptr) {
+	if (params->pName != nullptr && params->pName[0] != '\0') {
+		int nameSize = V_strlen(params->pName) + 1;
+		m_Name = new char[nameSize]; // Safe.
+		V_strncpy(m_Name, params->pName, nameSize);
 	}
 
 	btCollisionShape *shape = const_cast<CPhysCollide *>(collide)->GetShape();
-
-	btRigidBody::btRigidBodyConstructionInfo constructionInfo(m_Mass, nullptr, shape,
-			(m_Mass > 0.0f) ? collide->GetInertia() : btVector3(0.0f, 0.0f, 0.0f));
+	btVector3 inertia = (m_Mass > 0.0f) ? collide->GetInertia() : btVector3(0.0f, 0.0f, 0.0f);
 
 	btVector3 massCenter = collide->GetMassCenter();
 	const Vector *massCenterOverride = params->massCenterOverride;
@@ -59,65 +69,96 @@ CPhysicsObject::CPhysicsObject(IPhysicsEnvironment *environment,
 		btVector3 massCenterOffset = m_MassCenterOverride - massCenter;
 		massCenterOverrideShape->addChildShape(btTransform(btMatrix3x3::getIdentity(),
 				-massCenterOffset), shape);
-		constructionInfo.m_collisionShape = massCenterOverrideShape;
+		shape = massCenterOverrideShape;
 		massCenter = m_MassCenterOverride;
 		if (m_Mass > 0.0f) {
-			constructionInfo.m_localInertia = CPhysicsCollision::OffsetInertia(
-					constructionInfo.m_localInertia, massCenterOffset);
+			inertia = CPhysicsCollision::OffsetInertia(inertia, massCenterOffset);
 		}
 	}
 	if (m_Mass > 0.0f) {
-		constructionInfo.m_localInertia *= params->inertia * m_Mass;
+		inertia *= params->inertia * m_Mass;
 		if (params->rotInertiaLimit > 0.0f) {
-			btScalar minInertia = constructionInfo.m_localInertia.length() * params->rotInertiaLimit;
-			constructionInfo.m_localInertia.setMax(btVector3(minInertia, minInertia, minInertia));
+			btScalar minInertia = inertia.length() * params->rotInertiaLimit;
+			inertia.setMax(btVector3(minInertia, minInertia, minInertia));
 		}
 	}
-	ConvertInertiaToHL(constructionInfo.m_localInertia, m_Inertia);
+	ConvertInertiaToHL(inertia, m_Inertia);
 
 	matrix3x4_t startMatrix;
 	AngleMatrix(angles, position, startMatrix);
-	btTransform &startWorldTransform = constructionInfo.m_startWorldTransform;
+	btTransform startWorldTransform;
 	ConvertMatrixToBullet(startMatrix, startWorldTransform);
 	startWorldTransform.getOrigin() += startWorldTransform.getBasis() * massCenter;
-	m_InterPSIWorldTransform = startWorldTransform;
 
-	m_RigidBody = VPhysicsNew(btRigidBody, constructionInfo);
-	m_RigidBody->setUserPointer(this);
-
-	m_RigidBody->setSleepingThresholds(0.2f, 0.4f); // 0.1 and 0.2 in IVP, but that's too low.
+	if (m_Mass > 0.0f) {
+		btRigidBody::btRigidBodyConstructionInfo constructionInfo(m_Mass, nullptr, shape, inertia);
+		constructionInfo.m_startWorldTransform = startWorldTransform;
+		m_RigidBody = VPhysicsNew(btRigidBody, constructionInfo);
+		m_RigidBody->setSleepingThresholds(0.2f, 0.4f); // 0.1 and 0.2 in IVP, but that's too low.
+		m_CollisionObject = m_RigidBody;
+	} else {
+		// What addRigidBody does for static rigid bodies - never simulated, and never woken up.
+		m_RigidBody = nullptr;
+		m_CollisionObject = VPhysicsNew(btCollisionObject);
+		m_CollisionObject->setCollisionShape(shape);
+		m_CollisionObject->setWorldTransform(startWorldTransform);
+		m_CollisionObject->setInterpolationWorldTransform(startWorldTransform);
+		m_CollisionObject->setCollisionFlags(btCollisionObject::CF_STATIC_OBJECT);
+		m_CollisionObject->setActivationState(ISLAND_SLEEPING);
+	}
+	m_CollisionObject->setUserPointer(this);
 
 	if (!IsStatic()) {
+		m_RigidBody->setMotionState(&m_MotionState);
 		m_GravityEnabled = true;
-		m_LinearDragCoefficient = m_AngularDragCoefficient = params->dragCoefficient;
+		m_Dynamic = VPhysicsNew(DynamicState);
+		m_Dynamic->m_LinearDamping = params->damping;
+		m_Dynamic->m_AngularDamping = params->rotdamping;
+		m_Dynamic->m_LinearDragCoefficient = m_Dynamic->m_AngularDragCoefficient = params->dragCoefficient;
 		ComputeDragBases();
-		m_DragEnabled = (m_LinearDragCoefficient != 0.0f);
+		m_Dynamic->m_DragEnabled = (m_Dynamic->m_LinearDragCoefficient != 0.0f);
+		m_Dynamic->m_LinearVelocityChange.setZero();
+		m_Dynamic->m_LocalAngularVelocityChange.setZero();
+		m_Dynamic->m_InterPSIWorldTransform = startWorldTransform;
+		m_Dynamic->m_InterPSILinearVelocity.setZero();
+		m_Dynamic->m_InterPSIAngularVelocity.setZero();
+		m_Dynamic->m_PrePSILinearVelocity.setZero();
+		m_Dynamic->m_PrePSIAngularVelocity.setZero();
+		m_Dynamic->m_PSICollisionCount = 0;
 	} else {
-		const btVector3 zero(0.0f, 0.0f, 0.0f);
 		m_GravityEnabled = false;
-		m_LinearDragCoefficient = m_AngularDragCoefficient = 0.0f;
-		m_LinearDragBasis.setZero();
-		m_AngularDragBasis.setZero();
-		m_DragEnabled = false;
 	}
 
 	AddReferenceToCollide();
 
 	UpdateMaterial();
 
+	UpdateContinuousCollision();
+
 	Sleep();
 }
 
+#ifdef WIN32
+#pragma warning(pop)
+#endif
+
 CPhysicsObject::~CPhysicsObject() {
-	btCollisionShape *shape = m_RigidBody->getCollisionShape();
+	btCollisionShape *shape = m_CollisionObject->getCollisionShape();
 	if (shape->getUserPointer() == nullptr) {
 		// Delete the mass override shape.
-		m_RigidBody->setCollisionShape(static_cast<btCompoundShape *>(shape)->getChildShape(0));
+		m_CollisionObject->setCollisionShape(static_cast<btCompoundShape *>(shape)->getChildShape(0));
 		VPhysicsDelete(btCompoundShape, shape);
 	}
 
 	RemoveReferenceFromCollide();
-	VPhysicsDelete(btRigidBody, m_RigidBody);
+	if (m_RigidBody != nullptr) {
+		VPhysicsDelete(btRigidBody, m_RigidBody);
+	} else {
+		VPhysicsDelete(btCollisionObject, m_CollisionObject);
+	}
+
+	VPhysicsDelete(DynamicState, m_Dynamic);
+	delete[] m_Name; // Safe.
 }
 
 void CPhysicsObject::NotifyQueuedForRemoval() {
@@ -127,9 +168,10 @@ void CPhysicsObject::NotifyQueuedForRemoval() {
 	}
 }
 
-void CPhysicsObject::Release() {
+void CPhysicsObject::DetachBeforeRelease() {
 	// Prevent callbacks to the game code and unlink from this object.
-	m_Callbacks = 0;
+	// Still marked for deletion for the collision events that may reference it until its memory is freed.
+	m_Callbacks = CALLBACK_MARKED_FOR_DELETE;
 	m_GameData = nullptr;
 
 	RemovePlayerController();
@@ -137,14 +179,29 @@ void CPhysicsObject::Release() {
 	DetachFromMotionControllers();
 	// Really, REALLY bad if still a vehicle - constraints queued for removal won't be removed correctly.
 	Assert(m_BodyOfVehicle == nullptr);
+}
+
+void CPhysicsObject::Release() {
+	ReleaseKeepingMemory();
+	DeleteAfterRelease();
+}
 
+void CPhysicsObject::ReleaseKeepingMemory() {
+	DetachBeforeRelease();
 	static_cast<CPhysicsEnvironment *>(m_Environment)->NotifyObjectRemoving(this);
+}
+
+void CPhysicsObject::DeleteAfterRelease() {
+	VPhysicsDelete(CPhysicsObject, this);
+}
 
+void CPhysicsObject::ReleaseWithWorld() {
+	DetachBeforeRelease();
 	VPhysicsDelete(CPhysicsObject, this);
 }
 
 CPhysCollide *CPhysicsObject::GetCollide() {
-	btCollisionShape *shape = m_RigidBody->getCollisionShape();
+	btCollisionShape *shape = m_CollisionObject->getCollisionShape();
 	if (shape->getUserPointer() == nullptr) {
 		// Overriding mass center.
 		shape = static_cast<btCompoundShape *>(shape)->getChildShape(0);
@@ -153,7 +210,7 @@ CPhysCollide *CPhysicsObject::GetCollide() {
 }
 
 const CPhysCollide *CPhysicsObject::GetCollide() const {
-	const btCollisionShape *shape = m_RigidBody->getCollisionShape();
+	const btCollisionShape *shape = m_CollisionObject->getCollisionShape();
 	if (shape->getUserPointer() == nullptr) {
 		// Overriding mass center.
 		shape = static_cast<const btCompoundShape *>(shape)->getChildShape(0);
@@ -172,6 +229,7 @@ float CPhysicsObject::GetSphereRadius() const {
 void CPhysicsObject::NotifyTransferred(IPhysicsEnvironment *newEnvironment) {
 	m_Environment = newEnvironment;
 	Assert(!IsTouchingTriggers());
+	UpdateContinuousCollision();
 }
 
 /*******************
@@ -179,10 +237,13 @@ void CPhysicsObject::NotifyTransferred(IPhysicsEnvironment *newEnvironment) {
  *******************/
 
 bool CPhysicsObject::IsStatic() const {
-	return m_RigidBody->isStaticObject();
+	return m_RigidBody == nullptr;
 }
 
 void CPhysicsObject::UpdateMassProps() {
+	if (IsStatic()) {
+		return;
+	}
 	// GetMass and GetInertia handle the overrides (shadows, hinge).
 	btVector3 bulletInertia;
 	ConvertInertiaToBullet(GetInertia(), bulletInertia);
@@ -209,7 +270,7 @@ float CPhysicsObject::GetMass() const {
 }
 
 float CPhysicsObject::GetInvMass() const {
-	return m_RigidBody->getInvMass();
+	return GetBulletInvMass();
 }
 
 Vector CPhysicsObject::GetInertia() const {
@@ -225,13 +286,16 @@ Vector CPhysicsObject::GetInertia() const {
 }
 
 Vector CPhysicsObject::GetInvInertia() const {
+	if (IsStatic()) {
+		return Vector(0.0f, 0.0f, 0.0f);
+	}
 	Vector inertia;
 	ConvertInertiaToHL(m_RigidBody->getInvInertiaDiagLocal(), inertia);
 	return inertia;
 }
 
 void CPhysicsObject::SetInertia(const Vector &inertia) {
-	if (!IsStatic()) {
+	if (IsStatic()) {
 		return;
 	}
 	m_Inertia = inertia;
@@ -272,7 +336,8 @@ bool CPhysicsObject::IsMoveable() const {
 }
 
 void CPhysicsObject::EnableMotion(bool enable) {
-	if (IsMotionEnabled() == enable) {
+	// Static objects don't have a mass to override, and must stay static.
+	if (IsStatic() || IsMotionEnabled() == enable) {
 		return;
 	}
 
@@ -282,21 +347,61 @@ void CPhysicsObject::EnableMotion(bool enable) {
 	btVector3 zero(0.0f, 0.0f, 0.0f);
 	m_RigidBody->setLinearVelocity(zero);
 	m_RigidBody->setAngularVelocity(zero);
-	m_LinearVelocityChange.setZero();
-	m_LocalAngularVelocityChange.setZero();
+	m_Dynamic->m_LinearVelocityChange.setZero();
+	m_Dynamic->m_LocalAngularVelocityChange.setZero();
 	// Freeze in place if called externally, don't wait for the next PSI.
-	m_InterPSILinearVelocity.setZero();
-	m_InterPSIAngularVelocity.setZero();
+	m_Dynamic->m_InterPSILinearVelocity.setZero();
+	m_Dynamic->m_InterPSIAngularVelocity.setZero();
 
 	UpdateMassProps();
 }
 
+/***********************
+ * Continuous collision
+ ***********************/
+
+void CPhysicsObject::UpdateContinuousCollision() {
+	btScalar lookAheadTime = static_cast<const CPhysicsEnvironment *>(m_Environment)->GetContinuousCollisionLookAheadTime();
+	if (IsStatic() || lookAheadTime <= 0.0f) {
+		m_CollisionObject->setCcdMotionThreshold(0.0f);
+		m_CollisionObject->setCcdSweptSphereRadius(0.0f);
+		return;
+	}
+
+	// The thickness along an axis is the volume divided by the area of the projection along it, from the
+	// orthographic areas (fractions of the bounding box faces), so rods and plates lying diagonally within
+	// their bounding boxes aren't treated as thick.
+	const CPhysCollide *collide = GetCollide();
+	btVector3 aabbMin, aabbMax;
+	collide->GetShape()->getAabb(btTransform::getIdentity(), aabbMin, aabbMax);
+	btVector3 extents = aabbMax - aabbMin;
+	btScalar thickness = extents[extents.minAxis()];
+	btScalar volume = collide->GetVolume();
+	if (volume > 0.0f) {
+		btVector3 projectedAreas(
+				extents.getY() * extents.getZ(),
+				extents.getX() * extents.getZ(),
+				extents.getX() * extents.getY());
+		projectedAreas *= collide->GetOrthographicAreas();
+		btScalar maxProjectedArea = projectedAreas[projectedAreas.maxAxis()];
+		if (maxProjectedArea > SIMD_EPSILON) {
+			thickness = btMin(thickness, volume / maxProjectedArea);
+		}
+	}
+
+	// Zero would disable sweeping.
+	btScalar motionThreshold = btMax(CCD_MOTION_THRESHOLD * (CCD_MOTION_THRESHOLD_LOOK_AHEAD_TIME / lookAheadTime),
+			CCD_MIN_MOTION_THRESHOLD);
+	m_CollisionObject->setCcdMotionThreshold(thickness * motionThreshold);
+	m_CollisionObject->setCcdSweptSphereRadius(thickness * CCD_SWEPT_SPHERE_RADIUS);
+}
+
 /*******************
  * Activation state
  *******************/
 
 bool CPhysicsObject::IsAsleep() const {
-	return !m_RigidBody->isActive();
+	return !m_CollisionObject->isActive();
 }
 
 void CPhysicsObject::Wake() {
@@ -305,6 +410,7 @@ void CPhysicsObject::Wake() {
 		// Also waking up from DISABLE_SIMULATION, which is not possible with setActivationState.
 		m_RigidBody->forceActivationState(ACTIVE_TAG);
 		m_RigidBody->setDeactivationTime(0.0f);
+		static_cast<CPhysicsEnvironment *>(m_Environment)->NotifyObjectActive(this);
 	}
 }
 
@@ -335,20 +441,23 @@ void CPhysicsObject::EnableGravity(bool enable) {
 }
 
 void CPhysicsObject::SetDamping(const float *speed, const float *rot) {
+	if (IsStatic()) {
+		return;
+	}
 	if (speed != nullptr) {
-		m_LinearDamping = *speed;
+		m_Dynamic->m_LinearDamping = *speed;
 	}
 	if (rot != nullptr) {
-		m_AngularDamping = *rot;
+		m_Dynamic->m_AngularDamping = *rot;
 	}
 }
 
 void CPhysicsObject::GetDamping(float *speed, float *rot) const {
 	if (speed != nullptr) {
-		*speed = m_LinearDamping;
+		*speed = (m_Dynamic != nullptr ? m_Dynamic->m_LinearDamping : 0.0f);
 	}
 	if (rot != nullptr) {
-		*rot = m_AngularDamping;
+		*rot = (m_Dynamic != nullptr ? m_Dynamic->m_AngularDamping : 0.0f);
 	}
 }
 
@@ -367,7 +476,7 @@ void CPhysicsObject::ApplyDamping(btScalar timeStep) {
 	}
 
 	const btVector3 &linearVelocity = m_RigidBody->getLinearVelocity();
-	btScalar linearDamping = m_LinearDamping * timeStep;
+	btScalar linearDamping = m_Dynamic->m_LinearDamping * timeStep;
 	btScalar linearSleepingThreshold = m_RigidBody->getLinearSleepingThreshold();
 	if (linearVelocity.length2() < linearSleepingThreshold * linearSleepingThreshold) {
 		linearDamping += 0.1f;
@@ -381,7 +490,7 @@ void CPhysicsObject::ApplyDamping(btScalar timeStep) {
 
 	if (m_Shadow == nullptr) {
 		const btVector3 &angularVelocity = m_RigidBody->getAngularVelocity();
-		btScalar angularDamping = m_AngularDamping * timeStep;
+		btScalar angularDamping = m_Dynamic->m_AngularDamping * timeStep;
 		btScalar angularSleepingThreshold = m_RigidBody->getAngularSleepingThreshold();
 		if (angularVelocity.length2() < angularSleepingThreshold * angularSleepingThreshold) {
 			angularDamping += 0.1f;
@@ -421,27 +530,28 @@ void CPhysicsObject::ComputeDragBases() {
 	collide->GetShape()->getAabb(btTransform::getIdentity(), aabbMin, aabbMax);
 	btVector3 extents = aabbMax - aabbMin;
 	const btVector3 &areas = collide->GetOrthographicAreas();
-	m_LinearDragBasis.setValue(
+	btVector3 &linearDragBasis = m_Dynamic->m_LinearDragBasis, &angularDragBasis = m_Dynamic->m_AngularDragBasis;
+	linearDragBasis.setValue(
 			extents.getY() * extents.getZ(),
 			extents.getX() * extents.getZ(),
 			extents.getX() * extents.getY());
-	m_LinearDragBasis *= areas;
+	linearDragBasis *= areas;
 	extents *= 0.5f;
-	m_AngularDragBasis.setValue(
+	angularDragBasis.setValue(
 			AngularDragIntegral(extents.getX(), extents.getY(), extents.getZ()) +
 					AngularDragIntegral(extents.getX(), extents.getZ(), extents.getY()),
 			AngularDragIntegral(extents.getY(), extents.getX(), extents.getZ()) +
 					AngularDragIntegral(extents.getY(), extents.getZ(), extents.getX()),
 			AngularDragIntegral(extents.getZ(), extents.getX(), extents.getY()) +
 					AngularDragIntegral(extents.getZ(), extents.getY(), extents.getX()));
-	m_AngularDragBasis *= areas;
+	angularDragBasis *= areas;
 }
 
 bool CPhysicsObject::IsDragEnabled() const {
-	if (m_Shadow != nullptr || IsTrigger()) {
+	if (IsStatic() || m_Shadow != nullptr || IsTrigger()) {
 		return false;
 	}
-	return m_DragEnabled;
+	return m_Dynamic->m_DragEnabled;
 }
 
 void CPhysicsObject::EnableDrag(bool enable) {
@@ -449,21 +559,28 @@ void CPhysicsObject::EnableDrag(bool enable) {
 		return;
 	}
 	// IsDragEnabled comparison shouldn't be done because of shadow and trigger overrides.
-	m_DragEnabled = enable;
+	m_Dynamic->m_DragEnabled = enable;
 }
 
 void CPhysicsObject::SetDragCoefficient(float *pDrag, float *pAngularDrag) {
+	if (IsStatic()) {
+		return;
+	}
 	if (pDrag != nullptr) {
-		m_LinearDragCoefficient = *pDrag;
+		m_Dynamic->m_LinearDragCoefficient = *pDrag;
 	}
 	if (pAngularDrag != nullptr) {
-		m_AngularDragCoefficient = *pAngularDrag;
+		m_Dynamic->m_AngularDragCoefficient = *pAngularDrag;
 	}
 }
 
 btScalar CPhysicsObject::CalculateLinearDrag(const btVector3 &velocity) const {
-	btVector3 drag = ((velocity * m_RigidBody->getWorldTransform().getBasis()) * m_LinearDragBasis).absolute();
-	return m_LinearDragCoefficient * m_RigidBody->getInvMass() * (drag.getX() + drag.getY() + drag.getZ());
+	if (IsStatic()) {
+		return 0.0f;
+	}
+	btVector3 drag = ((velocity * m_CollisionObject->getWorldTransform().getBasis()) *
+			m_Dynamic->m_LinearDragBasis).absolute();
+	return m_Dynamic->m_LinearDragCoefficient * m_RigidBody->getInvMass() * (drag.getX() + drag.getY() + drag.getZ());
 }
 
 float CPhysicsObject::CalculateLinearDrag(const Vector &unitDirection) const {
@@ -473,9 +590,12 @@ float CPhysicsObject::CalculateLinearDrag(const Vector &unitDirection) const {
 }
 
 btScalar CPhysicsObject::CalculateAngularDrag(const btVector3 &objectSpaceRotationAxis) const {
-	btVector3 drag = (objectSpaceRotationAxis * m_AngularDragBasis *
+	if (IsStatic()) {
+		return 0.0f;
+	}
+	btVector3 drag = (objectSpaceRotationAxis * m_Dynamic->m_AngularDragBasis *
 			m_RigidBody->getInvInertiaDiagLocal()).absolute();
-	return m_AngularDragCoefficient * (drag.getX() + drag.getY() + drag.getZ());
+	return m_Dynamic->m_AngularDragCoefficient * (drag.getX() + drag.getY() + drag.getZ());
 }
 
 float CPhysicsObject::CalculateAngularDrag(const Vector &objectSpaceRotationAxis) const {
@@ -500,7 +620,7 @@ void CPhysicsObject::ApplyDrag(btScalar timeStep) {
 
 	const btVector3 &angularVelocity = m_RigidBody->getAngularVelocity();
 	float angularDragForce = -CalculateAngularDrag(angularVelocity *
-			m_RigidBody->getWorldTransform().getBasis()) * dragForceScale;
+			m_CollisionObject->getWorldTransform().getBasis()) * dragForceScale;
 	if (angularDragForce < 0.0f) {
 		btSetMax(angularDragForce, btScalar(-1.0f));
 		m_RigidBody->setAngularVelocity(angularVelocity + (angularVelocity * angularDragForce));
@@ -544,14 +664,14 @@ void CPhysicsObject::UpdateMaterial() {
 		m_RealMaterialIndex = materialIndex;
 		float friction, elasticity;
 		g_pPhysSurfaceProps->GetPhysicsProperties(materialIndex, nullptr, nullptr, &friction, &elasticity);
-		m_RigidBody->setFriction(friction);
+		m_CollisionObject->setFriction(friction);
 		if (friction > 0.0f) {
 			// Stability.
-			m_RigidBody->setCollisionFlags(m_RigidBody->getCollisionFlags() | btCollisionObject::CF_HAS_FRICTION_ANCHOR);
+			m_CollisionObject->setCollisionFlags(m_CollisionObject->getCollisionFlags() | btCollisionObject::CF_HAS_FRICTION_ANCHOR);
 		} else {
-			m_RigidBody->setCollisionFlags(m_RigidBody->getCollisionFlags() & ~btCollisionObject::CF_HAS_FRICTION_ANCHOR);
+			m_CollisionObject->setCollisionFlags(m_CollisionObject->getCollisionFlags() & ~btCollisionObject::CF_HAS_FRICTION_ANCHOR);
 		}
-		m_RigidBody->setRestitution(elasticity);
+		m_CollisionObject->setRestitution(elasticity);
 	}
 }
 
@@ -600,7 +720,7 @@ unsigned short CPhysicsObject::GetCallbackFlags() const {
 }
 
 const char *CPhysicsObject::GetName() const {
-	return m_Name;
+	return (m_Name != nullptr ? m_Name : "");
 }
 
 /**********************
@@ -608,7 +728,7 @@ const char *CPhysicsObject::GetName() const {
  **********************/
 
 const btVector3 &CPhysicsObject::GetBulletMassCenter() const {
-	if (m_RigidBody->getCollisionShape()->getUserPointer() == nullptr) {
+	if (m_CollisionObject->getCollisionShape()->getUserPointer() == nullptr) {
 		return m_MassCenterOverride;
 	}
 	return GetCollide()->GetMassCenter();
@@ -621,8 +741,14 @@ Vector CPhysicsObject::GetMassCenterLocalSpace() const {
 }
 
 void CPhysicsObject::ProceedToTransform(const btTransform &transform) {
-	btTransform oldTransform = m_RigidBody->getWorldTransform();
-	m_RigidBody->proceedToTransform(transform);
+	btTransform oldTransform = m_CollisionObject->getWorldTransform();
+	if (!IsStatic()) {
+		m_RigidBody->proceedToTransform(transform);
+	} else {
+		m_CollisionObject->setWorldTransform(transform);
+		m_CollisionObject->setInterpolationWorldTransform(transform);
+	}
+	static_cast<CPhysicsEnvironment *>(m_Environment)->UpdateInactiveObjectAabb(this);
 
 	if (!IsStatic()) {
 		m_RigidBody->setAngularVelocity(transform.getBasis() *
@@ -631,8 +757,8 @@ void CPhysicsObject::ProceedToTransform(const btTransform &transform) {
 		// TODO: Properly handle interpolation values of the rigid body.
 
 		if (!m_Environment->IsInSimulation()) {
-			m_InterPSIAngularVelocity = transform.getBasis() *
-					(m_InterPSIAngularVelocity * oldTransform.getBasis());
+			btVector3 &interPSIAngularVelocity = m_Dynamic->m_InterPSIAngularVelocity;
+			interPSIAngularVelocity = transform.getBasis() * (interPSIAngularVelocity * oldTransform.getBasis());
 			InterpolateBetweenPSIs();
 		}
 	}
@@ -682,7 +808,7 @@ void CPhysicsObject::GetPosition(Vector *worldPosition, QAngle *angles) const {
 }
 
 void CPhysicsObject::GetPositionAtPSI(Vector *worldPosition, QAngle *angles) const {
-	const btTransform &transform = m_RigidBody->getWorldTransform();
+	const btTransform &transform = m_CollisionObject->getWorldTransform();
 	const btMatrix3x3 &basis = transform.getBasis();
 	if (worldPosition != nullptr) {
 		ConvertPositionToHL(transform.getOrigin() - (basis * GetBulletMassCenter()), *worldPosition);
@@ -728,18 +854,31 @@ void CPhysicsObject::WorldToLocalVector(Vector *localVector, const Vector &world
 }
 
 void CPhysicsObject::UpdateAfterPSI() {
-	m_InterPSIWorldTransform = m_RigidBody->getWorldTransform();
-	m_InterPSILinearVelocity = m_RigidBody->getLinearVelocity();
-	m_InterPSIAngularVelocity = m_RigidBody->getAngularVelocity();
+	m_Dynamic->m_InterPSIWorldTransform = m_CollisionObject->getWorldTransform();
+	m_Dynamic->m_InterPSILinearVelocity = m_RigidBody->getLinearVelocity();
+	m_Dynamic->m_InterPSIAngularVelocity = m_RigidBody->getAngularVelocity();
+}
+
+void CPhysicsObject::MotionState::getWorldTransform(btTransform &worldTrans) const {
+	// Only called when attaching and for kinematic bodies - the rigid body owns the transform.
+	worldTrans = m_Object->m_CollisionObject->getWorldTransform();
+}
+
+void CPhysicsObject::MotionState::setWorldTransform(const btTransform &worldTrans) {
+	// Called after every PSI, but only for active objects.
+	// Bullet's interpolated transform is not used, interpolation between PSIs is done manually.
+	m_Object->UpdateAfterPSI();
+	static_cast<CPhysicsEnvironment *>(m_Object->m_Environment)->NotifyObjectActive(m_Object);
 }
 
 void CPhysicsObject::InterpolateBetweenPSIs() {
 	// For non-moving objects, the transform was already updated at the end of the PSI.
-	if (!m_InterPSILinearVelocity.isZero() || !m_InterPSIAngularVelocity.isZero()) {
-		btTransformUtil::integrateTransform(m_RigidBody->getWorldTransform(),
-				m_InterPSILinearVelocity, m_InterPSIAngularVelocity,
+	DynamicState &dynamic = *m_Dynamic;
+	if (!dynamic.m_InterPSILinearVelocity.isZero() || !dynamic.m_InterPSIAngularVelocity.isZero()) {
+		btTransformUtil::integrateTransform(m_CollisionObject->getWorldTransform(),
+				dynamic.m_InterPSILinearVelocity, dynamic.m_InterPSIAngularVelocity,
 				static_cast<const CPhysicsEnvironment *>(m_Environment)->GetTimeSinceLastPSI(),
-				m_InterPSIWorldTransform);
+				dynamic.m_InterPSIWorldTransform);
 	}
 }
 
@@ -748,25 +887,75 @@ void CPhysicsObject::ApplyForcesAndSpeedLimit(btScalar timeStep) {
 	// Still need to clamp things like shadow impulses even if motion is disabled, so it doesn't affect this.
 	if (!IsAsleep()) {
 		const CPhysicsEnvironment *environment = static_cast<const CPhysicsEnvironment *>(m_Environment);
-		btVector3 linearVelocity = m_RigidBody->getLinearVelocity() + m_LinearVelocityChange;
+		btVector3 linearVelocity = m_RigidBody->getLinearVelocity() + m_Dynamic->m_LinearVelocityChange;
 		btScalar maxSpeed = environment->GetMaxSpeed();
 		btClamp(linearVelocity[0], -maxSpeed, maxSpeed);
 		btClamp(linearVelocity[1], -maxSpeed, maxSpeed);
 		btClamp(linearVelocity[2], -maxSpeed, maxSpeed);
 		m_RigidBody->setLinearVelocity(linearVelocity);
 
-		const btMatrix3x3 &worldTransformBasis = m_RigidBody->getWorldTransform().getBasis();
+		const btMatrix3x3 &worldTransformBasis = m_CollisionObject->getWorldTransform().getBasis();
 		btVector3 localAngularVelocity = (m_RigidBody->getAngularVelocity() * worldTransformBasis) +
-				m_LocalAngularVelocityChange;
+				m_Dynamic->m_LocalAngularVelocityChange;
 		btScalar maxAngularSpeed = environment->GetMaxAngularSpeed();
 		btClamp(localAngularVelocity[0], -maxAngularSpeed, maxAngularSpeed);
 		btClamp(localAngularVelocity[1], -maxAngularSpeed, maxAngularSpeed);
 		btClamp(localAngularVelocity[2], -maxAngularSpeed, maxAngularSpeed);
 		m_RigidBody->setAngularVelocity(worldTransformBasis * localAngularVelocity);
 	}
-	m_LinearVelocityChange.setZero();
-	m_LocalAngularVelocityChange.setZero();
+	m_Dynamic->m_LinearVelocityChange.setZero();
+	m_Dynamic->m_LocalAngularVelocityChange.setZero();
+}
+
+#ifndef BT_USE_DOUBLE_PRECISION
+void CPhysicsObject::AddToForceBatch(CPhysicsVelocityBatch &batch, btScalar timeStep) {
+	Assert(!IsStatic());
+	bool moveable = IsMoveable();
+	if (moveable && (m_Shadow != nullptr || m_Player != nullptr)) {
+		// Only single-tick forces for shadows.
+		m_RigidBody->setAngularVelocity(btVector3(0.0f, 0.0f, 0.0f));
+	}
+
+	if (!IsAsleep()) {
+		CPhysicsVelocityBatch::ForceStageParameters_t parameters;
+		parameters.m_LinearVelocityChange = m_Dynamic->m_LinearVelocityChange;
+		parameters.m_LocalAngularVelocityChange = m_Dynamic->m_LocalAngularVelocityChange;
+		parameters.m_LinearDamping = -1.0f;
+		parameters.m_AngularDamping = -1.0f;
+		parameters.m_LinearSleepingThreshold = 0.0f;
+		parameters.m_AngularSleepingThreshold = 0.0f;
+		parameters.m_GravityVelocity.setZero();
+		if (moveable && IsGravityEnabled()) {
+			parameters.m_LinearDamping = m_Dynamic->m_LinearDamping * timeStep;
+			parameters.m_LinearSleepingThreshold = m_RigidBody->getLinearSleepingThreshold();
+			if (m_Shadow == nullptr) {
+				parameters.m_AngularDamping = m_Dynamic->m_AngularDamping * timeStep;
+				parameters.m_AngularSleepingThreshold = m_RigidBody->getAngularSleepingThreshold();
+			}
+			btVector3 gravity = static_cast<const CPhysicsEnvironment *>(m_Environment)->GetBulletGravity();
+			if (m_BodyOfVehicle != nullptr) {
+				static_cast<CPhysicsVehicleController *>(m_BodyOfVehicle)->ModifyGravity(gravity);
+			}
+			parameters.m_GravityVelocity = gravity * timeStep;
+		}
+		batch.AddForceObject(this, parameters);
+	}
+
+	m_Dynamic->m_LinearVelocityChange.setZero();
+	m_Dynamic->m_LocalAngularVelocityChange.setZero();
+}
+
+void CPhysicsObject::AddToDragBatch(CPhysicsVelocityBatch &batch, btScalar timeStep) {
+	if (!IsMoveable() || IsAsleep() || !IsDragEnabled()) {
+		return;
+	}
+	btScalar dragForceScale = m_Environment->GetAirDensity() * timeStep;
+	const DynamicState &dynamic = *m_Dynamic;
+	batch.AddDragObject(this,
+			dynamic.m_LinearDragBasis, -0.5f * dynamic.m_LinearDragCoefficient * m_RigidBody->getInvMass() * dragForceScale,
+			dynamic.m_AngularDragBasis * m_RigidBody->getInvInertiaDiagLocal(), -dynamic.m_AngularDragCoefficient * dragForceScale);
 }
+#endif
 
 void CPhysicsObject::CheckAndClearBulletForces() {
 	Assert(m_RigidBody->getTotalForce().isZero() && m_RigidBody->getTotalTorque().isZero());
@@ -780,14 +969,14 @@ void CPhysicsObject::SetVelocity(const Vector *velocity, const AngularImpulse *a
 	btVector3 zero(0.0f, 0.0f, 0.0f);
 	bool wake = false;
 	if (velocity != nullptr) {
-		ConvertPositionToBullet(*velocity, m_LinearVelocityChange);
+		ConvertPositionToBullet(*velocity, m_Dynamic->m_LinearVelocityChange);
 		m_RigidBody->setLinearVelocity(zero);
-		wake = (wake || !m_LinearVelocityChange.isZero());
+		wake = (wake || !m_Dynamic->m_LinearVelocityChange.isZero());
 	}
 	if (angularVelocity != nullptr) {
-		ConvertAngularImpulseToBullet(*angularVelocity, m_LocalAngularVelocityChange);
+		ConvertAngularImpulseToBullet(*angularVelocity, m_Dynamic->m_LocalAngularVelocityChange);
 		m_RigidBody->setAngularVelocity(zero);
-		wake = (wake || !m_LocalAngularVelocityChange.isZero());
+		wake = (wake || !m_Dynamic->m_LocalAngularVelocityChange.isZero());
 	}
 	if (wake) {
 		Wake();
@@ -808,8 +997,8 @@ void CPhysicsObject::SetVelocityInstantaneous(const Vector *velocity, const Angu
 		btClamp(bulletVelocity[1], -maxSpeed, maxSpeed);
 		btClamp(bulletVelocity[2], -maxSpeed, maxSpeed);
 		m_RigidBody->setLinearVelocity(bulletVelocity);
-		m_LinearVelocityChange.setZero();
-		m_InterPSILinearVelocity = bulletVelocity;
+		m_Dynamic->m_LinearVelocityChange.setZero();
+		m_Dynamic->m_InterPSILinearVelocity = bulletVelocity;
 		wake = (wake || !bulletVelocity.isZero());
 	}
 	if (angularVelocity != nullptr) {
@@ -819,10 +1008,10 @@ void CPhysicsObject::SetVelocityInstantaneous(const Vector *velocity, const Angu
 		btClamp(bulletAngularVelocity[0], -maxAngularSpeed, maxAngularSpeed);
 		btClamp(bulletAngularVelocity[1], -maxAngularSpeed, maxAngularSpeed);
 		btClamp(bulletAngularVelocity[2], -maxAngularSpeed, maxAngularSpeed);
-		bulletAngularVelocity = m_RigidBody->getWorldTransform().getBasis() * bulletAngularVelocity;
+		bulletAngularVelocity = m_CollisionObject->getWorldTransform().getBasis() * bulletAngularVelocity;
 		m_RigidBody->setAngularVelocity(bulletAngularVelocity);
-		m_LocalAngularVelocityChange.setZero();
-		m_InterPSIAngularVelocity = bulletAngularVelocity;
+		m_Dynamic->m_LocalAngularVelocityChange.setZero();
+		m_Dynamic->m_InterPSIAngularVelocity = bulletAngularVelocity;
 		wake = (wake || !bulletAngularVelocity.isZero());
 	}
 	if (wake) {
@@ -831,26 +1020,49 @@ void CPhysicsObject::SetVelocityInstantaneous(const Vector *velocity, const Angu
 }
 
 void CPhysicsObject::GetVelocity(Vector *velocity, AngularImpulse *angularVelocity) const {
+	if (m_EventLinearVelocity != nullptr) {
+		if (velocity != nullptr) {
+			ConvertPositionToHL(*m_EventLinearVelocity, *velocity);
+		}
+		if (angularVelocity != nullptr) {
+			ConvertAngularImpulseToHL(*m_EventAngularVelocity * m_CollisionObject->getWorldTransform().getBasis(),
+					*angularVelocity);
+		}
+		return;
+	}
+	if (IsStatic()) {
+		if (velocity != nullptr) {
+			velocity->Init();
+		}
+		if (angularVelocity != nullptr) {
+			angularVelocity->Init();
+		}
+		return;
+	}
 	if (velocity != nullptr) {
-		ConvertPositionToHL(m_RigidBody->getLinearVelocity() + m_LinearVelocityChange, *velocity);
+		ConvertPositionToHL(m_RigidBody->getLinearVelocity() + m_Dynamic->m_LinearVelocityChange, *velocity);
 	}
 	if (angularVelocity != nullptr) {
 		AngularImpulse worldAngularVelocity;
 		ConvertAngularImpulseToHL((m_RigidBody->getAngularVelocity() * 
-				m_RigidBody->getWorldTransform().getBasis()) +
-				m_LocalAngularVelocityChange, *angularVelocity);
+				m_CollisionObject->getWorldTransform().getBasis()) +
+				m_Dynamic->m_LocalAngularVelocityChange, *angularVelocity);
 	}
 }
 
 void CPhysicsObject::GetVelocityAtPoint(const Vector &worldPosition, Vector *pVelocity) const {
-	const btTransform &worldTransform = m_RigidBody->getWorldTransform();
+	if (IsStatic()) {
+		pVelocity->Init();
+		return;
+	}
+	const btTransform &worldTransform = m_CollisionObject->getWorldTransform();
 	btVector3 angularVelocity = m_RigidBody->getAngularVelocity() +
-			(worldTransform.getBasis() * m_LocalAngularVelocityChange);
+			(worldTransform.getBasis() * m_Dynamic->m_LocalAngularVelocityChange);
 	// Position is relative to the center of mass (the rigid body's position).
 	btVector3 bulletWorldPosition;
 	ConvertPositionToBullet(worldPosition, bulletWorldPosition);
 	btVector3 linearVelocity = m_RigidBody->getLinearVelocity() + angularVelocity.cross(
-			bulletWorldPosition - worldTransform.getOrigin()) + m_LinearVelocityChange;
+			bulletWorldPosition - worldTransform.getOrigin()) + m_Dynamic->m_LinearVelocityChange;
 	ConvertPositionToHL(linearVelocity, *pVelocity);
 }
 
@@ -861,19 +1073,22 @@ void CPhysicsObject::AddVelocity(const Vector *velocity, const AngularImpulse *a
 	if (velocity != nullptr) {
 		btVector3 bulletVelocity;
 		ConvertPositionToBullet(*velocity, bulletVelocity);
-		m_LinearVelocityChange += bulletVelocity;
+		m_Dynamic->m_LinearVelocityChange += bulletVelocity;
 	}
 	if (angularVelocity != nullptr) {
 		btVector3 bulletAngularVelocity;
 		ConvertAngularImpulseToBullet(*angularVelocity, bulletAngularVelocity);
-		m_LocalAngularVelocityChange += bulletAngularVelocity;
+		m_Dynamic->m_LocalAngularVelocityChange += bulletAngularVelocity;
 	}
 	Wake();
 }
 
 float CPhysicsObject::GetEnergy() const {
+	if (IsStatic()) {
+		return 0.0f;
+	}
 	btVector3 angularVelocity = m_RigidBody->getAngularVelocity() *
-			m_RigidBody->getWorldTransform().getBasis();
+			m_CollisionObject->getWorldTransform().getBasis();
 	btVector3 inertia;
 	ConvertInertiaToBullet(GetInertia(), inertia);
 	// 1/2mv^2 + 1/2Iw^2
@@ -888,7 +1103,7 @@ void CPhysicsObject::ApplyForceCenter(const Vector &forceVector) {
 	}
 	btVector3 bulletForce;
 	ConvertForceImpulseToBullet(forceVector, bulletForce);
-	m_LinearVelocityChange += bulletForce * m_RigidBody->getInvMass();
+	m_Dynamic->m_LinearVelocityChange += bulletForce * m_RigidBody->getInvMass();
 	Wake();
 }
 
@@ -898,11 +1113,11 @@ void CPhysicsObject::ApplyForceOffset(const Vector &forceVector, const Vector &w
 	}
 	btVector3 bulletWorldForce;
 	ConvertForceImpulseToBullet(forceVector, bulletWorldForce);
-	m_LinearVelocityChange += bulletWorldForce * m_RigidBody->getInvMass();
+	m_Dynamic->m_LinearVelocityChange += bulletWorldForce * m_RigidBody->getInvMass();
 	btVector3 bulletWorldPosition;
 	ConvertPositionToBullet(worldPosition, bulletWorldPosition);
-	const btTransform &worldTransform = m_RigidBody->getWorldTransform();
-	m_LocalAngularVelocityChange += ((bulletWorldPosition - worldTransform.getOrigin()).cross(
+	const btTransform &worldTransform = m_CollisionObject->getWorldTransform();
+	m_Dynamic->m_LocalAngularVelocityChange += ((bulletWorldPosition - worldTransform.getOrigin()).cross(
 			bulletWorldForce) * worldTransform.getBasis()) * m_RigidBody->getInvInertiaDiagLocal();
 	Wake();
 }
@@ -913,8 +1128,8 @@ void CPhysicsObject::ApplyTorqueCenter(const AngularImpulse &torque) {
 	}
 	btVector3 bulletWorldTorque;
 	ConvertAngularImpulseToBullet(torque, bulletWorldTorque);
-	m_LocalAngularVelocityChange += (bulletWorldTorque *
-			m_RigidBody->getWorldTransform().getBasis()) * m_RigidBody->getInvInertiaDiagLocal();
+	m_Dynamic->m_LocalAngularVelocityChange += (bulletWorldTorque *
+			m_CollisionObject->getWorldTransform().getBasis()) * m_RigidBody->getInvInertiaDiagLocal();
 	Wake();
 }
 
@@ -928,7 +1143,7 @@ void CPhysicsObject::CalculateForceOffset(const Vector &forceVector, const Vecto
 		ConvertPositionToBullet(forceVector, bulletWorldForce);
 		ConvertPositionToBullet(worldPosition, bulletWorldPosition);
 		// Center torque is in mass center-relative space (for motion controllers, not ApplyTorqueCenter).
-		const btTransform &worldTransform = m_RigidBody->getWorldTransform();
+		const btTransform &worldTransform = m_CollisionObject->getWorldTransform();
 		btVector3 bulletCenterTorque = (bulletWorldPosition - worldTransform.getOrigin()).cross(
 				bulletWorldForce) * worldTransform.getBasis();
 		ConvertAngularImpulseToHL(bulletCenterTorque, *centerTorque);
@@ -937,6 +1152,15 @@ void CPhysicsObject::CalculateForceOffset(const Vector &forceVector, const Vecto
 
 void CPhysicsObject::CalculateVelocityOffset(const Vector &forceVector, const Vector &worldPosition,
 		Vector *centerVelocity, AngularImpulse *centerAngularVelocity) const {
+	if (IsStatic()) {
+		if (centerVelocity != nullptr) {
+			centerVelocity->Init();
+		}
+		if (centerAngularVelocity != nullptr) {
+			centerAngularVelocity->Init();
+		}
+		return;
+	}
 	if (centerVelocity != nullptr) {
 		*centerVelocity = forceVector * (float) m_RigidBody->getInvMass();
 	}
@@ -945,7 +1169,7 @@ void CPhysicsObject::CalculateVelocityOffset(const Vector &forceVector, const Ve
 		ConvertPositionToBullet(forceVector, bulletWorldForce);
 		ConvertPositionToBullet(worldPosition, bulletWorldPosition);
 		// Center angular velocity is in mass center-relative space.
-		const btTransform &worldTransform = m_RigidBody->getWorldTransform();
+		const btTransform &worldTransform = m_CollisionObject->getWorldTransform();
 		btVector3 bulletCenterAngularVelocity = ((bulletWorldPosition - worldTransform.getOrigin()).cross(
 				bulletWorldForce) * worldTransform.getBasis()) * m_RigidBody->getInvInertiaDiagLocal();
 		ConvertAngularImpulseToHL(bulletCenterAngularVelocity, *centerAngularVelocity);
@@ -985,10 +1209,10 @@ void CPhysicsObject::SimulateMotionControllers(
 
 void CPhysicsObject::ApplyEventMotion(bool isWorld, bool isForce,
 		const btVector3 &linear, const btVector3 &angular) {
-	if (isForce && !IsMoveable()) {
+	if (IsStatic() || (isForce && !IsMoveable())) {
 		return;
 	}
-	const btMatrix3x3 &worldTransformBasis = m_RigidBody->getWorldTransform().getBasis();
+	const btMatrix3x3 &worldTransformBasis = m_CollisionObject->getWorldTransform().getBasis();
 	bool wake = false;
 	if (!linear.isZero()) {
 		btVector3 worldLinearAcceleration = linear;
@@ -1040,8 +1264,8 @@ void CPhysicsObject::UpdateShadow(const Vector &targetPosition, const QAngle &ta
 
 int CPhysicsObject::GetShadowPosition(Vector *position, QAngle *angles) const {
 	btTransform transform;
-	btTransformUtil::integrateTransform(m_RigidBody->getWorldTransform(),
-			m_RigidBody->getLinearVelocity(), m_RigidBody->getAngularVelocity(),
+	btTransformUtil::integrateTransform(m_CollisionObject->getWorldTransform(),
+			GetBulletLinearVelocity(), GetBulletAngularVelocity(),
 			m_Environment->GetSimulationTimestep(), transform);
 	if (position != nullptr) {
 		ConvertPositionToHL(transform.getOrigin() -
@@ -1115,6 +1339,9 @@ void CPhysicsObject::NotifyAttachedToPlayerController(
 btScalar CPhysicsObject::ComputeBulletShadowControl(ShadowControlBulletParameters_t &params,
 		btScalar secondsToArrival, btScalar timeStep) {
 	Assert(m_Environment->IsInSimulation()); // Not going to touch interpolated values here.
+	if (IsStatic()) {
+		return btMax(secondsToArrival - timeStep, btScalar(0.0f));
+	}
 
 	// Resample fraction.
 	// This allows us to arrive at the target at the requested time.
@@ -1129,7 +1356,7 @@ btScalar CPhysicsObject::ComputeBulletShadowControl(ShadowControlBulletParameter
 	fraction *= 1.0f / timeStep;
 
 	// Not a reference because it may be modified by ProceedToTransform.
-	const btTransform &worldTransform = m_RigidBody->getWorldTransform();
+	const btTransform &worldTransform = m_CollisionObject->getWorldTransform();
 	const btVector3 &massCenter = GetBulletMassCenter();
 	btVector3 objectPosition = worldTransform.getOrigin() - (worldTransform.getBasis() * massCenter);
 	btVector3 localAngularVelocity = m_RigidBody->getAngularVelocity() * worldTransform.getBasis();
@@ -1222,35 +1449,37 @@ void CPhysicsObject::EnableCollisions(bool enable) {
 		return;
 	}
 	m_CollisionEnabled = enable;
+	btBroadphaseProxy *proxy = m_CollisionObject->getBroadphaseHandle();
+	if (proxy != nullptr) {
+		proxy->m_collisionFilterMask = GetCollisionFilterMask();
+	}
 	if (!enable) {
-		static_cast<CPhysicsEnvironment *>(m_Environment)->RemoveObjectCollisionPairs(m_RigidBody);
+		static_cast<CPhysicsEnvironment *>(m_Environment)->RemoveObjectCollisionPairs(m_CollisionObject);
 	}
 }
 
 void CPhysicsObject::RecheckCollisionFilter() {
-	static_cast<CPhysicsEnvironment *>(m_Environment)->RecheckObjectCollisionFilter(m_RigidBody);
+	static_cast<CPhysicsEnvironment *>(m_Environment)->RecheckObjectCollisionFilter(m_CollisionObject);
 }
 
 void CPhysicsObject::RecheckContactPoints() {
-	// The game calls this only after doing things that change collision rules,
-	// so RecheckCollisionFilter is always called prior to this.
-	// RecheckCollisionFilter removes obsolete contact points, so this isn't needed.
-	// There also were plans to make it recheck contact points in IVP VPhysics.
+	// The game calls this after changing collision rules, and disabling collisions between two objects
+	// calls only this, not RecheckCollisionFilter. Rechecking the filter drops the cached verdicts
+	// and the pairs that shouldn't collide anymore along with their contact points.
+	RecheckCollisionFilter();
 }
 
 bool CPhysicsObject::GetContactPoint(Vector *contactPoint, IPhysicsObject **contactObject) const {
-	const btCollisionDispatcher *dispatcher =
-			static_cast<CPhysicsEnvironment *>(m_Environment)->GetCollisionDispatcher();
-	int manifoldCount = dispatcher->getNumManifolds();
+	int manifoldCount = m_ContactManifolds.Count();
 	for (int manifoldIndex = 0; manifoldIndex < manifoldCount; ++manifoldIndex) {
-		const btPersistentManifold *manifold = dispatcher->getManifoldByIndexInternal(manifoldIndex);
+		const btPersistentManifold *manifold = m_ContactManifolds[manifoldIndex];
 		if (manifold->getNumContacts() == 0) {
 			continue;
 		}
 		// Contact point 0 is considered the best by Bullet.
 		const btManifoldPoint &manifoldPoint = manifold->getContactPoint(0);
 		const btCollisionObject *body0 = manifold->getBody0(), *body1 = manifold->getBody1();
-		if (body0 == m_RigidBody) {
+		if (body0 == m_CollisionObject) {
 			if (!body1->hasContactResponse()) {
 				continue;
 			}
@@ -1262,18 +1491,16 @@ bool CPhysicsObject::GetContactPoint(Vector *contactPoint, IPhysicsObject **cont
 			}
 			return true;
 		}
-		if (body1 == m_RigidBody) {
-			if (!body0->hasContactResponse()) {
-				continue;
-			}
-			if (contactPoint != nullptr) {
-				ConvertPositionToHL(manifoldPoint.getPositionWorldOnB(), *contactPoint);
-			}
-			if (contactObject != nullptr) {
-				*contactObject = reinterpret_cast<IPhysicsObject *>(body0->getUserPointer());
-			}
-			return true;
+		if (!body0->hasContactResponse()) {
+			continue;
 		}
+		if (contactPoint != nullptr) {
+			ConvertPositionToHL(manifoldPoint.getPositionWorldOnB(), *contactPoint);
+		}
+		if (contactObject != nullptr) {
+			*contactObject = reinterpret_cast<IPhysicsObject *>(body0->getUserPointer());
+		}
+		return true;
 	}
 	return false;
 }
@@ -1291,24 +1518,25 @@ void CPhysicsObject::DestroyFrictionSnapshot(IPhysicsFrictionSnapshot *pSnapshot
  ***********/
 
 bool CPhysicsObject::IsTrigger() const {
-	return (m_RigidBody->getCollisionFlags() & btCollisionObject::CF_NO_CONTACT_RESPONSE) != 0;
+	return (m_CollisionObject->getCollisionFlags() & btCollisionObject::CF_NO_CONTACT_RESPONSE) != 0;
 }
 
 void CPhysicsObject::BecomeTrigger() {
 	if (IsTrigger()) {
 		return;
 	}
-	m_RigidBody->setCollisionFlags(m_RigidBody->getCollisionFlags() |
+	m_CollisionObject->setCollisionFlags(m_CollisionObject->getCollisionFlags() |
 			btCollisionObject::CF_NO_CONTACT_RESPONSE);
+	static_cast<CPhysicsEnvironment *>(m_Environment)->NotifyTriggerStateChanged(this);
 }
 
 void CPhysicsObject::RemoveTrigger() {
 	if (!IsTrigger()) {
 		return;
 	}
-	m_RigidBody->setCollisionFlags(m_RigidBody->getCollisionFlags() &
+	m_CollisionObject->setCollisionFlags(m_CollisionObject->getCollisionFlags() &
 			~btCollisionObject::CF_NO_CONTACT_RESPONSE);
-	static_cast<CPhysicsEnvironment *>(m_Environment)->NotifyTriggerRemoved(this);
+	static_cast<CPhysicsEnvironment *>(m_Environment)->NotifyTriggerStateChanged(this);
 }
 
 /***************************************
@@ -139,8 +139,27 @@ public:
 
 	// Internal methods.
 
+	FORCEINLINE btCollisionObject *GetCollisionObject() const { return m_CollisionObject; }
+	// Null for static objects, which are plain collision objects without mass and velocity.
 	FORCEINLINE btRigidBody *GetRigidBody() const { return m_RigidBody; }
 
+	// Zero for static objects.
+	FORCEINLINE btScalar GetBulletInvMass() const {
+		return (m_RigidBody != nullptr ? m_RigidBody->getInvMass() : btScalar(0.0f));
+	}
+	FORCEINLINE btVector3 GetBulletLinearVelocity() const {
+		return (m_RigidBody != nullptr ? m_RigidBody->getLinearVelocity() : btVector3(0.0f, 0.0f, 0.0f));
+	}
+	FORCEINLINE btVector3 GetBulletAngularVelocity() const {
+		return (m_RigidBody != nullptr ? m_RigidBody->getAngularVelocity() : btVector3(0.0f, 0.0f, 0.0f));
+	}
+	FORCEINLINE btVector3 GetBulletVelocityAtPoint(const btVector3 &worldPosition) const {
+		if (m_RigidBody == nullptr) {
+			return btVector3(0.0f, 0.0f, 0.0f);
+		}
+		return m_RigidBody->getVelocityInLocalPoint(worldPosition - m_RigidBody->getCenterOfMassPosition());
+	}
+
 	FORCEINLINE IPhysicsEnvironment *GetEnvironment() const { return m_Environment; }
 
 	inline bool WasAsleep() const { return m_WasAsleep; }
@@ -150,6 +169,15 @@ public:
 		return wasAsleep;
 	}
 
+	// Indices in the environment's object arrays for removal without searching, -1 if not there.
+	FORCEINLINE int GetObjectIndex() const { return m_ObjectIndex; }
+	FORCEINLINE void SetObjectIndex(int objectIndex) { m_ObjectIndex = objectIndex; }
+	FORCEINLINE int GetNonStaticIndex() const { return m_NonStaticIndex; }
+	FORCEINLINE void SetNonStaticIndex(int nonStaticIndex) { m_NonStaticIndex = nonStaticIndex; }
+	// Index in the environment's awake object array, -1 if not there.
+	FORCEINLINE int GetActiveIndex() const { return m_ActiveIndex; }
+	FORCEINLINE void SetActiveIndex(int activeIndex) { m_ActiveIndex = activeIndex; }
+
 	const btVector3 &GetBulletMassCenter() const;
 	void GetPositionAtPSI(Vector *worldPosition, QAngle *angles) const;
 	void ProceedToTransform(const btTransform &transform);
@@ -166,23 +194,59 @@ public:
 
 	void UpdateMaterial();
 
+	// Sweeping of fast-moving objects against others, so they don't tunnel through thin brushes.
+	void UpdateContinuousCollision();
+
+	// Velocity changes are only stored for non-static objects.
 	FORCEINLINE const btVector3 &GetLinearVelocityChange() const {
-		return m_LinearVelocityChange;
+		return m_Dynamic->m_LinearVelocityChange;
 	}
 	FORCEINLINE const btVector3 &GetLocalAngularVelocityChange() const {
-		return m_LocalAngularVelocityChange;
+		return m_Dynamic->m_LocalAngularVelocityChange;
 	}
 	// Moveability not checked - async impulses (not forces) are still okay for internal use.
 	FORCEINLINE void SetLinearVelocityChange(const btVector3 &linearVelocityChange) {
-		m_LinearVelocityChange = linearVelocityChange;
+		m_Dynamic->m_LinearVelocityChange = linearVelocityChange;
 	}
 	FORCEINLINE void SetLocalAngularVelocityChange(const btVector3 &localAngularVelocityChange) {
-		m_LocalAngularVelocityChange = localAngularVelocityChange;
+		m_Dynamic->m_LocalAngularVelocityChange = localAngularVelocityChange;
+	}
+
+	// Impacts and deep penetrations of non-static objects within the current PSI, for the collision limit.
+	FORCEINLINE int GetPSICollisionCount() const { return m_Dynamic->m_PSICollisionCount; }
+	FORCEINLINE void IncrementPSICollisionCount() { ++m_Dynamic->m_PSICollisionCount; }
+	FORCEINLINE void ResetPSICollisionCount() { m_Dynamic->m_PSICollisionCount = 0; }
+
+	// Velocities before the current PSI, for collision events. Saved for active objects before every PSI,
+	// and cleared when they fall asleep, as Bullet clears the velocities of objects deactivated by it.
+	FORCEINLINE void SavePrePSIVelocity() {
+		m_Dynamic->m_PrePSILinearVelocity = m_RigidBody->getLinearVelocity();
+		m_Dynamic->m_PrePSIAngularVelocity = m_RigidBody->getAngularVelocity();
+	}
+	FORCEINLINE void ClearPrePSIVelocity() {
+		m_Dynamic->m_PrePSILinearVelocity.setZero();
+		m_Dynamic->m_PrePSIAngularVelocity.setZero();
+	}
+	FORCEINLINE void GetPrePSIVelocity(btVector3 &linear, btVector3 &angular) const {
+		if (IsStatic()) {
+			linear.setZero();
+			angular.setZero();
+			return;
+		}
+		linear = m_Dynamic->m_PrePSILinearVelocity;
+		angular = m_Dynamic->m_PrePSIAngularVelocity;
 	}
 
 	// Bullet integrates forces and torques over time, in IVP async pushes are applied fully.
 	void ApplyForcesAndSpeedLimit(btScalar timeStep);
 
+#ifndef BT_USE_DOUBLE_PRECISION
+	// Batched equivalents of ApplyDamping, ApplyForcesAndSpeedLimit and ApplyGravity, and of ApplyDrag.
+	// Per-object checks are done here, the velocities are changed when the batch stage is run.
+	void AddToForceBatch(class CPhysicsVelocityBatch &batch, btScalar timeStep);
+	void AddToDragBatch(class CPhysicsVelocityBatch &batch, btScalar timeStep);
+#endif
+
 	// No force should EVER be applied with applyForce/applyCentralForce/applyTorque,
 	// as we take over force application. Bullet may only apply gravity, but we set it to 0.
 	void CheckAndClearBulletForces();
@@ -207,6 +271,19 @@ public:
 	bool IsPartOfSameVehicle(const IPhysicsObject *otherObject) const;
 	void SimulateVehicle(btScalar timeStep);
 
+	// Broadphase proxy filtering - static objects don't collide with each other, and objects with collisions
+	// disabled don't collide with anything, so such pairs are rejected without calling the environment.
+	FORCEINLINE int GetCollisionFilterGroup() const {
+		return IsStatic() ? btBroadphaseProxy::StaticFilter : btBroadphaseProxy::DefaultFilter;
+	}
+	FORCEINLINE int GetCollisionFilterMask() const {
+		if (!m_CollisionEnabled) {
+			return 0;
+		}
+		return IsStatic() ? (btBroadphaseProxy::AllFilter ^ btBroadphaseProxy::StaticFilter) :
+				btBroadphaseProxy::AllFilter;
+	}
+
 	FORCEINLINE CPhysicsObject *GetNextCollideObject() const {
 		return m_CollideObjectNext;
 	}
@@ -222,25 +299,41 @@ public:
 		return m_TouchingTriggers > 0;
 	}
 
+	// Manifolds involving this object, including those without contact points, maintained by the dispatcher.
+	FORCEINLINE const CUtlVector<btPersistentManifold *> &GetContactManifolds() const {
+		return m_ContactManifolds;
+	}
+	FORCEINLINE void AddContactManifold(btPersistentManifold *manifold) {
+		m_ContactManifolds.AddToTail(manifold);
+	}
+	FORCEINLINE void RemoveContactManifold(btPersistentManifold *manifold) {
+		m_ContactManifolds.FindAndFastRemove(manifold);
+	}
+
+	// World velocity reported by GetVelocity while the game handles a collision event, the current one if null.
+	FORCEINLINE void SetEventVelocity(const btVector3 *linear, const btVector3 *angular) {
+		m_EventLinearVelocity = linear;
+		m_EventAngularVelocity = angular;
+	}
+
 	FORCEINLINE bool IsAttachedToConstraintObjects() const {
-		return m_ConstraintObjectCount > 0;
+		return m_ConstraintObjects.Count() > 0;
+	}
+	FORCEINLINE const CUtlVector<IPhysicsConstraint *> &GetConstraintObjects() const {
+		return m_ConstraintObjects;
 	}
-	FORCEINLINE void NotifyConstraintAdded(bool valid) {
-		++m_ConstraintObjectCount;
+	FORCEINLINE void NotifyConstraintAdded(IPhysicsConstraint *constraint, bool valid) {
+		m_ConstraintObjects.AddToTail(constraint);
 		if (valid) {
 			++m_ValidConstraintCount;
 		}
 	}
-	FORCEINLINE void NotifyConstraintRemoved(bool valid) {
+	FORCEINLINE void NotifyConstraintRemoved(IPhysicsConstraint *constraint, bool valid) {
 		if (valid) {
 			Assert(m_ValidConstraintCount > 0);
 			m_ValidConstraintCount = btMax(m_ValidConstraintCount - 1, 0);
 		}
-		Assert(m_ConstraintObjectCount > 0);
-		m_ConstraintObjectCount = btMax(m_ConstraintObjectCount - 1, 0);
-	}
-	FORCEINLINE void NotifyAllConstraintsRemoved() {
-		m_ValidConstraintCount = m_ConstraintObjectCount = 0;
+		m_ConstraintObjects.FindAndFastRemove(constraint);
 	}
 
 	void UpdateAfterPSI(); // Only called for non-static objects.
@@ -248,7 +341,7 @@ public:
 	void InterpolateBetweenPSIs();
 	inline const btTransform &GetInterPSIWorldTransform() const {
 		return ((IsStatic() || m_Environment->IsInSimulation()) ?
-				m_RigidBody->getWorldTransform() : m_InterPSIWorldTransform);
+				m_CollisionObject->getWorldTransform() : m_Dynamic->m_InterPSIWorldTransform);
 	}
 
 	void NotifyTransferred(IPhysicsEnvironment *newEnvironment);
@@ -259,6 +352,13 @@ public:
 	// Destruction permitting calling back through virtual functions.
 	// NotifyQueuedForRemoval must be called before a call to Release happens!!!
 	void Release();
+	// Release split in two, for objects that buffered collision events may still reference -
+	// removed from the environment first, with the memory freed after the events are delivered.
+	void ReleaseKeepingMemory();
+	void DeleteAfterRelease();
+	// Same as Release, but when the environment has already destroyed the world as a whole,
+	// so the object isn't removed from it and the environment isn't notified.
+	void ReleaseWithWorld();
 
 private:
 	/***********************************
@@ -267,7 +367,22 @@ private:
 
 	IPhysicsEnvironment *m_Environment;
 
-	btRigidBody *m_RigidBody;
+	// World brushes and static props are the majority of objects on maps, and they never move,
+	// so they are plain collision objects, and only moving objects are rigid bodies.
+	btCollisionObject *m_CollisionObject;
+	btRigidBody *m_RigidBody; // Same as the collision object, or null for static objects.
+
+	// Bullet synchronizes motion states of active bodies only, so this is where the environment
+	// finds out about objects woken up by Bullet itself (by contacts with awake objects, for instance).
+	class MotionState : public btMotionState {
+	public:
+		MotionState(CPhysicsObject *object) : m_Object(object) {}
+		virtual void getWorldTransform(btTransform &worldTrans) const;
+		virtual void setWorldTransform(const btTransform &worldTrans);
+	private:
+		CPhysicsObject *m_Object;
+	};
+	MotionState m_MotionState;
 
 	CPhysCollide *GetCollide();
 	CPhysicsObject *m_CollideObjectNext, *m_CollideObjectPrevious;
@@ -284,19 +399,36 @@ private:
 
 	bool m_GravityEnabled;
 	bool m_ShadowTempGravityDisable;
-	float m_LinearDamping, m_AngularDamping;
 
 	int m_MaterialIndex, m_RealMaterialIndex;
 	unsigned int m_ContentsMask;
 
-	btScalar m_LinearDragCoefficient, m_AngularDragCoefficient;
-	btVector3 m_LinearDragBasis, m_AngularDragBasis;
-	bool m_DragEnabled;
+	// State that only moving objects use, not allocated for static objects (world brushes and static props),
+	// which are the majority of objects on maps, to keep them small.
+	struct DynamicState {
+		float m_LinearDamping, m_AngularDamping;
+
+		btScalar m_LinearDragCoefficient, m_AngularDragCoefficient;
+		btVector3 m_LinearDragBasis, m_AngularDragBasis;
+		bool m_DragEnabled;
+
+		btVector3 m_LinearVelocityChange, m_LocalAngularVelocityChange;
+
+		btTransform m_InterPSIWorldTransform;
+		btVector3 m_InterPSILinearVelocity, m_InterPSIAngularVelocity;
+
+		btVector3 m_PrePSILinearVelocity, m_PrePSIAngularVelocity;
+
+		int m_PSICollisionCount;
+	};
+	DynamicState *m_Dynamic;
+
 	static btScalar AngularDragIntegral(btScalar l, btScalar w, btScalar h);
 	void ComputeDragBases();
 
 	CUtlVector<IPhysicsMotionController *> m_MotionControllers;
 	void DetachFromMotionControllers();
+	void DetachBeforeRelease();
 
 	IPhysicsShadowController *m_Shadow;
 	IPhysicsPlayerController *m_Player;
@@ -306,12 +438,14 @@ private:
 
 	bool m_CollisionEnabled;
 
-	int m_ConstraintObjectCount, m_ValidConstraintCount;
+	// Constraint objects attached to this object, both valid and invalid, so they can be detached on removal.
+	CUtlVector<IPhysicsConstraint *> m_ConstraintObjects;
+	int m_ValidConstraintCount;
 
 	void *m_GameData;
 	unsigned short m_GameFlags;
 	unsigned short m_GameIndex;
-	char m_Name[128];
+	char *m_Name; // Null if not named.
 
 	unsigned short m_Callbacks;
 
@@ -321,13 +455,13 @@ private:
 
 	// Was the object active in the previous PSI - used to trigger sleep events.
 	bool m_WasAsleep;
-
-	btVector3 m_LinearVelocityChange, m_LocalAngularVelocityChange;
+	int m_ObjectIndex, m_NonStaticIndex, m_ActiveIndex;
 
 	int m_TouchingTriggers;
 
-	btTransform m_InterPSIWorldTransform;
-	btVector3 m_InterPSILinearVelocity, m_InterPSIAngularVelocity;
+	CUtlVector<btPersistentManifold *> m_ContactManifolds;
+
+	const btVector3 *m_EventLinearVelocity, *m_EventAngularVelocity;
 };
 
 #endif
@@ -0,0 +1,195 @@
+// Copyright Valve Corporation, All rights reserved.
+// Bullet integration by Triang3l, derivative work, in public domain if detached from Valve's work.
+
+#ifndef PHYSICS_PAIRHASH_H
+#define PHYSICS_PAIRHASH_H
+
+#include "physics_internal.h"
+
+// Set of ordered physics object pairs with per-pair data and linked lists of pairs for every object.
+// Pair indices are persistent until removal, so pairs can be iterated by index while being modified.
+// Same layout as CPhysicsObjectPairHash, but the order of the objects is meaningful.
+
+template<typename PairData>
+class CPhysicsPairHash {
+public:
+	struct Pair {
+		IPhysicsObject *m_Objects[2]; // Free if the first object is nullptr.
+		PairData m_Data;
+	};
+
+	CPhysicsPairHash() : m_FirstFreePair(-1), m_PairCount(0) {
+		m_PairArray.reserve(16);
+		GrowTables();
+	}
+
+	FORCEINLINE int GetPairArraySize() const { return m_PairArray.size(); }
+	FORCEINLINE int GetPairCount() const { return m_PairCount; }
+	FORCEINLINE Pair &GetPair(int pairIndex) { return m_PairArray[pairIndex].m_Pair; }
+	FORCEINLINE bool IsPairUsed(int pairIndex) const { return m_PairArray[pairIndex].m_Pair.m_Objects[0] != nullptr; }
+
+	int FindPair(IPhysicsObject *object0, IPhysicsObject *object1) const {
+		int pairIndex = m_HashTable[GetHash(object0, object1)];
+		while (pairIndex >= 0) {
+			const Pair &pair = m_PairArray[pairIndex].m_Pair;
+			if (pair.m_Objects[0] == object0 && pair.m_Objects[1] == object1) {
+				break;
+			}
+			pairIndex = m_Next[pairIndex];
+		}
+		return pairIndex;
+	}
+
+	// The pair must not exist yet, its data is not initialized.
+	int AddPair(IPhysicsObject *object0, IPhysicsObject *object1) {
+		Assert(object0 != nullptr && object1 != nullptr && object0 != object1);
+		Assert(FindPair(object0, object1) < 0);
+
+		int pairIndex;
+		if (m_FirstFreePair >= 0) {
+			pairIndex = m_FirstFreePair;
+			m_FirstFreePair = m_PairArray[pairIndex].m_Next[0];
+		} else {
+			pairIndex = m_PairArray.size();
+			int oldCapacity = m_PairArray.capacity();
+			m_PairArray.expandNonInitializing();
+			if (oldCapacity < m_PairArray.capacity()) {
+				m_PairArray[pairIndex].m_Pair.m_Objects[0] = nullptr; // Ignore during expansion.
+				GrowTables();
+			}
+		}
+
+		Pair &pair = m_PairArray[pairIndex].m_Pair;
+		pair.m_Objects[0] = object0;
+		pair.m_Objects[1] = object1;
+
+		LinkToObject(pairIndex, 0);
+		LinkToObject(pairIndex, 1);
+
+		unsigned int hash = GetHash(object0, object1);
+		m_Next[pairIndex] = m_HashTable[hash];
+		m_HashTable[hash] = pairIndex;
+
+		++m_PairCount;
+		return pairIndex;
+	}
+
+	void RemovePair(int pairIndex) {
+		PairEntry &entry = m_PairArray[pairIndex];
+		Assert(entry.m_Pair.m_Objects[0] != nullptr);
+
+		unsigned int hash = GetHash(entry.m_Pair.m_Objects[0], entry.m_Pair.m_Objects[1]);
+		int previousHashPairIndex = -1, hashPairIndex = m_HashTable[hash];
+		while (hashPairIndex != pairIndex && hashPairIndex >= 0 /* Safety */) {
+			previousHashPairIndex = hashPairIndex;
+			hashPairIndex = m_Next[hashPairIndex];
+		}
+		Assert(hashPairIndex == pairIndex);
+		if (previousHashPairIndex >= 0) {
+			m_Next[previousHashPairIndex] = m_Next[pairIndex];
+		} else {
+			m_HashTable[hash] = m_Next[pairIndex];
+		}
+
+		UnlinkFromObject(pairIndex, 0);
+		UnlinkFromObject(pairIndex, 1);
+
+		entry.m_Pair.m_Objects[0] = nullptr;
+		entry.m_Next[0] = m_FirstFreePair;
+		m_FirstFreePair = pairIndex;
+		--m_PairCount;
+	}
+
+	// Iteration over the pairs the object is in, at either side.
+	int GetFirstPairForObject(IPhysicsObject *object) const {
+		const int *firstPair = m_FirstPairsForObjects.find(object);
+		return (firstPair != nullptr ? *firstPair : -1);
+	}
+	FORCEINLINE int GetNextPairForObject(int pairIndex, IPhysicsObject *object) const {
+		const PairEntry &entry = m_PairArray[pairIndex];
+		return entry.m_Next[(int) (entry.m_Pair.m_Objects[0] != object)];
+	}
+
+private:
+	FORCEINLINE unsigned int GetHash(IPhysicsObject *object0, IPhysicsObject *object1) const {
+		return btHashPtr(reinterpret_cast<void *>(reinterpret_cast<size_t>(object0) +
+				reinterpret_cast<size_t>(object1))).getHash() &
+				((unsigned int) m_PairArray.capacity() - 1);
+	}
+
+	struct PairEntry {
+		Pair m_Pair;
+		// Linked lists of pairs for each object. m_Next[0] also links the free list.
+		int m_Previous[2], m_Next[2];
+	};
+
+	btAlignedObjectArray<PairEntry> m_PairArray;
+	int m_FirstFreePair; // Using a free list to make indices persistent.
+	int m_PairCount;
+
+	btAlignedObjectArray<int> m_HashTable;
+	btAlignedObjectArray<int> m_Next;
+
+	btHashMap<btHashPtr, int> m_FirstPairsForObjects;
+
+	void GrowTables() {
+		int newCapacity = m_PairArray.capacity();
+		if (m_HashTable.size() >= newCapacity) {
+			return;
+		}
+
+		m_HashTable.resizeNoInitialize(newCapacity);
+		memset(&m_HashTable[0], 0xff, newCapacity * sizeof(m_HashTable[0]));
+		m_Next.resizeNoInitialize(newCapacity);
+		memset(&m_Next[0], 0xff, newCapacity * sizeof(m_Next[0]));
+
+		int pairCount = m_PairArray.size();
+		for (int pairIndex = 0; pairIndex < pairCount; ++pairIndex) {
+			const Pair &pair = m_PairArray[pairIndex].m_Pair;
+			if (pair.m_Objects[0] == nullptr) {
+				continue; // Free pair.
+			}
+			unsigned int hash = GetHash(pair.m_Objects[0], pair.m_Objects[1]);
+			m_Next[pairIndex] = m_HashTable[hash];
+			m_HashTable[hash] = pairIndex;
+		}
+	}
+
+	void LinkToObject(int pairIndex, int objectIndex) {
+		PairEntry &entry = m_PairArray[pairIndex];
+		IPhysicsObject *object = entry.m_Pair.m_Objects[objectIndex];
+		entry.m_Previous[objectIndex] = -1;
+		int *firstPair = m_FirstPairsForObjects.find(object);
+		if (firstPair != nullptr) {
+			PairEntry &nextEntry = m_PairArray[*firstPair];
+			nextEntry.m_Previous[(int) (nextEntry.m_Pair.m_Objects[0] != object)] = pairIndex;
+			entry.m_Next[objectIndex] = *firstPair;
+			*firstPair = pairIndex;
+		} else {
+			entry.m_Next[objectIndex] = -1;
+			m_FirstPairsForObjects.insert(object, pairIndex);
+		}
+	}
+
+	void UnlinkFromObject(int pairIndex, int objectIndex) {
+		PairEntry &entry = m_PairArray[pairIndex];
+		IPhysicsObject *object = entry.m_Pair.m_Objects[objectIndex];
+		int previousPairIndex = entry.m_Previous[objectIndex], nextPairIndex = entry.m_Next[objectIndex];
+		if (nextPairIndex >= 0) {
+			PairEntry &nextEntry = m_PairArray[nextPairIndex];
+			nextEntry.m_Previous[(int) (nextEntry.m_Pair.m_Objects[0] != object)] = previousPairIndex;
+		}
+		if (previousPairIndex >= 0) {
+			PairEntry &previousEntry = m_PairArray[previousPairIndex];
+			previousEntry.m_Next[(int) (previousEntry.m_Pair.m_Objects[0] != object)] = nextPairIndex;
+		} else {
+			if (nextPairIndex >= 0) {
+				m_FirstPairsForObjects.insert(object, nextPairIndex);
+			} else {
+				m_FirstPairsForObjects.remove(object);
+			}
+		}
+	}
+};
+
+#endif
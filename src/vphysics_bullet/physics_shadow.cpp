@@ -50,7 +50,7 @@ void CPhysicsShadowController::MaxSpeed(float maxSpeed, float maxAngularSpeed) {
 
 void CPhysicsShadowController::StepUp(float height) {
 	CPhysicsObject *object = static_cast<CPhysicsObject *>(m_Object);
-	btTransform transform = object->GetRigidBody()->getWorldTransform();
+	btTransform transform = object->GetCollisionObject()->getWorldTransform();
 	transform.getOrigin()[1] += HL2BULLET(height);
 	object->ProceedToTransform(transform);
 }
@@ -203,7 +203,7 @@ void CPhysicsPlayerController::Update(const Vector &position, const Vector &velo
 	m_Ground = ground;
 	if (ground != nullptr) {
 		m_TargetGroundLocalPosition = static_cast<const CPhysicsObject *>(
-				ground)->GetRigidBody()->getWorldTransform().invXform(targetObjectPosition);
+				ground)->GetCollisionObject()->getWorldTransform().invXform(targetObjectPosition);
 	}
 	// onground is not used, StepUp serves its purpose.
 }
@@ -214,23 +214,16 @@ void CPhysicsPlayerController::SetEventHandler(IPhysicsPlayerControllerEvent *ha
 
 bool CPhysicsPlayerController::IsInContact() {
 	const CPhysicsObject *object = static_cast<const CPhysicsObject *>(m_Object);
-	const btCollisionObject *collisionObject = object->GetRigidBody();
-	const btCollisionDispatcher *dispatcher = static_cast<const CPhysicsEnvironment *>(
-			object->GetEnvironment())->GetCollisionDispatcher();
-	int manifoldCount = dispatcher->getNumManifolds();
+	const btCollisionObject *collisionObject = object->GetCollisionObject();
+	const CUtlVector<btPersistentManifold *> &manifolds = object->GetContactManifolds();
+	int manifoldCount = manifolds.Count();
 	for (int manifoldIndex = 0; manifoldIndex < manifoldCount; ++manifoldIndex) {
-		const btPersistentManifold *manifold = dispatcher->getManifoldByIndexInternal(manifoldIndex);
+		const btPersistentManifold *manifold = manifolds[manifoldIndex];
 		if (manifold->getNumContacts() == 0) {
 			continue;
 		}
-		const btCollisionObject *otherCollisionObject;
-		if (manifold->getBody0() == collisionObject) {
-			otherCollisionObject = manifold->getBody1();
-		} else if (manifold->getBody1() == collisionObject) {
-			otherCollisionObject = manifold->getBody0();
-		} else {
-			continue;
-		}
+		const btCollisionObject *otherCollisionObject = (manifold->getBody0() == collisionObject ?
+				manifold->getBody1() : manifold->getBody0());
 		if (!otherCollisionObject->hasContactResponse()) {
 			continue;
 		}
@@ -248,7 +241,7 @@ void CPhysicsPlayerController::MaxSpeed(const Vector &maxVelocity) {
 	btVector3 bulletMaxVelocity;
 	ConvertPositionToBullet(maxVelocity, bulletMaxVelocity);
 	btScalar dot = bulletMaxVelocity.dot(static_cast<CPhysicsObject *>(
-			m_Object)->GetRigidBody()->getLinearVelocity());
+			m_Object)->GetBulletLinearVelocity());
 	if (dot > 0.0f) {
 		bulletMaxVelocity -= bulletMaxVelocity * (dot * bulletMaxVelocity.length()); 
 	}
@@ -270,10 +263,9 @@ void CPhysicsPlayerController::SetObject(IPhysicsObject *pObject) {
 
 int CPhysicsPlayerController::GetShadowPosition(Vector *position, QAngle *angles) {
 	const CPhysicsObject *object = static_cast<const CPhysicsObject *>(m_Object);
-	const btRigidBody *rigidBody = object->GetRigidBody();
 	btTransform transform;
-	btTransformUtil::integrateTransform(rigidBody->getWorldTransform(),
-			rigidBody->getLinearVelocity(), rigidBody->getAngularVelocity(),
+	btTransformUtil::integrateTransform(object->GetCollisionObject()->getWorldTransform(),
+			object->GetBulletLinearVelocity(), object->GetBulletAngularVelocity(),
 			object->GetEnvironment()->GetSimulationTimestep(), transform);
 	if (position != nullptr) {
 		ConvertPositionToHL(transform.getOrigin() -
@@ -287,7 +279,7 @@ int CPhysicsPlayerController::GetShadowPosition(Vector *position, QAngle *angles
 
 void CPhysicsPlayerController::StepUp(float height) {
 	CPhysicsObject *object = static_cast<CPhysicsObject *>(m_Object);
-	btTransform transform = object->GetRigidBody()->getWorldTransform();
+	btTransform transform = object->GetCollisionObject()->getWorldTransform();
 	transform.getOrigin()[1] += HL2BULLET(height);
 	object->ProceedToTransform(transform);
 }
@@ -301,15 +293,14 @@ void CPhysicsPlayerController::GetShadowVelocity(Vector *velocity) {
 		return;
 	}
 	const CPhysicsObject *object = static_cast<CPhysicsObject *>(m_Object);
-	btVector3 bulletVelocity = object->GetRigidBody()->getLinearVelocity() + object->GetLinearVelocityChange();
+	btVector3 bulletVelocity = object->GetBulletLinearVelocity();
+	if (!object->IsStatic()) {
+		bulletVelocity += object->GetLinearVelocityChange();
+	}
 	if (m_Ground != nullptr) {
-		const btRigidBody *groundRigidBody =
-				static_cast<const CPhysicsObject *>(m_Ground)->GetRigidBody();
-		const btTransform &groundWorldTransform = groundRigidBody->getWorldTransform();
-		btVector3 groundLocalAngularVelocity =
-				groundRigidBody->getAngularVelocity() * groundWorldTransform.getBasis();
-		bulletVelocity -= groundRigidBody->getLinearVelocity() + (groundWorldTransform.getBasis() *
-				groundLocalAngularVelocity.cross(m_TargetGroundLocalPosition));
+		const CPhysicsObject *ground = static_cast<const CPhysicsObject *>(m_Ground);
+		bulletVelocity -= ground->GetBulletVelocityAtPoint(
+				ground->GetCollisionObject()->getWorldTransform() * m_TargetGroundLocalPosition);
 	}
 	ConvertPositionToHL(bulletVelocity, *velocity);
 }
@@ -362,14 +353,9 @@ void CPhysicsPlayerController::Simulate(btScalar timeStep) {
 
 	btVector3 groundVelocity;
 	if (m_Ground != nullptr) {
-		const btRigidBody *groundRigidBody =
-				static_cast<const CPhysicsObject *>(m_Ground)->GetRigidBody();
-		const btTransform &groundWorldTransform = groundRigidBody->getWorldTransform();
-		m_TargetObjectPosition = groundWorldTransform * m_TargetGroundLocalPosition;
-		btVector3 groundLocalAngularVelocity =
-				groundRigidBody->getAngularVelocity() * groundWorldTransform.getBasis();
-		groundVelocity = groundRigidBody->getLinearVelocity() + (groundWorldTransform.getBasis() *
-				groundLocalAngularVelocity.cross(m_TargetGroundLocalPosition));
+		const CPhysicsObject *ground = static_cast<const CPhysicsObject *>(m_Ground);
+		m_TargetObjectPosition = ground->GetCollisionObject()->getWorldTransform() * m_TargetGroundLocalPosition;
+		groundVelocity = ground->GetBulletVelocityAtPoint(m_TargetObjectPosition);
 	} else {
 		groundVelocity.setZero();
 	}
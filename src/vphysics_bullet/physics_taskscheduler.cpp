@@ -0,0 +1,184 @@
+// Copyright Valve Corporation, All rights reserved.
+// Bullet integration by Triang3l, derivative work, in public domain if detached from Valve's work.
+
+#include "physics_taskscheduler.h"
+
+#if BT_THREADSAFE
+
+CPhysicsTaskScheduler::CPhysicsTaskScheduler() : btITaskScheduler("VPhysics"),
+		m_NumThreads(1), m_Exiting(false), m_JobRunning(0),
+		m_JobForBody(nullptr), m_JobSumBody(nullptr) {}
+
+CPhysicsTaskScheduler::~CPhysicsTaskScheduler() {
+	Assert(!m_JobRunning);
+	m_Exiting = true;
+	int workerCount = m_Workers.Count();
+	for (int workerIndex = 0; workerIndex < workerCount; ++workerIndex) {
+		m_Workers[workerIndex]->m_WakeEvent.Set();
+	}
+	for (int workerIndex = 0; workerIndex < workerCount; ++workerIndex) {
+		WorkerThread *worker = m_Workers[workerIndex];
+		worker->Join();
+		VPhysicsDelete(WorkerThread, worker);
+	}
+}
+
+int CPhysicsTaskScheduler::getMaxNumThreads() const {
+	return MIN((int) GetCPUInformation()->m_nLogicalProcessors, (int) BT_MAX_THREAD_COUNT);
+}
+
+int CPhysicsTaskScheduler::getNumThreads() const {
+	return m_NumThreads;
+}
+
+void CPhysicsTaskScheduler::setNumThreads(int numThreads) {
+	Assert(!m_JobRunning);
+	m_NumThreads = clamp(numThreads, 1, getMaxNumThreads());
+	for (int workerIndex = m_Workers.Count(); workerIndex < m_NumThreads - 1; ++workerIndex) {
+		WorkerThread *worker = VPhysicsNew(WorkerThread, this, workerIndex + 1);
+		worker->SetName("VPhysics Worker");
+		if (!worker->Start()) {
+			DevMsg("Failed to start a physics worker thread, using %d threads.\n", workerIndex + 1);
+			VPhysicsDelete(WorkerThread, worker);
+			m_NumThreads = workerIndex + 1;
+			break;
+		}
+		m_Workers.AddToTail(worker);
+	}
+}
+
+int CPhysicsTaskScheduler::BeginJob(int iBegin, int iEnd, int grainSize) {
+	grainSize = MAX(grainSize, 1);
+	int chunkCount = (iEnd - iBegin + grainSize - 1) / grainSize;
+	int workerCount = MAX(MIN(chunkCount, m_NumThreads) - 1, 0);
+	if (workerCount == 0) {
+		return 0;
+	}
+	// Nested loop from a worker or from the thread running one, or a loop started by another thread.
+	if (ThreadInterlockedCompareExchange(&m_JobRunning, 1, 0) != 0) {
+		return 0;
+	}
+	return workerCount;
+}
+
+void CPhysicsTaskScheduler::parallelFor(int iBegin, int iEnd, int grainSize, const btIParallelForBody &body) {
+	int workerCount = BeginJob(iBegin, iEnd, grainSize);
+	if (workerCount == 0) {
+		if (iBegin < iEnd) {
+			body.forLoop(iBegin, iEnd);
+		}
+		return;
+	}
+	m_JobForBody = &body;
+	m_JobSumBody = nullptr;
+	RunJob(iBegin, iEnd, grainSize, workerCount);
+}
+
+btScalar CPhysicsTaskScheduler::parallelSum(int iBegin, int iEnd, int grainSize, const btIParallelSumBody &body) {
+	int workerCount = BeginJob(iBegin, iEnd, grainSize);
+	if (workerCount == 0) {
+		return (iBegin < iEnd ? body.sumLoop(iBegin, iEnd) : btScalar(0.0f));
+	}
+	m_JobForBody = nullptr;
+	m_JobSumBody = &body;
+	RunJob(iBegin, iEnd, grainSize, workerCount);
+	btScalar sum = 0.0f;
+	for (int participantIndex = 0; participantIndex <= workerCount; ++participantIndex) {
+		sum += m_JobSums[participantIndex];
+	}
+	return sum;
+}
+
+void CPhysicsTaskScheduler::RunJob(int iBegin, int iEnd, int grainSize, int workerCount) {
+	m_JobNextIndex = iBegin;
+	m_JobEnd = iEnd;
+	m_JobGrainSize = MAX(grainSize, 1);
+	m_JobParticipantsRunning = workerCount + 1;
+	// Setting an event is a full barrier, so workers see the job parameters written above.
+	for (int workerIndex = 0; workerIndex < workerCount; ++workerIndex) {
+		m_Workers[workerIndex]->m_WakeEvent.Set();
+	}
+	ProcessJobChunks(0);
+	if (ThreadInterlockedDecrement(&m_JobParticipantsRunning) != 0) {
+		m_JobDoneEvent.Wait();
+	}
+	ThreadInterlockedExchange(&m_JobRunning, 0);
+}
+
+void CPhysicsTaskScheduler::ProcessJobChunks(int participantIndex) {
+	btScalar sum = 0.0f;
+	for (;;) {
+		int chunkBegin = ThreadInterlockedExchangeAdd(&m_JobNextIndex, m_JobGrainSize);
+		if (chunkBegin >= m_JobEnd) {
+			break;
+		}
+		int chunkEnd = MIN(chunkBegin + m_JobGrainSize, m_JobEnd);
+		if (m_JobSumBody != nullptr) {
+			sum += m_JobSumBody->sumLoop(chunkBegin, chunkEnd);
+		} else {
+			m_JobForBody->forLoop(chunkBegin, chunkEnd);
+		}
+	}
+	m_JobSums[participantIndex] = sum;
+}
+
+void CPhysicsTaskScheduler::NotifyParticipantDone() {
+	if (ThreadInterlockedDecrement(&m_JobParticipantsRunning) == 0) {
+		m_JobDoneEvent.Set();
+	}
+}
+
+int CPhysicsTaskScheduler::WorkerThread::Run() {
+	for (;;) {
+		m_WakeEvent.Wait();
+		if (m_Scheduler->m_Exiting) {
+			break;
+		}
+		m_Scheduler->ProcessJobChunks(m_ParticipantIndex);
+		m_Scheduler->NotifyParticipantDone();
+	}
+	return 0;
+}
+
+static CPhysicsTaskScheduler *s_TaskScheduler = nullptr;
+static int s_TaskSchedulerRequestedThreads = 0;
+
+int VPhysicsSetupTaskScheduler(int threadCount) {
+	if (threadCount <= 1) {
+		return 1;
+	}
+	if (s_TaskScheduler == nullptr) {
+		s_TaskScheduler = VPhysicsNew(CPhysicsTaskScheduler);
+		s_TaskScheduler->setNumThreads(threadCount);
+		s_TaskSchedulerRequestedThreads = threadCount;
+		btSetTaskScheduler(s_TaskScheduler);
+	} else if (threadCount != s_TaskSchedulerRequestedThreads) {
+		// Changing the worker count would resize the pools under the solvers of the existing environments.
+		DevMsg("The physics thread count can't be changed while the physics module is running, using %d threads.\n",
+				s_TaskScheduler->getNumThreads());
+	}
+	return s_TaskScheduler->getNumThreads();
+}
+
+void VPhysicsShutdownTaskScheduler() {
+	if (s_TaskScheduler == nullptr) {
+		return;
+	}
+	btSetTaskScheduler(btGetSequentialTaskScheduler());
+	VPhysicsDelete(CPhysicsTaskScheduler, s_TaskScheduler);
+	s_TaskScheduler = nullptr;
+	s_TaskSchedulerRequestedThreads = 0;
+}
+
+#else
+
+int VPhysicsSetupTaskScheduler(int threadCount) {
+	if (threadCount > 1) {
+		DevMsg("Bullet was built without BT_THREADSAFE, physics will be simulated on one thread.\n");
+	}
+	return 1;
+}
+
+void VPhysicsShutdownTaskScheduler() {}
+
+#endif
@@ -0,0 +1,74 @@
+// Copyright Valve Corporation, All rights reserved.
+// Bullet integration by Triang3l, derivative work, in public domain if detached from Valve's work.
+
+#ifndef PHYSICS_TASKSCHEDULER_H
+#define PHYSICS_TASKSCHEDULER_H
+
+#include "physics_internal.h"
+#include <LinearMath/btThreads.h>
+
+// Multithreading requires Bullet to be built with BT_THREADSAFE, otherwise it never calls the scheduler.
+#if BT_THREADSAFE
+
+#include "tier0/threadtools.h"
+#include "tier1/utlvector.h"
+
+// Runs Bullet's parallel loops on tier0 threads.
+// The thread starting a loop participates in it, so N threads means N - 1 workers.
+// Only one loop runs at a time - nested loops, and loops started by other threads while one is running,
+// are executed serially by the thread calling the scheduler.
+class CPhysicsTaskScheduler : public btITaskScheduler {
+public:
+	CPhysicsTaskScheduler();
+	virtual ~CPhysicsTaskScheduler();
+
+	virtual int getMaxNumThreads() const;
+	virtual int getNumThreads() const;
+	virtual void setNumThreads(int numThreads);
+	virtual void parallelFor(int iBegin, int iEnd, int grainSize, const btIParallelForBody &body);
+	virtual btScalar parallelSum(int iBegin, int iEnd, int grainSize, const btIParallelSumBody &body);
+
+private:
+	class WorkerThread : public CThread {
+	public:
+		WorkerThread(CPhysicsTaskScheduler *scheduler, int participantIndex) :
+				m_Scheduler(scheduler), m_ParticipantIndex(participantIndex) {}
+		CThreadEvent m_WakeEvent;
+	protected:
+		virtual int Run();
+	private:
+		CPhysicsTaskScheduler *m_Scheduler;
+		int m_ParticipantIndex;
+	};
+	// Workers are only created when needed and are kept until shutdown.
+	CUtlVector<WorkerThread *> m_Workers;
+	int m_NumThreads;
+	bool m_Exiting;
+
+	// The loop being executed, claimed atomically by the thread starting it.
+	volatile long m_JobRunning;
+	const btIParallelForBody *m_JobForBody;
+	const btIParallelSumBody *m_JobSumBody;
+	int m_JobEnd, m_JobGrainSize;
+	volatile long m_JobNextIndex;
+	volatile long m_JobParticipantsRunning;
+	CThreadEvent m_JobDoneEvent;
+	btScalar m_JobSums[BT_MAX_THREAD_COUNT];
+
+	// Returns the number of workers to wake, or 0 if the loop must be executed serially without claiming the job.
+	int BeginJob(int iBegin, int iEnd, int grainSize);
+	void RunJob(int iBegin, int iEnd, int grainSize, int workerCount);
+	void ProcessJobChunks(int participantIndex);
+	void NotifyParticipantDone();
+};
+
+#endif
+
+// Installs the shared scheduler with the requested thread count as Bullet's task scheduler.
+// The thread count is only set when the scheduler is created, as existing worlds are sized for it.
+// Returns the number of threads that will actually be used, 1 if Bullet can't run multithreaded.
+int VPhysicsSetupTaskScheduler(int threadCount);
+// Stops the worker threads, must be called when no environment is being simulated.
+void VPhysicsShutdownTaskScheduler();
+
+#endif
@@ -0,0 +1,218 @@
+// Copyright Valve Corporation, All rights reserved.
+// Bullet integration by Triang3l, derivative work, in public domain if detached from Valve's work.
+
+#include "physics_velocitybatch.h"
+
+#ifndef BT_USE_DOUBLE_PRECISION
+
+#include "physics_object.h"
+
+/********
+ * Lanes
+ ********/
+
+template<typename Group>
+int CPhysicsVelocityBatch::AddLane(btAlignedObjectArray<Group> &groups, int objectIndex) {
+	int lane = objectIndex & 3;
+	if (lane == 0) {
+		groups.expandNonInitializing();
+		memset(&groups[groups.size() - 1], 0, sizeof(Group));
+	}
+	return lane;
+}
+
+static FORCEINLINE void SetLane(FourVectors &vectors, int lane, const btVector3 &value) {
+	vectors.X(lane) = value.getX();
+	vectors.Y(lane) = value.getY();
+	vectors.Z(lane) = value.getZ();
+}
+
+static FORCEINLINE btVector3 GetLane(const FourVectors &vectors, int lane) {
+	return btVector3(vectors.X(lane), vectors.Y(lane), vectors.Z(lane));
+}
+
+void CPhysicsVelocityBatch::GatherRigidBody(const CPhysicsObject *object, int lane,
+		FourVectors &linearVelocity, FourVectors &angularVelocity, FourVectors basis[3]) {
+	const btRigidBody *rigidBody = object->GetRigidBody();
+	SetLane(linearVelocity, lane, rigidBody->getLinearVelocity());
+	SetLane(angularVelocity, lane, rigidBody->getAngularVelocity());
+	const btMatrix3x3 &worldTransformBasis = rigidBody->getWorldTransform().getBasis();
+	for (int column = 0; column < 3; ++column) {
+		SetLane(basis[column], lane, worldTransformBasis.getColumn(column));
+	}
+}
+
+void CPhysicsVelocityBatch::ScatterRigidBody(CPhysicsObject *object, int lane,
+		const FourVectors &linearVelocity, const FourVectors &angularVelocity) {
+	btRigidBody *rigidBody = object->GetRigidBody();
+	rigidBody->setLinearVelocity(GetLane(linearVelocity, lane));
+	rigidBody->setAngularVelocity(GetLane(angularVelocity, lane));
+}
+
+/**********
+ * Kernels
+ **********/
+
+static FORCEINLINE fltx4 AbsoluteSIMD(const fltx4 &value) {
+	return MaxSIMD(value, SubSIMD(Four_Zeros, value));
+}
+
+// Same as in CPhysicsObject::ApplyDamping - linear for small damping, exponential for large.
+static FORCEINLINE fltx4 ComputeDampingFactors(const fltx4 &damping, const fltx4 &speed2,
+		const fltx4 &sleepingThreshold2, const fltx4 &exponentialThreshold) {
+	fltx4 totalDamping = AddSIMD(damping,
+			AndSIMD(CmpLtSIMD(speed2, sleepingThreshold2), ReplicateX4(0.1f)));
+	fltx4 factors = SubSIMD(Four_Ones, totalDamping);
+	fltx4 exponentialMask = CmpGeSIMD(totalDamping, exponentialThreshold);
+	if (TestSignSIMD(exponentialMask) != 0) {
+		// ExpSIMD is 2^x.
+		factors = MaskedAssign(exponentialMask,
+				ExpSIMD(MulSIMD(totalDamping, ReplicateX4(-1.44269504f))), factors);
+	}
+	return MaskedAssign(CmpGeSIMD(damping, Four_Zeros), factors, Four_Ones);
+}
+
+static FORCEINLINE void ClampSpeeds(FourVectors &velocity, const fltx4 &minSpeed, const fltx4 &maxSpeed) {
+	velocity.x = MaxSIMD(minSpeed, MinSIMD(maxSpeed, velocity.x));
+	velocity.y = MaxSIMD(minSpeed, MinSIMD(maxSpeed, velocity.y));
+	velocity.z = MaxSIMD(minSpeed, MinSIMD(maxSpeed, velocity.z));
+}
+
+// Velocity in the object space, same as velocity * basis for btVector3.
+static FORCEINLINE FourVectors RotateToLocal(const FourVectors &velocity, const FourVectors basis[3]) {
+	FourVectors localVelocity;
+	localVelocity.x = basis[0] * velocity;
+	localVelocity.y = basis[1] * velocity;
+	localVelocity.z = basis[2] * velocity;
+	return localVelocity;
+}
+
+static FORCEINLINE FourVectors RotateToWorld(const FourVectors &localVelocity, const FourVectors basis[3]) {
+	FourVectors velocity = basis[0], column;
+	velocity *= localVelocity.x;
+	column = basis[1];
+	column *= localVelocity.y;
+	velocity += column;
+	column = basis[2];
+	column *= localVelocity.z;
+	velocity += column;
+	return velocity;
+}
+
+// Drag force from the local velocity, same as in CPhysicsObject::ApplyDrag, 0 if not slowing down.
+static FORCEINLINE fltx4 ComputeDragForces(const FourVectors &localVelocity,
+		const FourVectors &dragBasis, const fltx4 &dragScale) {
+	fltx4 drag = AddSIMD(AddSIMD(
+			AbsoluteSIMD(MulSIMD(localVelocity.x, dragBasis.x)),
+			AbsoluteSIMD(MulSIMD(localVelocity.y, dragBasis.y))),
+			AbsoluteSIMD(MulSIMD(localVelocity.z, dragBasis.z)));
+	fltx4 forces = MulSIMD(drag, dragScale);
+	return AndSIMD(CmpLtSIMD(forces, Four_Zeros), MaxSIMD(forces, Four_NegativeOnes));
+}
+
+/**************
+ * Force stage
+ **************/
+
+void CPhysicsVelocityBatch::BeginForceStage() {
+	m_ForceGroups.resizeNoInitialize(0);
+	m_ForceObjects.RemoveAll();
+}
+
+void CPhysicsVelocityBatch::AddForceObject(CPhysicsObject *object, const ForceStageParameters_t &parameters) {
+	int objectIndex = m_ForceObjects.AddToTail(object);
+	int lane = AddLane(m_ForceGroups, objectIndex);
+	ForceGroup &group = m_ForceGroups[m_ForceGroups.size() - 1];
+	GatherRigidBody(object, lane, group.m_LinearVelocity, group.m_AngularVelocity, group.m_Basis);
+	SetLane(group.m_LinearVelocityChange, lane, parameters.m_LinearVelocityChange);
+	SetLane(group.m_LocalAngularVelocityChange, lane, parameters.m_LocalAngularVelocityChange);
+	SetLane(group.m_GravityVelocity, lane, parameters.m_GravityVelocity);
+	SubFloat(group.m_LinearDamping, lane) = parameters.m_LinearDamping;
+	SubFloat(group.m_AngularDamping, lane) = parameters.m_AngularDamping;
+	SubFloat(group.m_LinearSleepingThreshold2, lane) =
+			parameters.m_LinearSleepingThreshold * parameters.m_LinearSleepingThreshold;
+	SubFloat(group.m_AngularSleepingThreshold2, lane) =
+			parameters.m_AngularSleepingThreshold * parameters.m_AngularSleepingThreshold;
+}
+
+void CPhysicsVelocityBatch::RunForceStage(btScalar maxSpeed, btScalar maxAngularSpeed) {
+	fltx4 maxSpeed4 = ReplicateX4(maxSpeed), minSpeed4 = ReplicateX4(-maxSpeed);
+	fltx4 maxAngularSpeed4 = ReplicateX4(maxAngularSpeed), minAngularSpeed4 = ReplicateX4(-maxAngularSpeed);
+	fltx4 linearExponentialThreshold = ReplicateX4(0.25f), angularExponentialThreshold = ReplicateX4(0.4f);
+
+	int groupCount = m_ForceGroups.size();
+	for (int groupIndex = 0; groupIndex < groupCount; ++groupIndex) {
+		ForceGroup &group = m_ForceGroups[groupIndex];
+		FourVectors &linearVelocity = group.m_LinearVelocity, &angularVelocity = group.m_AngularVelocity;
+
+		linearVelocity *= ComputeDampingFactors(group.m_LinearDamping, linearVelocity.length2(),
+				group.m_LinearSleepingThreshold2, linearExponentialThreshold);
+		angularVelocity *= ComputeDampingFactors(group.m_AngularDamping, angularVelocity.length2(),
+				group.m_AngularSleepingThreshold2, angularExponentialThreshold);
+
+		linearVelocity += group.m_LinearVelocityChange;
+		ClampSpeeds(linearVelocity, minSpeed4, maxSpeed4);
+		FourVectors localAngularVelocity = RotateToLocal(angularVelocity, group.m_Basis);
+		localAngularVelocity += group.m_LocalAngularVelocityChange;
+		ClampSpeeds(localAngularVelocity, minAngularSpeed4, maxAngularSpeed4);
+		angularVelocity = RotateToWorld(localAngularVelocity, group.m_Basis);
+
+		linearVelocity += group.m_GravityVelocity;
+	}
+
+	int objectCount = m_ForceObjects.Count();
+	for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex) {
+		const ForceGroup &group = m_ForceGroups[objectIndex >> 2];
+		ScatterRigidBody(m_ForceObjects[objectIndex], objectIndex & 3,
+				group.m_LinearVelocity, group.m_AngularVelocity);
+	}
+}
+
+/*************
+ * Drag stage
+ *************/
+
+void CPhysicsVelocityBatch::BeginDragStage() {
+	m_DragGroups.resizeNoInitialize(0);
+	m_DragObjects.RemoveAll();
+}
+
+void CPhysicsVelocityBatch::AddDragObject(CPhysicsObject *object,
+		const btVector3 &linearDragBasis, btScalar linearDragScale,
+		const btVector3 &angularDragBasis, btScalar angularDragScale) {
+	int objectIndex = m_DragObjects.AddToTail(object);
+	int lane = AddLane(m_DragGroups, objectIndex);
+	DragGroup &group = m_DragGroups[m_DragGroups.size() - 1];
+	GatherRigidBody(object, lane, group.m_LinearVelocity, group.m_AngularVelocity, group.m_Basis);
+	SetLane(group.m_LinearDragBasis, lane, linearDragBasis);
+	SetLane(group.m_AngularDragBasis, lane, angularDragBasis);
+	SubFloat(group.m_LinearDragScale, lane) = linearDragScale;
+	SubFloat(group.m_AngularDragScale, lane) = angularDragScale;
+}
+
+void CPhysicsVelocityBatch::RunDragStage() {
+	int groupCount = m_DragGroups.size();
+	for (int groupIndex = 0; groupIndex < groupCount; ++groupIndex) {
+		DragGroup &group = m_DragGroups[groupIndex];
+		FourVectors velocityChange;
+
+		velocityChange = group.m_LinearVelocity;
+		velocityChange *= ComputeDragForces(RotateToLocal(group.m_LinearVelocity, group.m_Basis),
+				group.m_LinearDragBasis, group.m_LinearDragScale);
+		group.m_LinearVelocity += velocityChange;
+
+		velocityChange = group.m_AngularVelocity;
+		velocityChange *= ComputeDragForces(RotateToLocal(group.m_AngularVelocity, group.m_Basis),
+				group.m_AngularDragBasis, group.m_AngularDragScale);
+		group.m_AngularVelocity += velocityChange;
+	}
+
+	int objectCount = m_DragObjects.Count();
+	for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex) {
+		const DragGroup &group = m_DragGroups[objectIndex >> 2];
+		ScatterRigidBody(m_DragObjects[objectIndex], objectIndex & 3,
+				group.m_LinearVelocity, group.m_AngularVelocity);
+	}
+}
+
+#endif
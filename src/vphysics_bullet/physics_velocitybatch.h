@@ -0,0 +1,76 @@
+// Copyright Valve Corporation, All rights reserved.
+// Bullet integration by Triang3l, derivative work, in public domain if detached from Valve's work.
+
+#ifndef PHYSICS_VELOCITYBATCH_H
+#define PHYSICS_VELOCITYBATCH_H
+
+#include "physics_internal.h"
+
+// The kernels work on single-precision vectors, with double-precision Bullet objects are processed one by one.
+#ifndef BT_USE_DOUBLE_PRECISION
+
+#include "mathlib/ssemath.h"
+#include "tier1/utlvector.h"
+
+class CPhysicsObject;
+
+// Velocity stages of the pre-tick that don't call into the game - damping, async forces with the speed limit,
+// gravity and drag - processed for four objects at once.
+// Objects are gathered with their parameters into groups of four (x x x x y y y y z z z z vectors),
+// then the stage is run over all groups, and the velocities are scattered back to the rigid bodies.
+class CPhysicsVelocityBatch {
+public:
+	struct ForceStageParameters_t {
+		btVector3 m_LinearVelocityChange, m_LocalAngularVelocityChange;
+		// Damping multiplied by the time step, negative if the velocity must not be damped.
+		btScalar m_LinearDamping, m_AngularDamping;
+		btScalar m_LinearSleepingThreshold, m_AngularSleepingThreshold;
+		btVector3 m_GravityVelocity; // Gravity multiplied by the time step.
+	};
+
+	// Damping, async velocity changes with the speed limit and gravity, in this order.
+	void BeginForceStage();
+	void AddForceObject(CPhysicsObject *object, const ForceStageParameters_t &parameters);
+	void RunForceStage(btScalar maxSpeed, btScalar maxAngularSpeed);
+
+	// Drag scales are the coefficients multiplied by the air density, the time step and -1 (-0.5 for linear).
+	// The angular drag basis must include the local inverse inertia.
+	void BeginDragStage();
+	void AddDragObject(CPhysicsObject *object,
+			const btVector3 &linearDragBasis, btScalar linearDragScale,
+			const btVector3 &angularDragBasis, btScalar angularDragScale);
+	void RunDragStage();
+
+private:
+	struct ForceGroup {
+		FourVectors m_LinearVelocity, m_AngularVelocity;
+		FourVectors m_Basis[3]; // Columns of the world transform basis.
+		FourVectors m_LinearVelocityChange, m_LocalAngularVelocityChange;
+		FourVectors m_GravityVelocity;
+		fltx4 m_LinearDamping, m_AngularDamping;
+		fltx4 m_LinearSleepingThreshold2, m_AngularSleepingThreshold2;
+	};
+	btAlignedObjectArray<ForceGroup> m_ForceGroups;
+	CUtlVector<CPhysicsObject *> m_ForceObjects;
+
+	struct DragGroup {
+		FourVectors m_LinearVelocity, m_AngularVelocity;
+		FourVectors m_Basis[3];
+		FourVectors m_LinearDragBasis, m_AngularDragBasis;
+		fltx4 m_LinearDragScale, m_AngularDragScale;
+	};
+	btAlignedObjectArray<DragGroup> m_DragGroups;
+	CUtlVector<CPhysicsObject *> m_DragObjects;
+
+	// Returns the lane in the last group, appending a zeroed group if needed so padding lanes are harmless.
+	template<typename Group>
+	static int AddLane(btAlignedObjectArray<Group> &groups, int objectIndex);
+	static void GatherRigidBody(const CPhysicsObject *object, int lane,
+			FourVectors &linearVelocity, FourVectors &angularVelocity, FourVectors basis[3]);
+	static void ScatterRigidBody(CPhysicsObject *object, int lane,
+			const FourVectors &linearVelocity, const FourVectors &angularVelocity);
+};
+
+#endif
+
+#endif
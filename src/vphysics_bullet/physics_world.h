@@ -0,0 +1,166 @@
+// Copyright Valve Corporation, All rights reserved.
+// Bullet integration by Triang3l, derivative work, in public domain if detached from Valve's work.
+
+#ifndef PHYSICS_WORLD_H
+#define PHYSICS_WORLD_H
+
+#include "physics_internal.h"
+#include "physics_environment.h"
+#include <utility>
+
+// Dynamics world measuring the time taken by the stages of Bullet's simulation step,
+// and sweeping compound shapes for continuous collision detection, which Bullet only does for convex ones.
+// BaseWorld is either btDiscreteDynamicsWorld or btDiscreteDynamicsWorldMt.
+template<class BaseWorld>
+class CPhysicsDynamicsWorld : public BaseWorld {
+public:
+	template<typename... Arguments>
+	CPhysicsDynamicsWorld(CPhysicsEnvironment *environment, Arguments&&... arguments) :
+			BaseWorld(std::forward<Arguments>(arguments)...), m_Environment(environment) {}
+
+	// Same as in btCollisionWorld, but split into the broadphase and the narrowphase.
+	virtual void performDiscreteCollisionDetection() {
+		{
+			CTimeAdder timeAdder(m_Environment->GetPhaseTime(CPhysicsEnvironment::PHASE_BROADPHASE));
+			this->updateAabbs();
+			this->computeOverlappingPairs();
+		}
+		btDispatcher *dispatcher = this->getDispatcher();
+		if (dispatcher != nullptr) {
+			CTimeAdder timeAdder(m_Environment->GetPhaseTime(CPhysicsEnvironment::PHASE_NARROWPHASE));
+			dispatcher->dispatchAllCollisionPairs(this->getBroadphase()->getOverlappingPairCache(),
+					this->getDispatchInfo(), dispatcher);
+		}
+	}
+
+protected:
+	virtual void solveConstraints(btContactSolverInfo &solverInfo) {
+		CTimeAdder timeAdder(m_Environment->GetPhaseTime(CPhysicsEnvironment::PHASE_SOLVER));
+		BaseWorld::solveConstraints(solverInfo);
+	}
+
+	virtual void predictUnconstraintMotion(btScalar timeStep) {
+		CTimeAdder timeAdder(m_Environment->GetPhaseTime(CPhysicsEnvironment::PHASE_INTEGRATION));
+		BaseWorld::predictUnconstraintMotion(timeStep);
+	}
+
+	virtual void integrateTransforms(btScalar timeStep) {
+		CTimeAdder timeAdder(m_Environment->GetPhaseTime(CPhysicsEnvironment::PHASE_INTEGRATION));
+		ClampCompoundMotions(timeStep);
+		BaseWorld::integrateTransforms(timeStep);
+		RestoreClampedVelocities();
+	}
+
+private:
+	CPhysicsEnvironment *m_Environment;
+
+	// Same sweep as Bullet's for convex shapes - a sphere along the motion of the center of mass,
+	// stopping only at surfaces the object is moving into, and respecting the collision rules of the game.
+	class ContinuousCollisionCallback : public btCollisionWorld::ClosestConvexResultCallback {
+	public:
+		ContinuousCollisionCallback(CPhysicsEnvironment *environment, const btCollisionObject *object,
+				const btVector3 &from, const btVector3 &to, btScalar allowedPenetration) :
+				btCollisionWorld::ClosestConvexResultCallback(from, to),
+				m_Environment(environment), m_Object(object), m_AllowedPenetration(allowedPenetration) {}
+
+		virtual bool needsCollision(btBroadphaseProxy *proxy0) const {
+			const btCollisionObject *otherObject = static_cast<const btCollisionObject *>(proxy0->m_clientObject);
+			if (otherObject == m_Object || !otherObject->hasContactResponse() ||
+					!btCollisionWorld::ClosestConvexResultCallback::needsCollision(proxy0)) {
+				return false;
+			}
+			return m_Environment->NeedCollision(reinterpret_cast<IPhysicsObject *>(m_Object->getUserPointer()),
+					reinterpret_cast<IPhysicsObject *>(otherObject->getUserPointer()));
+		}
+
+		virtual btScalar addSingleResult(btCollisionWorld::LocalConvexResult &convexResult, bool normalInWorldSpace) {
+			btVector3 normal = convexResult.m_hitNormalLocal;
+			if (!normalInWorldSpace) {
+				normal = convexResult.m_hitCollisionObject->getWorldTransform().getBasis() * normal;
+			}
+			if (normal.dot(m_convexToWorld - m_convexFromWorld) >= -m_AllowedPenetration) {
+				return btScalar(1.0f);
+			}
+			return btCollisionWorld::ClosestConvexResultCallback::addSingleResult(convexResult, true);
+		}
+
+	private:
+		CPhysicsEnvironment *m_Environment;
+		const btCollisionObject *m_Object;
+		btScalar m_AllowedPenetration;
+	};
+
+	// Model collisions are compound shapes even when they consist of a single convex, so they're swept here,
+	// and their velocities are scaled for the step so Bullet's integration stops them at the hit.
+	struct ClampedBody_t {
+		btRigidBody *m_Body;
+		btVector3 m_LinearVelocity, m_AngularVelocity;
+		btVector3 m_Origin, m_Motion; // For the tunneling check.
+		btScalar m_HitFraction;
+	};
+	btAlignedObjectArray<ClampedBody_t> m_ClampedBodies;
+
+	void ClampCompoundMotions(btScalar timeStep) {
+		m_ClampedBodies.resizeNoInitialize(0);
+		const btDispatcherInfo &dispatchInfo = this->getDispatchInfo();
+		if (!dispatchInfo.m_useContinuous) {
+			return;
+		}
+		btAlignedObjectArray<btRigidBody *> &bodies = this->m_nonStaticRigidBodies;
+		int bodyCount = bodies.size();
+		for (int bodyIndex = 0; bodyIndex < bodyCount; ++bodyIndex) {
+			btRigidBody *body = bodies[bodyIndex];
+			btScalar squareMotionThreshold = body->getCcdSquareMotionThreshold();
+			// Convex shapes are swept by Bullet itself.
+			if (squareMotionThreshold <= 0.0f || !body->isActive() || body->isStaticOrKinematicObject() ||
+					body->getCollisionShape()->isConvex() || body->getBroadphaseHandle() == nullptr) {
+				continue;
+			}
+			const btTransform &transform = body->getWorldTransform();
+			btTransform predictedTransform;
+			body->predictIntegratedTransform(timeStep, predictedTransform);
+			btVector3 motion = predictedTransform.getOrigin() - transform.getOrigin();
+			if (motion.length2() <= squareMotionThreshold) {
+				continue;
+			}
+
+			ContinuousCollisionCallback callback(m_Environment, body, transform.getOrigin(),
+					predictedTransform.getOrigin(), dispatchInfo.m_allowedCcdPenetration);
+			const btBroadphaseProxy *proxy = body->getBroadphaseHandle();
+			callback.m_collisionFilterGroup = proxy->m_collisionFilterGroup;
+			callback.m_collisionFilterMask = proxy->m_collisionFilterMask;
+			btSphereShape sphere(body->getCcdSweptSphereRadius());
+			this->convexSweepTest(&sphere, transform,
+					btTransform(transform.getBasis(), predictedTransform.getOrigin()), callback);
+			if (!callback.hasHit() || callback.m_closestHitFraction >= 1.0f) {
+				continue;
+			}
+
+			ClampedBody_t &clampedBody = m_ClampedBodies.expandNonInitializing();
+			clampedBody.m_Body = body;
+			clampedBody.m_LinearVelocity = body->getLinearVelocity();
+			clampedBody.m_AngularVelocity = body->getAngularVelocity();
+			clampedBody.m_Origin = transform.getOrigin();
+			clampedBody.m_Motion = motion;
+			clampedBody.m_HitFraction = callback.m_closestHitFraction;
+			// Integrating with the scaled velocity is the same as integrating over the part of the step.
+			body->setLinearVelocity(clampedBody.m_LinearVelocity * callback.m_closestHitFraction);
+			body->setAngularVelocity(clampedBody.m_AngularVelocity * callback.m_closestHitFraction);
+		}
+	}
+
+	void RestoreClampedVelocities() {
+		int clampedCount = m_ClampedBodies.size();
+		for (int clampedIndex = 0; clampedIndex < clampedCount; ++clampedIndex) {
+			const ClampedBody_t &clampedBody = m_ClampedBodies[clampedIndex];
+			btRigidBody *body = clampedBody.m_Body;
+			// Tunneling check - the center must not have moved past the surface it was stopped at.
+			Assert((body->getWorldTransform().getOrigin() - clampedBody.m_Origin).dot(clampedBody.m_Motion) <=
+					clampedBody.m_HitFraction * clampedBody.m_Motion.length2() + SIMD_EPSILON);
+			body->setLinearVelocity(clampedBody.m_LinearVelocity);
+			body->setAngularVelocity(clampedBody.m_AngularVelocity);
+		}
+	}
+};
+
+#endif